@@ -0,0 +1,216 @@
+#include "algorithms.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "bcrypt.h"
+#include "scrypt.h"
+#include "tune.h"
+
+/* Offset of the nonce in a block header */
+#define POW_NONCE	76
+
+/* A testnet block header, and what each algorithm makes of it */
+static const unsigned char pow_test_header[NUDD_HEADER_SIZE] = {
+    0x70, 0x00, 0x00, 0x00, 0x9d, 0xa3, 0xe7, 0x1a, 0xfe, 0x06, 0x28, 0x50,
+    0x56, 0xf9, 0x17, 0xd2, 0x23, 0x43, 0xfa, 0xaf, 0x58, 0x65, 0x5c, 0xfa,
+    0x75, 0xbe, 0xb2, 0x68, 0x45, 0x2c, 0x08, 0x2c, 0x00, 0x00, 0x00, 0x00,
+    0xf5, 0x4b, 0x50, 0xa0, 0x0d, 0xe0, 0xf7, 0x76, 0x9b, 0x7a, 0x2c, 0x5b,
+    0x4b, 0x22, 0x03, 0x26, 0x9f, 0x50, 0xa1, 0xa5, 0xc6, 0x2d, 0x30, 0x1b,
+    0x10, 0xff, 0x5d, 0xc5, 0xa5, 0xe5, 0x1d, 0x57, 0x00, 0x6d, 0xd8, 0x52,
+    0x06, 0x0e, 0x63, 0x1c, 0xd0, 0x0b, 0x85, 0xd6
+};
+
+static const unsigned char nudd_test_hash[NUDD_HASH_SIZE] = {
+    0xe9, 0x6b, 0xae, 0x80, 0xee, 0x8b, 0xcd, 0x42, 0xf2, 0x83, 0x34, 0xd7,
+    0x6b, 0xe6, 0xf5, 0xe7, 0xf4, 0x1b, 0xbd, 0xcf, 0xc2, 0xbc, 0xf8, 0xff,
+    0x01, 0xbd, 0x2c, 0x25, 0x45, 0xd4, 0x34, 0x56
+};
+
+static const unsigned char scrypt_test_hash[NUDD_HASH_SIZE] = {
+    0x0e, 0x82, 0x22, 0xc6, 0xec, 0x7d, 0x6c, 0xf8, 0x40, 0x18, 0xa9, 0x66,
+    0x24, 0xbe, 0x6a, 0x18, 0x39, 0xd3, 0x2a, 0x76, 0x48, 0xe9, 0x6a, 0x89,
+    0x30, 0x08, 0x5d, 0xb3, 0x52, 0xfe, 0x63, 0xde
+};
+
+bool pow_algorithm::hash_batch(const char *headers, size_t count,
+    char *hashes, thread_pool& pool, pool_priority priority) const
+{
+    std::atomic<bool> failed(false);
+
+    pool.parallel_for(count, [&](size_t i) {
+        if (!hash(headers + i * NUDD_HEADER_SIZE, hashes + i * NUDD_HASH_SIZE))
+            failed = true;
+    }, priority);
+    return !failed;
+}
+
+bool pow_algorithm::scan(const char *header, const unsigned char *target,
+    uint32_t first, uint32_t count, std::vector<pow_found>& found) const
+{
+    char candidate[NUDD_HEADER_SIZE];
+    pow_found share;
+
+    memcpy(candidate, header, NUDD_HEADER_SIZE);
+    for (uint32_t n = 0; n < count; n++) {
+        share.nonce = first + n;
+        le32enc(candidate + POW_NONCE, share.nonce);
+        if (!hash(candidate, (char *)share.hash))
+            return false;
+        if (nudd_hash_meets_target((const char *)share.hash, target))
+            found.push_back(share);
+    }
+    return true;
+}
+
+bool pow_algorithm::scan_batch(const char *header,
+    const unsigned char *target, uint32_t first, uint32_t count,
+    std::vector<pow_found>& found, thread_pool& pool,
+    pool_priority priority) const
+{
+    /* One chunk per thread, so work shared between nonces is done once each */
+    size_t chunks = std::min<size_t>(count, pool.size() + 1);
+    std::vector<std::vector<pow_found> > results(chunks);
+    std::atomic<bool> failed(false);
+
+    pool.parallel_for(chunks, [&](size_t i) {
+        uint32_t begin = (uint32_t)((uint64_t)count * i / chunks);
+        uint32_t end = (uint32_t)((uint64_t)count * (i + 1) / chunks);
+
+        if (!scan(header, target, first + begin, end - begin, results[i]))
+            failed = true;
+    }, priority);
+    for (size_t i = 0; i < chunks; i++)
+        found.insert(found.end(), results[i].begin(), results[i].end());
+    return !failed;
+}
+
+bool pow_algorithm::self_test(thread_pool& pool) const
+{
+    static const unsigned char anything[NUDD_HASH_SIZE] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+    };
+    const char *header = (const char *)pow_test_header;
+    char headers[3 * NUDD_HEADER_SIZE], hashes[3 * NUDD_HASH_SIZE];
+    char expected[NUDD_HASH_SIZE];
+    std::vector<pow_found> found;
+    uint32_t nonce = le32dec(header + POW_NONCE);
+    int i;
+
+    if (!hash(header, expected) ||
+        memcmp(expected, test_hash, NUDD_HASH_SIZE))
+        return false;
+
+    for (i = 0; i < 3; i++) {
+        memcpy(headers + i * NUDD_HEADER_SIZE, header, NUDD_HEADER_SIZE);
+        le32enc(headers + i * NUDD_HEADER_SIZE + POW_NONCE, nonce - 1 + i);
+    }
+    if (!hash_batch(headers, 3, hashes, pool) ||
+        !scan_batch(header, anything, nonce - 1, 3, found, pool))
+        return false;
+    if (memcmp(hashes + NUDD_HASH_SIZE, expected, NUDD_HASH_SIZE) ||
+        found.size() != 3)
+        return false;
+    for (i = 0; i < 3; i++)
+        if (found[i].nonce != nonce - 1 + i ||
+            memcmp(found[i].hash, hashes + i * NUDD_HASH_SIZE, NUDD_HASH_SIZE))
+            return false;
+    return true;
+}
+
+/*
+ * The bcrypt-based hash of pow.h.  The nonce sits in the 20-byte suffix
+ * that bcrypt_iterated() hashes on its own, so a scan hashes the 60-byte
+ * prefix once and then costs one bcrypt call per nonce.
+ */
+class nudd_algorithm : public pow_algorithm {
+public:
+    nudd_algorithm() : pow_algorithm("nudd", nudd_test_hash) {}
+
+    /* Interleaving both halves wins on most hosts; the profile decides */
+    const char *kernel() const
+    {
+        return nudd_host_profile().lanes == 1 ? "serial" : "interleaved";
+    }
+
+    bool hash(const char *header, char *hash) const
+    {
+        if (nudd_host_profile().lanes == 1)
+            nudd_hash(header, hash);
+        else
+            nudd_hash_interleaved(header, hash);
+        return true;
+    }
+
+    bool scan(const char *header, const unsigned char *target,
+        uint32_t first, uint32_t count, std::vector<pow_found>& found) const
+    {
+        unsigned char suffix[NUDD_HEADER_SIZE - NUDD_SPLIT];
+        unsigned char high[BCRYPT_ITERATED_OUTPUT];
+        pow_found share;
+
+        if (!count)
+            return true;
+        bcrypt_iterated_single(header, NUDD_SPLIT, share.hash, NULL);
+        memcpy(suffix, header + NUDD_SPLIT, sizeof(suffix));
+        for (uint32_t n = 0; n < count; n++) {
+            share.nonce = first + n;
+            le32enc(suffix + POW_NONCE - NUDD_SPLIT, share.nonce);
+            bcrypt_iterated_single(suffix, sizeof(suffix), high, NULL);
+            memcpy(share.hash + BCRYPT_ITERATED_OUTPUT, high,
+                NUDD_HASH_SIZE - BCRYPT_ITERATED_OUTPUT);
+            if (nudd_hash_meets_target((const char *)share.hash, target))
+                found.push_back(share);
+        }
+        return true;
+    }
+};
+
+/*
+ * scrypt with N = 1024, r = 1, p = 1 and the header as both password and
+ * salt.  The general engine computes it with SSE2 Salsa20/8 where the
+ * build has it, and its V comes from the calling thread's arena.
+ */
+class scrypt_algorithm : public pow_algorithm {
+public:
+    scrypt_algorithm() : pow_algorithm("scrypt", scrypt_test_hash) {}
+
+    const char *kernel() const
+    {
+#ifdef __SSE2__
+        return "sse2";
+#else
+        return "generic";
+#endif
+    }
+
+    /* The parameters are fixed, so scrypt() can only fail to map V */
+    bool hash(const char *header, char *hash) const
+    {
+        return !scrypt((const uint8_t *)header, NUDD_HEADER_SIZE,
+            (const uint8_t *)header, NUDD_HEADER_SIZE, 1024, 1, 1,
+            (uint8_t *)hash, NUDD_HASH_SIZE);
+    }
+};
+
+std::vector<pow_algorithm const *> const& pow_algorithms()
+{
+    static const nudd_algorithm nudd;
+    static const scrypt_algorithm scrypt_1024;
+    static const std::vector<pow_algorithm const *> registry = {
+        &nudd, &scrypt_1024
+    };
+    return registry;
+}
+
+pow_algorithm const *pow_find(const char *name)
+{
+    for (pow_algorithm const *algorithm : pow_algorithms())
+        if (!strcmp(algorithm->name(), name))
+            return algorithm;
+    return NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef ALGORITHMS_H
+#define ALGORITHMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "pow.h"
+#include "threadpool.h"
+
+/* One nonce a scan found, with its hash */
+struct pow_found {
+    uint32_t nonce;
+    unsigned char hash[NUDD_HASH_SIZE];
+};
+
+/*
+ * A proof of work over 80-byte block headers with 32-byte little-endian
+ * hashes, whichever kernel computes it.  Implementations override hash()
+ * and, when part of the work can be shared between nonces, scan(); the
+ * batched and threaded paths are the same for every algorithm.
+ */
+class pow_algorithm {
+public:
+    virtual ~pow_algorithm() {}
+
+    const char *name() const { return algorithm_name; }
+
+    /* The kernel hash() runs on this host */
+    virtual const char *kernel() const = 0;
+
+    /* false if the hash could not be computed, for want of memory */
+    virtual bool hash(const char *header, char *hash) const = 0;
+
+    /*
+     * count contiguous headers into count contiguous hashes, on the pool;
+     * false if any hash() failed
+     */
+    bool hash_batch(const char *headers, size_t count, char *hashes,
+        thread_pool& pool, pool_priority priority = pool_foreground) const;
+
+    /*
+     * Hashes header (whose nonce is ignored) with every nonce in
+     * [first, first + count), appending those that meet the 32-byte target
+     * to found in nonce order.  The default hashes each header whole.
+     * false, with found incomplete, if a hash() failed.
+     */
+    virtual bool scan(const char *header, const unsigned char *target,
+        uint32_t first, uint32_t count, std::vector<pow_found>& found) const;
+
+    /* scan() split into chunks over the pool; found stays in nonce order */
+    bool scan_batch(const char *header, const unsigned char *target,
+        uint32_t first, uint32_t count, std::vector<pow_found>& found,
+        thread_pool& pool, pool_priority priority = pool_foreground) const;
+
+    /*
+     * Checks hash() against a known answer, and hash_batch() and scan()
+     * against hash().  Returns false if any of them disagree or fail.
+     */
+    bool self_test(thread_pool& pool) const;
+
+protected:
+    pow_algorithm(const char *name, const unsigned char *expected)
+        : algorithm_name(name), test_hash(expected) {}
+
+private:
+    pow_algorithm(pow_algorithm const&);
+    pow_algorithm& operator=(pow_algorithm const&);
+
+    const char *algorithm_name;
+    const unsigned char *test_hash;
+};
+
+/* Every registered algorithm, in a fixed order */
+std::vector<pow_algorithm const *> const& pow_algorithms();
+
+/* The algorithm registered as name, or NULL */
+pow_algorithm const *pow_find(const char *name);
+
+#endif
@@ -71,11 +71,15 @@
  */
 
 #include "bcrypt.h"
+#include "radix64.h"
+#include "threadpool.h"
+#include "trace.h"
 // #include "util.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <openssl/sha.h>
+
+#include "sha256.h"
 
 #if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
 #ifdef _MSC_VER
@@ -104,14 +108,43 @@ static inline void be32enc(void *pp, uint32_t x)
 }
 
 typedef struct HMAC_SHA256Context {
-	SHA256_CTX ictx;
-	SHA256_CTX octx;
+	sha256_ctx ictx;
+	sha256_ctx octx;
 } HMAC_SHA256_CTX;
 
 /* Initialize an HMAC-SHA256 operation with the given key. */
 static void
 HMAC_SHA256_Init(HMAC_SHA256_CTX *ctx, const void *_K, size_t Klen)
 {
+	unsigned char pad[64];
+	unsigned char khash[32];
+	const unsigned char *K = (const unsigned char *)_K;
+	size_t i;
+
+	/* If Klen > 64, the key is really SHA256(K). */
+	if (Klen > 64) {
+		sha256(K, Klen, khash);
+		K = khash;
+		Klen = 32;
+	}
+
+	/* Inner SHA256 operation is SHA256(K xor [block of 0x36] || data). */
+	sha256_init(&ctx->ictx);
+	memset(pad, 0x36, 64);
+	for (i = 0; i < Klen; i++)
+		pad[i] ^= K[i];
+	sha256_update(&ctx->ictx, pad, 64);
+
+	/* Outer SHA256 operation is SHA256(K xor [block of 0x5c] || hash). */
+	sha256_init(&ctx->octx);
+	memset(pad, 0x5c, 64);
+	for (i = 0; i < Klen; i++)
+		pad[i] ^= K[i];
+	sha256_update(&ctx->octx, pad, 64);
+
+	/* Clean the stack. */
+	memset(khash, 0, 32);
+	memset(pad, 0, 64);
 }
 
 /* Add bytes to the HMAC-SHA256 operation. */
@@ -119,12 +152,26 @@ static void
 HMAC_SHA256_Update(HMAC_SHA256_CTX *ctx, const void *in, size_t len)
 {
 	/* Feed data to the inner SHA256 operation. */
+	sha256_update(&ctx->ictx, in, len);
 }
 
 /* Finish an HMAC-SHA256 operation. */
 static void
 HMAC_SHA256_Final(unsigned char digest[32], HMAC_SHA256_CTX *ctx)
 {
+	unsigned char ihash[32];
+
+	/* Finish the inner SHA256 operation. */
+	sha256_final(&ctx->ictx, ihash);
+
+	/* Feed the inner hash to the outer SHA256 operation. */
+	sha256_update(&ctx->octx, ihash, 32);
+
+	/* Finish the outer SHA256 operation. */
+	sha256_final(&ctx->octx, digest);
+
+	/* Clean the stack. */
+	memset(ihash, 0, 32);
 }
 
 /**
@@ -146,6 +193,8 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 	size_t clen;
 
 	/* Compute HMAC state after processing P and S. */
+	HMAC_SHA256_Init(&PShctx, passwd, passwdlen);
+	HMAC_SHA256_Update(&PShctx, salt, saltlen);
 
 	/* Iterate through the blocks. */
 	for (i = 0; i * 32 < dkLen; i++) {
@@ -155,6 +204,7 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 		/* Compute U_1 = PRF(P, S || INT(i)). */
 		memcpy(&hctx, &PShctx, sizeof(HMAC_SHA256_CTX));
 		HMAC_SHA256_Update(&hctx, ivec, 4);
+		HMAC_SHA256_Final(U, &hctx);
 
 		/* T_i = U_1 ... */
 		memcpy(T, U, 32);
@@ -1021,8 +1071,14 @@ static void BF_swap(BF_word *x, int count)
 		*(ptr - 1) = R; \
 	} while (ptr < &data.ctx.S[3][0xFF]);
 
-static void BF_set_key(const char *key, size_t length, BF_key expanded, BF_key initial,
-    unsigned char flags)
+/*
+ * Flags == 0 takes the subtype flags from the argument; any other value fixes
+ * them at compile time, which lets the compiler drop the bug emulation or the
+ * safety measure below when they are not in effect.
+ */
+template <unsigned char Flags>
+static void BF_set_key_t(const char *key, size_t length, BF_key expanded,
+    BF_key initial, unsigned char flags)
 {
 	const char *ptr = key;
 	const char *end = ptr + length;
@@ -1063,6 +1119,8 @@ static void BF_set_key(const char *key, size_t length, BF_key expanded, BF_key i
  * Prefix "$2x$": bug = 1, safety = 0
  * Prefix "$2y$": bug = 0, safety = 0
  */
+	if (Flags)
+		flags = Flags;
 	bug = (unsigned int)flags & 1;
 	safety = ((BF_word)flags & 2) << 15;
 
@@ -1123,51 +1181,48 @@ static void BF_set_key(const char *key, size_t length, BF_key expanded, BF_key i
 	initial[0] ^= sign;
 }
 
-static char *BF_crypt(const char *key, size_t length, const char *setting,
-	char *output, int size,
-	BF_word min)
+static void BF_set_key(const char *key, size_t length, BF_key expanded,
+    BF_key initial, unsigned char flags)
+{
+	BF_set_key_t<0>(key, length, expanded, initial, flags);
+}
+
+typedef struct {
+	BF_ctx ctx;
+	BF_key expanded_key;
+	union {
+		BF_word salt[4];
+		BF_word output[6];
+	} binary;
+} BF_crypt_data;
+
+/*
+ * The expensive part of BF_crypt(): Eksblowfish setup with the salt already
+ * in data.binary.salt, then the 64 encryptions of the magic IV, leaving the
+ * raw result in data.binary.output.
+ *
+ * Cost < 0 and Flags == 0 take the cost and subtype flags from the count and
+ * flags arguments.  Instantiations with both fixed get a constant trip count
+ * for the main loop and a BF_set_key() specialized for the subtype.  The data
+ * lives in the caller's frame so that the self-test in _crypt_blowfish_rn()
+ * keeps overwriting the same stack locations whichever engine ran.
+ *
+ * Returns -1 if cancel fired before the main loop finished.
+ */
+template <int Cost, unsigned char Flags>
+static int BF_crypt_engine(BF_crypt_data &data, const char *key,
+	size_t length, BF_word count, unsigned char flags,
+	bcrypt_cancel const *cancel)
 {
-	static const unsigned char flags_by_subtype[26] =
-		{2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 4, 0};
-	struct {
-		BF_ctx ctx;
-		BF_key expanded_key;
-		union {
-			BF_word salt[4];
-			BF_word output[6];
-		} binary;
-	} data;
 	BF_word L, R;
 	BF_word tmp1, tmp2, tmp3, tmp4;
 	BF_word *ptr;
-	BF_word count;
-	int i;
+	int i, n;
 
-	if (size < 7 + 22 + 31 + 1) {
-		return NULL;
-	}
+	if (Cost >= 0)
+		count = (BF_word)1 << Cost;
 
-	if (setting[0] != '$' ||
-	    setting[1] != '2' ||
-	    setting[2] < 'a' || setting[2] > 'z' ||
-	    !flags_by_subtype[(unsigned int)(unsigned char)setting[2] - 'a'] ||
-	    setting[3] != '$' ||
-	    setting[4] < '0' || setting[4] > '3' ||
-	    setting[5] < '0' || setting[5] > '9' ||
-	    (setting[4] == '3' && setting[5] > '1') ||
-	    setting[6] != '$') {
-		return NULL;
-	}
-
-	count = (BF_word)1 << ((setting[4] - '0') * 10 + (setting[5] - '0'));
-	if (count < min || BF_decode(data.binary.salt, &setting[7], 16)) {
-		return NULL;
-	}
-	BF_swap(data.binary.salt, 4);
-
-	BF_set_key(key, length, data.expanded_key, data.ctx.P,
-	    flags_by_subtype[(unsigned int)(unsigned char)setting[2] - 'a']);
+	BF_set_key_t<Flags>(key, length, data.expanded_key, data.ctx.P, flags);
 
 	memcpy(data.ctx.S, BF_init_state.S, sizeof(data.ctx.S));
 
@@ -1197,48 +1252,242 @@ static char *BF_crypt(const char *key, size_t length, const char *setting,
 	} while (ptr < &data.ctx.S[3][0xFF]);
 
 	do {
-		int done;
+		if (cancel && cancel->epoch->load(std::memory_order_relaxed) !=
+		    cancel->started)
+			return -1;
 
 		for (i = 0; i < BF_N + 2; i += 2) {
 			data.ctx.P[i] ^= data.expanded_key[i];
 			data.ctx.P[i + 1] ^= data.expanded_key[i + 1];
 		}
 
-		done = 0;
-		do {
-			BF_body();
-			if (done)
-				break;
-			done = 1;
-
-			tmp1 = data.binary.salt[0];
-			tmp2 = data.binary.salt[1];
-			tmp3 = data.binary.salt[2];
-			tmp4 = data.binary.salt[3];
-			for (i = 0; i < BF_N; i += 4) {
-				data.ctx.P[i] ^= tmp1;
-				data.ctx.P[i + 1] ^= tmp2;
-				data.ctx.P[i + 2] ^= tmp3;
-				data.ctx.P[i + 3] ^= tmp4;
-			}
-			data.ctx.P[16] ^= tmp1;
-			data.ctx.P[17] ^= tmp2;
-		} while (1);
+		BF_body();
+
+		tmp1 = data.binary.salt[0];
+		tmp2 = data.binary.salt[1];
+		tmp3 = data.binary.salt[2];
+		tmp4 = data.binary.salt[3];
+		for (i = 0; i < BF_N; i += 4) {
+			data.ctx.P[i] ^= tmp1;
+			data.ctx.P[i + 1] ^= tmp2;
+			data.ctx.P[i + 2] ^= tmp3;
+			data.ctx.P[i + 3] ^= tmp4;
+		}
+		data.ctx.P[16] ^= tmp1;
+		data.ctx.P[17] ^= tmp2;
+
+		BF_body();
 	} while (--count);
 
 	for (i = 0; i < 6; i += 2) {
 		L = BF_magic_w[i];
 		R = BF_magic_w[i + 1];
 
-		count = 64;
+		n = 64;
 		do {
 			BF_ENCRYPT;
-		} while (--count);
+		} while (--n);
 
 		data.binary.output[i] = L;
 		data.binary.output[i + 1] = R;
 	}
 
+	return 0;
+}
+
+typedef int (*BF_crypt_engine_fn)(BF_crypt_data &data, const char *key,
+	size_t length, BF_word count, unsigned char flags,
+	bcrypt_cancel const *cancel);
+
+/*
+ * Settings with a dedicated instantiation: the "$2a$04$" used by
+ * bcrypt_iterated() for proof of work, and the usual password hashing costs.
+ */
+static const struct {
+	unsigned char flags;
+	int cost;
+	BF_crypt_engine_fn engine;
+} BF_crypt_engines[] = {
+	{2, 4, BF_crypt_engine<4, 2>},
+	{2, 10, BF_crypt_engine<10, 2>},
+	{2, 12, BF_crypt_engine<12, 2>},
+	{4, 10, BF_crypt_engine<10, 4>},
+	{4, 12, BF_crypt_engine<12, 4>}
+};
+
+static std::atomic<int> BF_engine_variant(BCRYPT_ENGINE_SPECIALIZED);
+
+void bcrypt_set_engine(int variant)
+{
+	BF_engine_variant.store(variant, std::memory_order_relaxed);
+}
+
+int bcrypt_engine(void)
+{
+	return BF_engine_variant.load(std::memory_order_relaxed);
+}
+
+static BF_crypt_engine_fn BF_crypt_select(unsigned char flags, int cost)
+{
+	unsigned int i;
+
+	if (bcrypt_engine() == BCRYPT_ENGINE_GENERIC)
+		return BF_crypt_engine<-1, 0>;
+	for (i = 0; i < sizeof(BF_crypt_engines) / sizeof(BF_crypt_engines[0]); i++)
+		if (BF_crypt_engines[i].flags == flags &&
+		    BF_crypt_engines[i].cost == cost)
+			return BF_crypt_engines[i].engine;
+
+	return BF_crypt_engine<-1, 0>;
+}
+
+/*
+ * Two Eksblowfish computations with the same salt and cost, "$2a$" only,
+ * advanced in lockstep.  Every Blowfish round depends on the one before, so
+ * a single hash leaves the CPU waiting on S-box loads; interleaving two
+ * independent hashes gives it a second chain to work on in the meantime.
+ */
+#define BF_F(c, x) \
+	((((c).S[0][(x) >> 24] + (c).S[1][((x) >> 16) & 0xFF]) ^ \
+	(c).S[2][((x) >> 8) & 0xFF]) + (c).S[3][(x) & 0xFF])
+
+static inline void BF_encrypt_x2(BF_ctx &a, BF_ctx &b, BF_word lr[4])
+{
+	BF_word La = lr[0] ^ a.P[0], Ra = lr[1];
+	BF_word Lb = lr[2] ^ b.P[0], Rb = lr[3];
+	int i;
+
+	for (i = 0; i < BF_N; i += 2) {
+		Ra ^= a.P[i + 1] ^ BF_F(a, La);
+		Rb ^= b.P[i + 1] ^ BF_F(b, Lb);
+		La ^= a.P[i + 2] ^ BF_F(a, Ra);
+		Lb ^= b.P[i + 2] ^ BF_F(b, Rb);
+	}
+	lr[0] = Ra ^ a.P[BF_N + 1];
+	lr[1] = La;
+	lr[2] = Rb ^ b.P[BF_N + 1];
+	lr[3] = Lb;
+}
+
+/*
+ * Rewrites P and then all four S-boxes with the running encryption; with a
+ * salt, pair k is XORed with salt words (k & 1) * 2 and (k & 1) * 2 + 1
+ * first, which is the order BF_crypt_engine() uses.
+ */
+static void BF_body_x2(BF_ctx &a, BF_ctx &b, const BF_word *salt)
+{
+	BF_word lr[4] = {0, 0, 0, 0};
+	BF_word *pa = a.P, *pb = b.P;
+	int k;
+
+	for (k = 0; k < (BF_N + 2) / 2 + 4 * 0x100 / 2; k++) {
+		if (k == (BF_N + 2) / 2) {
+			pa = a.S[0];
+			pb = b.S[0];
+		}
+		if (salt) {
+			lr[0] ^= salt[(k & 1) * 2];
+			lr[1] ^= salt[(k & 1) * 2 + 1];
+			lr[2] ^= salt[(k & 1) * 2];
+			lr[3] ^= salt[(k & 1) * 2 + 1];
+		}
+		BF_encrypt_x2(a, b, lr);
+		*pa++ = lr[0];
+		*pa++ = lr[1];
+		*pb++ = lr[2];
+		*pb++ = lr[3];
+	}
+}
+
+static void BF_crypt_engine_x2(BF_crypt_data &a, BF_crypt_data &b,
+	const char *key_a, size_t length_a, const char *key_b, size_t length_b,
+	BF_word count)
+{
+	const BF_word *salt = a.binary.salt;
+	BF_word lr[4];
+	int i, n;
+
+	BF_set_key_t<2>(key_a, length_a, a.expanded_key, a.ctx.P, 2);
+	BF_set_key_t<2>(key_b, length_b, b.expanded_key, b.ctx.P, 2);
+	memcpy(a.ctx.S, BF_init_state.S, sizeof(a.ctx.S));
+	memcpy(b.ctx.S, BF_init_state.S, sizeof(b.ctx.S));
+
+	BF_body_x2(a.ctx, b.ctx, salt);
+
+	do {
+		for (i = 0; i < BF_N + 2; i++) {
+			a.ctx.P[i] ^= a.expanded_key[i];
+			b.ctx.P[i] ^= b.expanded_key[i];
+		}
+		BF_body_x2(a.ctx, b.ctx, NULL);
+
+		for (i = 0; i < BF_N + 2; i++) {
+			a.ctx.P[i] ^= salt[i & 3];
+			b.ctx.P[i] ^= salt[i & 3];
+		}
+		BF_body_x2(a.ctx, b.ctx, NULL);
+	} while (--count);
+
+	for (i = 0; i < 6; i += 2) {
+		lr[0] = lr[2] = BF_magic_w[i];
+		lr[1] = lr[3] = BF_magic_w[i + 1];
+
+		n = 64;
+		do {
+			BF_encrypt_x2(a.ctx, b.ctx, lr);
+		} while (--n);
+
+		a.binary.output[i] = lr[0];
+		a.binary.output[i + 1] = lr[1];
+		b.binary.output[i] = lr[2];
+		b.binary.output[i + 1] = lr[3];
+	}
+}
+
+static const unsigned char flags_by_subtype[26] =
+	{2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 4, 0};
+
+static char *BF_crypt(const char *key, size_t length, const char *setting,
+	char *output, int size,
+	BF_word min, bcrypt_cancel const *cancel)
+{
+	BF_crypt_data data;
+	BF_word count;
+	unsigned char flags;
+	int cost;
+
+	if (size < 7 + 22 + 31 + 1) {
+		return NULL;
+	}
+
+	if (setting[0] != '$' ||
+	    setting[1] != '2' ||
+	    setting[2] < 'a' || setting[2] > 'z' ||
+	    !flags_by_subtype[(unsigned int)(unsigned char)setting[2] - 'a'] ||
+	    setting[3] != '$' ||
+	    setting[4] < '0' || setting[4] > '3' ||
+	    setting[5] < '0' || setting[5] > '9' ||
+	    (setting[4] == '3' && setting[5] > '1') ||
+	    setting[6] != '$') {
+		return NULL;
+	}
+
+	cost = (setting[4] - '0') * 10 + (setting[5] - '0');
+	count = (BF_word)1 << cost;
+	if (count < min || BF_decode(data.binary.salt, &setting[7], 16)) {
+		return NULL;
+	}
+	BF_swap(data.binary.salt, 4);
+
+	flags = flags_by_subtype[(unsigned int)(unsigned char)setting[2] - 'a'];
+	NUDD_PROBE2(bf__entry, cost, length);
+	if (BF_crypt_select(flags, cost)(data, key, length, count, flags, cancel)) {
+		NUDD_PROBE2(bf__return, cost, 1);
+		return NULL;
+	}
+	NUDD_PROBE2(bf__return, cost, 0);
+
 	memcpy(output, setting, 7 + 22 - 1);
 	output[7 + 22 - 1] = BF_itoa64[(int)
 		BF_atoi64[(int)setting[7 + 22 - 1] - 0x20] & 0x30];
@@ -1287,8 +1536,8 @@ int _crypt_output_magic(const char *setting, char *output, int size)
  * The performance cost of this quick self-test is around 0.6% at the "$2a$08"
  * setting.
  */
-char *_crypt_blowfish_rn(const char *key, size_t length, const char *setting,
-	char *output, int size)
+char *_crypt_blowfish_rn_cancel(const char *key, size_t length,
+	const char *setting, char *output, int size, bcrypt_cancel const *cancel)
 {
 	const char *test_key = "8b \xd0\xc1\xd2\xcf\xcc\xd8";
 	const char *test_setting = "$2a$00$abcdefghijklmnopqrstuu";
@@ -1305,7 +1554,7 @@ char *_crypt_blowfish_rn(const char *key, size_t length, const char *setting,
 
 /* Hash the supplied password */
 	_crypt_output_magic(setting, output, size);
-	retval = BF_crypt(key, length, setting, output, size, 16);
+	retval = BF_crypt(key, length, setting, output, size, 16, cancel);
 
 /*
  * Do a quick self-test.  It is important that we make both calls to BF_crypt()
@@ -1319,7 +1568,7 @@ char *_crypt_blowfish_rn(const char *key, size_t length, const char *setting,
 		buf.s[2] = setting[2];
 	memset(buf.o, 0x55, sizeof(buf.o));
 	buf.o[sizeof(buf.o) - 1] = 0;
-	p = BF_crypt(test_key, strlen(test_key), buf.s, buf.o, sizeof(buf.o) - (1 + 1), 1);
+	p = BF_crypt(test_key, strlen(test_key), buf.s, buf.o, sizeof(buf.o) - (1 + 1), 1, NULL);
 
 	ok = (p == buf.o &&
 	    !memcmp(p, buf.s, 7 + 22) &&
@@ -1346,6 +1595,67 @@ char *_crypt_blowfish_rn(const char *key, size_t length, const char *setting,
 	return NULL;
 }
 
+char *_crypt_blowfish_rn(const char *key, size_t length, const char *setting,
+	char *output, int size)
+{
+	return _crypt_blowfish_rn_cancel(key, length, setting, output, size, NULL);
+}
+
+/*
+ * The self-test of _crypt_blowfish_rn_cancel() for callers that run the
+ * engine themselves.  Called from the same scope as the engine, its
+ * BF_crypt() overwrites the sensitive data the engine left on the stack.
+ */
+static int BF_self_test(char subtype)
+{
+	const char *test_key = "8b \xd0\xc1\xd2\xcf\xcc\xd8";
+	static const char * const test_hash[2] =
+		{"VUrPmXD6q/nVSSp7pNDhCR9071IfIRe\0\x55", /* $2x$ */
+		"i1D709vfamulimlGcq0qq3UvuUasvEa\0\x55"}; /* $2a$, $2y$ */
+	char setting[7 + 22 + 1] = "$2a$00$abcdefghijklmnopqrstuu";
+	char output[7 + 22 + 31 + 1 + 1 + 1];
+	const char *p;
+
+	setting[2] = subtype;
+	memset(output, 0x55, sizeof(output));
+	output[sizeof(output) - 1] = 0;
+	p = BF_crypt(test_key, strlen(test_key), setting, output,
+		sizeof(output) - (1 + 1), 1, NULL);
+	return p == output &&
+	    !memcmp(p, setting, 7 + 22) &&
+	    !memcmp(p + (7 + 22),
+	    test_hash[(unsigned int)(unsigned char)subtype & 1],
+	    31 + 1 + 1 + 1);
+}
+
+int bcrypt_verify_binary(const char *key, size_t length, char subtype,
+	int cost, const unsigned char salt[16], const unsigned char hash[23])
+{
+	BF_crypt_data data;
+	unsigned char flags, diff = 0;
+	int failed, i;
+
+	if (subtype < 'a' || subtype > 'z' || cost < 4 || cost > 31 ||
+	    !(flags = flags_by_subtype[(unsigned int)(unsigned char)subtype - 'a']))
+		return -1;
+
+	memcpy(data.binary.salt, salt, sizeof(data.binary.salt));
+	BF_swap(data.binary.salt, 4);
+	NUDD_PROBE2(bf__entry, cost, length);
+	failed = BF_crypt_select(flags, cost)(data, key, length,
+		(BF_word)1 << cost, flags, NULL);
+	NUDD_PROBE2(bf__return, cost, failed);
+
+/* Compare all 23 bytes, in constant time, as BF_crypt() would encode them */
+	BF_swap(data.binary.output, 6);
+	for (i = 0; i < 23; i++)
+		diff |= ((unsigned char *)data.binary.output)[i] ^ hash[i];
+
+	if (!BF_self_test(subtype) || failed)
+		return -1;
+	return !diff;
+}
+
 char *_crypt_gensalt_blowfish_rn(const char *prefix, unsigned long count,
 	const char *input, int size, char *output, int output_size)
 {
@@ -1373,80 +1683,238 @@ char *_crypt_gensalt_blowfish_rn(const char *prefix, unsigned long count,
 	return output;
 }
 
+static unsigned char const bcrypt_iterated_initializer[
+	BCRYPT_ITERATED_BLOCK] = {
+	0x03, 0xd5, 0xef, 0xf1, 0x34, 0xac, 0x9c, 0xda, 0x1f, 0xa3, 0x93, 0x38,
+	0x2e, 0x44, 0x93, 0x23, 0x81, 0xb9, 0x2a, 0xf1, 0xc1, 0x38, 0x4f, 0xd1,
+	0x75, 0xae, 0x58, 0x52, 0xfa, 0xd2, 0x90, 0xf1, 0xb6, 0x77, 0x24, 0xc2,
+	0x78, 0xbf, 0xa1, 0xe6, 0x3f, 0x14, 0x1b, 0xa3, 0x90, 0x55, 0xad, 0xa9,
+	0x71, 0x10, 0xa6, 0x1a, 0x9d, 0x15, 0x38, 0xe0, 0x00, 0xc1, 0x6d, 0x9c,
+	0x1f, 0x3c, 0x89, 0xac, 0x13, 0x5a, 0x56, 0x7d, 0x8d, 0x11, 0x85, 0x0b
+};
+
+/*
+ * Hash one block of at most 72 bytes, padded with the tail of the
+ * initializer, down to the 23 bytes bcrypt actually encodes.
+ */
+static int bcrypt_iterated_block(const unsigned char *data, size_t length,
+	unsigned char output[BCRYPT_ITERATED_OUTPUT], bcrypt_cancel const *cancel)
+{
+	static char const *setting = "$2a$04$abcdefghijklmnopqrstuu";
+	char block[BCRYPT_ITERATED_BLOCK + 1];
+	char hash[CRYPT_OUTPUT_SIZE];
+
+	memcpy(block, data, length);
+	memcpy(block + length, bcrypt_iterated_initializer + length,
+		BCRYPT_ITERATED_BLOCK - length);
+	block[BCRYPT_ITERATED_BLOCK] = '\0';
+
+	if (!_crypt_blowfish_rn_cancel(block, BCRYPT_ITERATED_BLOCK, setting,
+	    hash, sizeof(hash), cancel))
+		return -1;
+	return radix64_decode(output, hash + 7 + 22, BCRYPT_ITERATED_OUTPUT);
+}
+
+int bcrypt_iterated_single(const void *data, size_t length,
+	unsigned char output[BCRYPT_ITERATED_OUTPUT], bcrypt_cancel const *cancel)
+{
+	return bcrypt_iterated_block((const unsigned char *)data, length,
+		output, cancel);
+}
+
+/*
+ * The pair engine skips BF_crypt() and its self-test, so it is checked once
+ * against the scalar path instead and never used if the two disagree.
+ */
+static int bcrypt_iterated_pair_engine(const char *block_a,
+	const char *block_b, unsigned char *out_a, unsigned char *out_b)
+{
+	static char const *salt = "abcdefghijklmnopqrstuu";
+	BF_crypt_data a, b;
+
+	if (BF_decode(a.binary.salt, salt, 16))
+		return -1;
+	BF_swap(a.binary.salt, 4);
+	memcpy(b.binary.salt, a.binary.salt, sizeof(b.binary.salt));
+
+	BF_crypt_engine_x2(a, b, block_a, BCRYPT_ITERATED_BLOCK,
+		block_b, BCRYPT_ITERATED_BLOCK, (BF_word)1 << 4);
+
+	BF_swap(a.binary.output, 6);
+	BF_swap(b.binary.output, 6);
+	memcpy(out_a, a.binary.output, BCRYPT_ITERATED_OUTPUT);
+	memcpy(out_b, b.binary.output, BCRYPT_ITERATED_OUTPUT);
+	return 0;
+}
+
+static void bcrypt_iterated_pad(const void *data, size_t length,
+	char block[BCRYPT_ITERATED_BLOCK + 1])
+{
+	memcpy(block, data, length);
+	memcpy(block + length, bcrypt_iterated_initializer + length,
+		BCRYPT_ITERATED_BLOCK - length);
+	block[BCRYPT_ITERATED_BLOCK] = '\0';
+}
+
+static bool bcrypt_iterated_pair_works()
+{
+	char block_a[BCRYPT_ITERATED_BLOCK + 1], block_b[BCRYPT_ITERATED_BLOCK + 1];
+	unsigned char pair_a[BCRYPT_ITERATED_OUTPUT], pair_b[BCRYPT_ITERATED_OUTPUT];
+	unsigned char single_a[BCRYPT_ITERATED_OUTPUT], single_b[BCRYPT_ITERATED_OUTPUT];
+
+	bcrypt_iterated_pad("\xff\xa3" "34", 4, block_a);
+	bcrypt_iterated_pad("nudd", 4, block_b);
+	return !bcrypt_iterated_pair_engine(block_a, block_b, pair_a, pair_b) &&
+	    !bcrypt_iterated_block((const unsigned char *)"\xff\xa3" "34", 4,
+		single_a, NULL) &&
+	    !bcrypt_iterated_block((const unsigned char *)"nudd", 4,
+		single_b, NULL) &&
+	    !memcmp(pair_a, single_a, sizeof(pair_a)) &&
+	    !memcmp(pair_b, single_b, sizeof(pair_b));
+}
+
+void bcrypt_iterated_pair(const void *data_a, size_t length_a,
+	const void *data_b, size_t length_b,
+	unsigned char output_a[BCRYPT_ITERATED_OUTPUT],
+	unsigned char output_b[BCRYPT_ITERATED_OUTPUT])
+{
+	static bool const works = bcrypt_iterated_pair_works();
+	char block_a[BCRYPT_ITERATED_BLOCK + 1], block_b[BCRYPT_ITERATED_BLOCK + 1];
+
+	if (works) {
+		bcrypt_iterated_pad(data_a, length_a, block_a);
+		bcrypt_iterated_pad(data_b, length_b, block_b);
+		if (!bcrypt_iterated_pair_engine(block_a, block_b, output_a, output_b))
+			return;
+	}
+	bcrypt_iterated_block((const unsigned char *)data_a, length_a,
+		output_a, NULL);
+	bcrypt_iterated_block((const unsigned char *)data_b, length_b,
+		output_b, NULL);
+}
+
+/*
+ * Each reduction round of bcrypt_iterated_128() turns its input into 23 bytes
+ * per started 72-byte block, so round N + 1 can consume round N's output as
+ * soon as it is produced.  A level only ever holds its current, partial
+ * block; a full block is hashed immediately and handed to the next level.
+ */
+static void bcrypt_iterated_feed(bcrypt_iterated_ctx *ctx, int level,
+	const unsigned char *data, size_t length)
+{
+	unsigned char hash[BCRYPT_ITERATED_OUTPUT];
+	size_t take;
+
+	while (length) {
+		take = BCRYPT_ITERATED_BLOCK - ctx->fill[level];
+		if (take > length)
+			take = length;
+		memcpy(ctx->block[level] + ctx->fill[level], data, take);
+		ctx->fill[level] += take;
+		data += take;
+		length -= take;
+
+		if (ctx->fill[level] == BCRYPT_ITERATED_BLOCK) {
+			bcrypt_iterated_block(ctx->block[level],
+				BCRYPT_ITERATED_BLOCK, hash, NULL);
+			ctx->fill[level] = 0;
+			ctx->reduced[level] = 1;
+			bcrypt_iterated_feed(ctx, level + 1, hash, sizeof(hash));
+		}
+	}
+}
+
+void bcrypt_iterated_init(bcrypt_iterated_ctx *ctx)
+{
+	memset(ctx->fill, 0, sizeof(ctx->fill));
+	memset(ctx->reduced, 0, sizeof(ctx->reduced));
+}
+
+void bcrypt_iterated_update(bcrypt_iterated_ctx *ctx, const void *data,
+	size_t length)
+{
+	bcrypt_iterated_feed(ctx, 0, (const unsigned char *)data, length);
+}
+
+void bcrypt_iterated_final(bcrypt_iterated_ctx *ctx,
+	unsigned char output[BCRYPT_ITERATED_OUTPUT])
+{
+	unsigned char hash[BCRYPT_ITERATED_OUTPUT];
+	int level;
+
+/*
+ * Every round hashes a final, possibly empty, partial block.  The round whose
+ * input never filled a whole block produced exactly 23 bytes: that is the
+ * result.
+ */
+	for (level = 0; ; level++) {
+		bcrypt_iterated_block(ctx->block[level], ctx->fill[level], hash,
+			NULL);
+		if (!ctx->reduced[level])
+			break;
+		bcrypt_iterated_feed(ctx, level + 1, hash, sizeof(hash));
+	}
+	memcpy(output, hash, sizeof(hash));
+	bcrypt_iterated_init(ctx);
+}
+
 std::string bcrypt_iterated_128(std::string const& input) {
-	static std::string const initializer(
-		"\x03\xd5\xef\xf1\x34\xac\x9c\xda\x1f\xa3\x93\x38\x2e\x44\x93"
-		"\x23\x81\xb9\x2a\xf1\xc1\x38\x4f\xd1\x75\xae\x58\x52\xfa\xd2"
-		"\x90\xf1\xb6\x77\x24\xc2\x78\xbf\xa1\xe6\x3f\x14\x1b\xa3\x90"
-		"\x55\xad\xa9\x71\x10\xa6\x1a\x9d\x15\x38\xe0\x00\xc1\x6d\x9c"
-		"\x1f\x3c\x89\xac\x13\x5a\x56\x7d\x8d\x11\x85\x0b",
-		72
-	);
-	static char const* setting = "$2a$04$abcdefghijklmnopqrstuu";
-	std::string current_input = input;
+	bcrypt_iterated_ctx ctx;
+	unsigned char output[BCRYPT_ITERATED_OUTPUT];
+
+	NUDD_PROBE1(iterated__entry, input.size());
+	bcrypt_iterated_init(&ctx);
+	bcrypt_iterated_update(&ctx, input.data(), input.size());
+	bcrypt_iterated_final(&ctx, output);
+	NUDD_PROBE1(iterated__return, input.size());
+	return std::string(reinterpret_cast<char const*>(output), sizeof(output));
+}
+
+/*
+ * Same reduction, but each round's blocks are hashed concurrently.  Blocks
+ * within a round are independent, and every one of them writes its 23 bytes
+ * to a fixed offset, so the result is identical to the serial version.
+ */
+std::string bcrypt_iterated_128_parallel(std::string const& input,
+	thread_pool& pool) {
+	std::string current = input;
+	std::string output;
+
+	NUDD_PROBE1(iterated__entry, input.size());
 	do {
-		std::string output;
-		std::string::size_type begin = 0;
-		std::string::size_type end = 72;
-		do {
-			std::string::size_type initialized = (
-				current_input.size() < end
-			) ? current_input.size() : end;
-			std::string const block = std::string(
-				current_input.begin() + begin,
-				current_input.begin() + initialized
-			) + std::string(
-				initializer.begin() + initialized - begin,
-				initializer.end()
-			);
-			void* data = NULL;
-			int size;
-			char* hash = crypt_ra(
-				block.data(),
-				block.size(),
-				setting,
-				&data,
-				&size
-			);
-			BF_word raw_data[6];
-			BF_decode(raw_data, hash + 7 + 22, 31);
-			free(data);
-			output += std::string(
-				reinterpret_cast<char const*>(raw_data),
-				reinterpret_cast<
-					char const*
-				>(
-					raw_data + 6
-				) - reinterpret_cast<
-					char const*
-				>(
-					raw_data
-				) - 1
-			);
-			begin += 72;
-			end += 72;
-		} while (
-			current_input.size() >= begin
-		);
-		current_input = output;
-	} while (
-		current_input.size() > 23
-	);
-	return current_input;
+		size_t const blocks = current.size() / BCRYPT_ITERATED_BLOCK + 1;
+		output.resize(blocks * BCRYPT_ITERATED_OUTPUT);
+		unsigned char const *in =
+			reinterpret_cast<unsigned char const*>(current.data());
+		unsigned char *out = reinterpret_cast<unsigned char*>(&output[0]);
+		size_t const length = current.size();
+
+		pool.parallel_for(blocks, [in, out, length](size_t i) {
+			size_t begin = i * BCRYPT_ITERATED_BLOCK;
+			size_t size = length - begin < BCRYPT_ITERATED_BLOCK ?
+				length - begin : BCRYPT_ITERATED_BLOCK;
+			bcrypt_iterated_block(in + begin, size,
+				out + i * BCRYPT_ITERATED_OUTPUT, NULL);
+		});
+		current.swap(output);
+	} while (current.size() > BCRYPT_ITERATED_OUTPUT);
+	NUDD_PROBE1(iterated__return, input.size());
+	return current;
 }
 
 std::string bcrypt_iterated(std::string const& input) {
 	std::string::size_type const split = input.size() * 3 / 4;
-	std::string const concatenated = bcrypt_iterated_128(
-		std::string(input.begin(), input.begin() + split)
-	) + bcrypt_iterated_128(
-		std::string(input.begin() + split, input.end())
-	);
-	return std::string(
-		concatenated.begin(
-		),
-		concatenated.begin(
-		) + 32
-	);
+	bcrypt_iterated_ctx ctx;
+	unsigned char concatenated[2 * BCRYPT_ITERATED_OUTPUT];
+
+	bcrypt_iterated_init(&ctx);
+	NUDD_PROBE1(iterated__entry, split);
+	bcrypt_iterated_update(&ctx, input.data(), split);
+	bcrypt_iterated_final(&ctx, concatenated);
+	NUDD_PROBE1(iterated__return, split);
+	NUDD_PROBE1(iterated__entry, input.size() - split);
+	bcrypt_iterated_update(&ctx, input.data() + split, input.size() - split);
+	bcrypt_iterated_final(&ctx, concatenated + BCRYPT_ITERATED_OUTPUT);
+	NUDD_PROBE1(iterated__return, input.size() - split);
+	return std::string(reinterpret_cast<char const*>(concatenated), 32);
 }
-
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <string>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
@@ -84,12 +85,97 @@ extern char *_crypt_gensalt_md5_rn(const char *prefix, unsigned long count,
 extern int _crypt_output_magic(const char *setting, char *output, int size);
 extern char *_crypt_blowfish_rn(const char *key, size_t length,
 	const char *setting, char *output, int size);
+
+/*
+ * Lets a long-running caller abandon a hash: the Eksblowfish loop checks once
+ * per iteration and gives up as soon as *epoch no longer equals started.
+ */
+typedef struct {
+	std::atomic<unsigned int> const *epoch;
+	unsigned int started;
+} bcrypt_cancel;
+
+/* As _crypt_blowfish_rn(), but fails early once cancel (if any) fires */
+extern char *_crypt_blowfish_rn_cancel(const char *key, size_t length,
+	const char *setting, char *output, int size, bcrypt_cancel const *cancel);
 extern char *_crypt_gensalt_blowfish_rn(const char *prefix,
         unsigned long count,
         const char *input, int size, char *output, int output_size);
 
 extern int BF_decode(BF_word *dst, const char *src, int size);
 
+/*
+ * Checks key against a hash already split into its subtype, cost, 16-byte
+ * salt and 23-byte hash, without the setting parse and radix-64 round trip
+ * of _crypt_blowfish_rn().  Returns 1 on a match, 0 on a mismatch and -1 if
+ * the subtype or cost is invalid or the self-test fails.
+ */
+extern int bcrypt_verify_binary(const char *key, size_t length, char subtype,
+	int cost, const unsigned char salt[16], const unsigned char hash[23]);
+
+/*
+ * Which BF_crypt_engine instantiations BF_crypt() may use: the ones with the
+ * cost and subtype fixed at compile time, or only the generic loop.  Which
+ * is faster depends on the host's branch predictor and icache; the tuner
+ * picks one per host.
+ */
+#define BCRYPT_ENGINE_SPECIALIZED	0
+#define BCRYPT_ENGINE_GENERIC		1
+
+extern void bcrypt_set_engine(int variant);
+extern int bcrypt_engine(void);
+
+/*
+ * bcrypt_iterated_128() reduces its input in rounds: every started 72-byte
+ * block is padded with a fixed initializer and hashed with "$2a$04$" down to
+ * 23 bytes, until a single block's worth is left.  The context below computes
+ * the same result incrementally, holding one partial block per round instead
+ * of the whole message.  BCRYPT_ITERATED_LEVELS rounds cover any input whose
+ * length fits in a size_t.
+ */
+#define BCRYPT_ITERATED_BLOCK		72
+#define BCRYPT_ITERATED_OUTPUT		23
+#define BCRYPT_ITERATED_LEVELS		40
+
+typedef struct {
+	unsigned char block[BCRYPT_ITERATED_LEVELS][BCRYPT_ITERATED_BLOCK];
+	size_t fill[BCRYPT_ITERATED_LEVELS];
+	unsigned char reduced[BCRYPT_ITERATED_LEVELS];
+} bcrypt_iterated_ctx;
+
+extern void bcrypt_iterated_init(bcrypt_iterated_ctx *ctx);
+extern void bcrypt_iterated_update(bcrypt_iterated_ctx *ctx,
+	const void *data, size_t length);
+/* Writes BCRYPT_ITERATED_OUTPUT bytes and resets ctx for reuse */
+extern void bcrypt_iterated_final(bcrypt_iterated_ctx *ctx,
+	unsigned char output[BCRYPT_ITERATED_OUTPUT]);
+
+extern std::string bcrypt_iterated_128(std::string const& input);
+
+/*
+ * bcrypt_iterated_128() of an input shorter than BCRYPT_ITERATED_BLOCK, which
+ * is a single bcrypt call.  Returns -1 if cancel fired.
+ */
+extern int bcrypt_iterated_single(const void *data, size_t length,
+	unsigned char output[BCRYPT_ITERATED_OUTPUT], bcrypt_cancel const *cancel);
+
+/*
+ * bcrypt_iterated_single() of two inputs, both shorter than
+ * BCRYPT_ITERATED_BLOCK, with the two bcrypt calls interleaved round by
+ * round in the calling thread.  Not cancellable.
+ */
+extern void bcrypt_iterated_pair(const void *data_a, size_t length_a,
+	const void *data_b, size_t length_b,
+	unsigned char output_a[BCRYPT_ITERATED_OUTPUT],
+	unsigned char output_b[BCRYPT_ITERATED_OUTPUT]);
+
+/*
+ * Bit-identical to bcrypt_iterated_128(), with the blocks of every round
+ * spread over the given pool.  Worth it once the input spans a few blocks.
+ */
+class thread_pool;
+extern std::string bcrypt_iterated_128_parallel(std::string const& input,
+	thread_pool& pool);
 extern std::string bcrypt_iterated(std::string const& input);
 
 #endif
@@ -0,0 +1,87 @@
+#include "bench.h"
+
+#include <string.h>
+
+#include <chrono>
+
+#include "bcrypt.h"
+#include "pow.h"
+
+enum bench_kernel {
+    bench_nudd,
+    bench_nudd_interleaved,
+    bench_bcrypt,
+    bench_scrypt
+};
+
+bool nudd_bench(std::string const& kernel, bench_params const& params,
+    bench_result& result)
+{
+    char header[NUDD_HEADER_SIZE], hash[NUDD_HASH_SIZE];
+    unsigned char half[BCRYPT_ITERATED_OUTPUT];
+    uint32_t per_call = 1;
+    perf_counters counters;
+    bench_kernel which;
+
+    if (kernel == "nudd")
+        which = bench_nudd;
+    else if (kernel == "nudd_interleaved")
+        which = bench_nudd_interleaved;
+    else if (kernel == "bcrypt")
+        which = bench_bcrypt;
+    else if (kernel == "scrypt")
+        which = bench_scrypt;
+    else
+        return false;
+
+    for (int i = 0; i < NUDD_HEADER_SIZE; i++)
+        header[i] = (char)i;
+    /* One untimed call, which also rejects bad scrypt parameters */
+    if (which == bench_scrypt) {
+        per_call = params.tuning.interleave;
+        if (scrypt((const uint8_t *)header, NUDD_HEADER_SIZE,
+                (const uint8_t *)header, NUDD_HEADER_SIZE, params.n,
+                params.r, per_call, (uint8_t *)hash, NUDD_HASH_SIZE, NULL,
+                NULL, &params.tuning))
+            return false;
+    }
+
+    result.counted = params.counters && counters.open();
+    result.counter_error = params.counters ? counters.error() : "";
+    for (int i = 0; i < perf_event_count; i++)
+        result.available[i] = result.counted && counters.available((perf_event_id)i);
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    if (result.counted)
+        counters.start();
+    for (unsigned int n = 0; n < params.count; n++) {
+        le32enc(header + 76, n);
+        switch (which) {
+        case bench_nudd:
+            nudd_hash(header, hash);
+            break;
+        case bench_nudd_interleaved:
+            nudd_hash_interleaved(header, hash);
+            break;
+        case bench_bcrypt:
+            bcrypt_iterated_single(header + NUDD_SPLIT,
+                NUDD_HEADER_SIZE - NUDD_SPLIT, half, NULL);
+            break;
+        case bench_scrypt:
+            scrypt((const uint8_t *)header, NUDD_HEADER_SIZE,
+                (const uint8_t *)header, NUDD_HEADER_SIZE, params.n,
+                params.r, per_call, (uint8_t *)hash, NUDD_HASH_SIZE, NULL,
+                NULL, &params.tuning);
+            break;
+        }
+    }
+    if (result.counted)
+        counters.stop();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    result.hashes = (uint64_t)params.count * per_call;
+    result.seconds = elapsed.count();
+    for (int i = 0; i < perf_event_count; i++)
+        result.counts[i] = result.available[i] ? counters.value((perf_event_id)i) : 0;
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include "perf.h"
+#include "scrypt.h"
+
+/*
+ * Runs one hashing kernel back to back on the calling thread, optionally
+ * inside perf_counters, so layouts and lane counts can be compared by
+ * IPC and misses per hash as well as by throughput.  The kernels:
+ *
+ *   nudd              nudd_hash()
+ *   nudd_interleaved  nudd_hash_interleaved()
+ *   bcrypt            one bcrypt call on a 20-byte header suffix, the
+ *                     per-nonce cost of a scan
+ *   scrypt            scrypt(header, header, n, r, interleave) with
+ *                     tuning, counted as interleave hashes per call
+ */
+struct bench_params {
+    unsigned int count;
+    uint64_t n;
+    uint32_t r;
+    scrypt_tuning tuning;
+    bool counters;
+
+    bench_params() : count(100), n(1024), r(1), counters(true)
+    {
+        tuning.tmto = 1;
+        tuning.interleave = 1;
+    }
+};
+
+struct bench_result {
+    uint64_t hashes;
+    double seconds;
+
+    /* Whether counts[] is meaningful, and why not if it is not */
+    bool counted;
+    std::string counter_error;
+    bool available[perf_event_count];
+    uint64_t counts[perf_event_count];
+};
+
+/* false for an unknown kernel or scrypt parameters scrypt() rejects */
+bool nudd_bench(std::string const& kernel, bench_params const& params,
+    bench_result& result);
+
+#endif
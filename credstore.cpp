@@ -0,0 +1,201 @@
+#include "credstore.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "bcrypt.h"
+
+#define CREDSTORE_MAGIC		"NUDDCRED"
+#define CREDSTORE_VERSION	1
+/* The file grows a megabyte of records at a time */
+#define CREDSTORE_GROWTH	(1 << 20)
+
+struct credstore_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    unsigned char reserved[48];
+};
+
+static_assert(sizeof(credstore_header) == 64, "records start on a cache line");
+
+static size_t record_offset(uint64_t user)
+{
+    return sizeof(credstore_header) + user * sizeof(credential_record);
+}
+
+static uint64_t record_count(size_t mapped)
+{
+    return (mapped - sizeof(credstore_header)) / sizeof(credential_record);
+}
+
+credential_store::credential_store()
+    : fd(-1), writable(false), base(NULL), mapped(0)
+{
+}
+
+credential_store::~credential_store()
+{
+    close();
+}
+
+bool credential_store::fail(const char *what)
+{
+    last_error = std::string(what) + ": " + strerror(errno);
+    return false;
+}
+
+/* Replaces the mapping with one of size bytes; the caller holds lock */
+bool credential_store::map(size_t size)
+{
+    void *mapping = mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0),
+        MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED)
+        return fail("mmap");
+    if (base)
+        munmap(base, mapped);
+    base = (unsigned char *)mapping;
+    mapped = size;
+    return true;
+}
+
+bool credential_store::open(std::string const& path, bool writable)
+{
+    std::unique_lock<std::shared_mutex> exclusive(lock);
+    credstore_header header;
+    struct stat st;
+
+    if (fd >= 0) {
+        last_error = "already open";
+        return false;
+    }
+    fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0600);
+    if (fd < 0)
+        return fail(path.c_str());
+    this->writable = writable;
+
+    if (fstat(fd, &st)) {
+        fail("fstat");
+    } else if (st.st_size == 0 && writable) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CREDSTORE_MAGIC, sizeof(header.magic));
+        header.version = CREDSTORE_VERSION;
+        header.record_size = sizeof(credential_record);
+        if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+            fail("write");
+        else if (map(sizeof(header)))
+            return true;
+    } else if ((size_t)st.st_size < sizeof(header) ||
+        pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, CREDSTORE_MAGIC, sizeof(header.magic)) ||
+        header.version != CREDSTORE_VERSION ||
+        header.record_size != sizeof(credential_record)) {
+        last_error = path + ": not a credential store";
+    } else if (map(st.st_size)) {
+        madvise(base, mapped, MADV_RANDOM);
+        return true;
+    }
+    ::close(fd);
+    fd = -1;
+    return false;
+}
+
+void credential_store::close()
+{
+    std::unique_lock<std::shared_mutex> exclusive(lock);
+
+    if (base)
+        munmap(base, mapped);
+    if (fd >= 0)
+        ::close(fd);
+    base = NULL;
+    mapped = 0;
+    fd = -1;
+}
+
+uint64_t credential_store::capacity() const
+{
+    std::shared_lock<std::shared_mutex> shared(lock);
+
+    return base ? record_count(mapped) : 0;
+}
+
+bool credential_store::get(uint64_t user, credential_record& record) const
+{
+    std::shared_lock<std::shared_mutex> shared(lock);
+
+    if (!base || user >= record_count(mapped))
+        return false;
+    memcpy(&record, base + record_offset(user), sizeof(record));
+    return record.cost != 0;
+}
+
+bool credential_store::put(uint64_t user, credential_record const& record)
+{
+    std::unique_lock<std::shared_mutex> exclusive(lock);
+
+    if (!base || !writable) {
+        last_error = "not open for writing";
+        return false;
+    }
+    if (record.cost < 4 || record.cost > 31) {
+        last_error = "invalid record";
+        return false;
+    }
+    if (user >= ((size_t)-1 - CREDSTORE_GROWTH) / sizeof(credential_record)) {
+        last_error = "user id out of range";
+        return false;
+    }
+    if (user >= record_count(mapped)) {
+        size_t size = record_offset(user + CREDSTORE_GROWTH / sizeof(credential_record));
+        /* Zero-filled, so the new records read as empty */
+        if (ftruncate(fd, size))
+            return fail("ftruncate");
+        if (!map(size))
+            return false;
+        madvise(base, mapped, MADV_RANDOM);
+    }
+    memcpy(base + record_offset(user), &record, sizeof(record));
+    return true;
+}
+
+bool credential_store::remove(uint64_t user)
+{
+    std::unique_lock<std::shared_mutex> exclusive(lock);
+
+    if (!base || !writable) {
+        last_error = "not open for writing";
+        return false;
+    }
+    if (user < record_count(mapped))
+        memset(base + record_offset(user), 0, sizeof(credential_record));
+    return true;
+}
+
+int credential_store::verify(uint64_t user, const char *password,
+    size_t length) const
+{
+    credential_record record;
+
+    /* Copied out so a put() or a remap need not wait for the hash */
+    if (!get(user, record))
+        return -1;
+    return bcrypt_verify_binary(password, length, record.subtype, record.cost,
+        record.salt, record.hash) == 1;
+}
+
+bool credential_store::sync()
+{
+    std::unique_lock<std::shared_mutex> exclusive(lock);
+
+    if (base && writable && msync(base, mapped, MS_SYNC))
+        return fail("msync");
+    return true;
+}
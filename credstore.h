@@ -0,0 +1,69 @@
+#ifndef CREDSTORE_H
+#define CREDSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <shared_mutex>
+#include <string>
+
+#include "radix64.h"
+
+/*
+ * A credential record is a bcrypt hash with the string taken out of it: the
+ * subtype, the cost and the decoded salt and hash, 41 bytes against 60
+ * characters.  bcrypt_parse_batch() and bcrypt_format() convert to and from
+ * the "$2a$NN$..." form; any hash BF_crypt() produced survives the round trip
+ * unchanged.  A zero cost marks an empty record.
+ */
+typedef bcrypt_parsed credential_record;
+
+static_assert(sizeof(credential_record) == 41, "credential records are packed");
+
+/*
+ * A file of credential records indexed by user id, mapped into memory so a
+ * verify reads its record straight from the page cache.
+ *
+ * The file is a 64-byte header followed by one record per user id, so the
+ * record array starts on a cache line and no record spans more than two.
+ * Ids past the end read as empty; put() grows the file to cover them.  Any
+ * number of threads may read and verify while one thread writes; other
+ * processes should only open the file read-only.
+ */
+class credential_store {
+public:
+    credential_store();
+    ~credential_store();
+
+    /* Maps path, creating it when writable and it does not exist */
+    bool open(std::string const& path, bool writable);
+    void close();
+
+    /* One past the highest user id the file has room for */
+    uint64_t capacity() const;
+
+    bool get(uint64_t user, credential_record& record) const;
+    bool put(uint64_t user, credential_record const& record);
+    bool remove(uint64_t user);
+
+    /* 1 if password matches user's record, 0 if not, -1 if there is none */
+    int verify(uint64_t user, const char *password, size_t length) const;
+
+    /* msync()s the mapping; put() and remove() do not on their own */
+    bool sync();
+
+    std::string const& error() const { return last_error; }
+
+private:
+    bool fail(const char *what);
+    bool map(size_t size);
+
+    mutable std::shared_mutex lock;
+    int fd;
+    bool writable;
+    unsigned char *base;
+    size_t mapped;
+    std::string last_error;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include "json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+/* Nesting limit, so a hostile peer cannot exhaust the stack */
+const int max_depth = 32;
+
+struct json_parser {
+    const char *p;
+    const char *end;
+
+    void skip_space()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+    }
+
+    bool literal(const char *word)
+    {
+        size_t length = strlen(word);
+        if ((size_t)(end - p) < length || memcmp(p, word, length))
+            return false;
+        p += length;
+        return true;
+    }
+
+    static void append_utf8(std::string& out, unsigned long c)
+    {
+        if (c < 0x80) {
+            out += (char)c;
+        } else if (c < 0x800) {
+            out += (char)(0xc0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            out += (char)(0xe0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3f));
+            out += (char)(0x80 | (c & 0x3f));
+        } else {
+            out += (char)(0xf0 | (c >> 18));
+            out += (char)(0x80 | ((c >> 12) & 0x3f));
+            out += (char)(0x80 | ((c >> 6) & 0x3f));
+            out += (char)(0x80 | (c & 0x3f));
+        }
+    }
+
+    bool hex4(unsigned long& c)
+    {
+        c = 0;
+        for (int i = 0; i < 4; i++, p++) {
+            if (p >= end)
+                return false;
+            c <<= 4;
+            if (*p >= '0' && *p <= '9')
+                c |= *p - '0';
+            else if (*p >= 'a' && *p <= 'f')
+                c |= *p - 'a' + 10;
+            else if (*p >= 'A' && *p <= 'F')
+                c |= *p - 'A' + 10;
+            else
+                return false;
+        }
+        return true;
+    }
+
+    bool string(std::string& out)
+    {
+        if (p >= end || *p != '"')
+            return false;
+        p++;
+        out.clear();
+        while (p < end && *p != '"') {
+            if ((unsigned char)*p < 0x20)
+                return false;
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end)
+                return false;
+            switch (*p++) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned long c, low;
+                if (!hex4(c))
+                    return false;
+                if (c >= 0xd800 && c < 0xdc00) {
+                    if (!literal("\\u") || !hex4(low) ||
+                        low < 0xdc00 || low >= 0xe000)
+                        return false;
+                    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                }
+                append_utf8(out, c);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (p >= end)
+            return false;
+        p++;
+        return true;
+    }
+
+    bool number(double& out)
+    {
+        const char *start = p;
+        char buffer[64];
+
+        if (p < end && *p == '-')
+            p++;
+        while (p < end && *p && strchr("0123456789.eE+-", *p))
+            p++;
+        if (p == start || (size_t)(p - start) >= sizeof(buffer))
+            return false;
+        memcpy(buffer, start, p - start);
+        buffer[p - start] = '\0';
+        char *parsed;
+        out = strtod(buffer, &parsed);
+        return *parsed == '\0';
+    }
+
+    bool value(json_value& out, int depth)
+    {
+        if (depth > max_depth)
+            return false;
+        skip_space();
+        if (p >= end)
+            return false;
+
+        switch (*p) {
+        case 'n':
+            out.type = json_value::null_value;
+            return literal("null");
+        case 't':
+            out.type = json_value::bool_value;
+            out.boolean = true;
+            return literal("true");
+        case 'f':
+            out.type = json_value::bool_value;
+            out.boolean = false;
+            return literal("false");
+        case '"':
+            out.type = json_value::string_value;
+            return string(out.string);
+        case '[':
+            out.type = json_value::array_value;
+            p++;
+            skip_space();
+            if (p < end && *p == ']') {
+                p++;
+                return true;
+            }
+            for (;;) {
+                out.items.push_back(json_value());
+                if (!value(out.items.back(), depth + 1))
+                    return false;
+                skip_space();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == ']') {
+                    p++;
+                    return true;
+                }
+                return false;
+            }
+        case '{':
+            out.type = json_value::object_value;
+            p++;
+            skip_space();
+            if (p < end && *p == '}') {
+                p++;
+                return true;
+            }
+            for (;;) {
+                out.members.push_back(std::make_pair(std::string(), json_value()));
+                skip_space();
+                if (!string(out.members.back().first))
+                    return false;
+                skip_space();
+                if (p >= end || *p++ != ':')
+                    return false;
+                if (!value(out.members.back().second, depth + 1))
+                    return false;
+                skip_space();
+                if (p < end && *p == ',') {
+                    p++;
+                    continue;
+                }
+                if (p < end && *p == '}') {
+                    p++;
+                    return true;
+                }
+                return false;
+            }
+        default:
+            out.type = json_value::number_value;
+            return number(out.number);
+        }
+    }
+};
+
+}
+
+json_value const* json_value::get(const char *key) const
+{
+    for (size_t i = 0; i < members.size(); i++)
+        if (members[i].first == key)
+            return &members[i].second;
+    return NULL;
+}
+
+bool json_parse(std::string const& text, json_value& value)
+{
+    json_parser parser;
+
+    parser.p = text.data();
+    parser.end = text.data() + text.size();
+    value = json_value();
+    if (!parser.value(value, 0))
+        return false;
+    parser.skip_space();
+    return parser.p == parser.end;
+}
+
+std::string json_quote(std::string const& text)
+{
+    std::string out("\"");
+    char escape[8];
+
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+std::string json_hex(const void *data, size_t length)
+{
+    static const char digits[] = "0123456789abcdef";
+    const unsigned char *bytes = (const unsigned char *)data;
+    std::string out;
+
+    for (size_t i = 0; i < length; i++) {
+        out += digits[bytes[i] >> 4];
+        out += digits[bytes[i] & 15];
+    }
+    return out;
+}
+
+bool json_unhex(std::string const& hex, std::string& out)
+{
+    out.clear();
+    if (hex.size() % 2)
+        return false;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int value = 0;
+        for (int j = 0; j < 2; j++) {
+            char c = hex[i + j];
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                return false;
+        }
+        out += (char)value;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Just enough JSON for line-delimited stratum messages: parsing into a tree
+ * and quoting strings for the hand-built replies.
+ */
+struct json_value {
+    enum kind {
+        null_value,
+        bool_value,
+        number_value,
+        string_value,
+        array_value,
+        object_value
+    };
+
+    kind type;
+    bool boolean;
+    double number;
+    std::string string;
+    std::vector<json_value> items;
+    std::vector<std::pair<std::string, json_value> > members;
+
+    json_value() : type(null_value), boolean(false), number(0) {}
+
+    /* Object member, or NULL if this is not an object or has no such key */
+    json_value const* get(const char *key) const;
+
+    bool is_null() const { return type == null_value; }
+    bool is_true() const { return type == bool_value && boolean; }
+};
+
+/* Returns false on malformed input or trailing garbage */
+bool json_parse(std::string const& text, json_value& value);
+
+std::string json_quote(std::string const& text);
+
+/* Binary fields travel as lowercase hex strings */
+std::string json_hex(const void *data, size_t length);
+bool json_unhex(std::string const& hex, std::string& out);
+
+#endif
@@ -0,0 +1,626 @@
+#include "lease.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "json.h"
+#include "stratum.h"
+
+/* How often workers report, which doubles as the lease heartbeat */
+#define LEASE_REPORT_US		250000
+
+/* Back-off after the coordinator had nothing to lease */
+#define LEASE_RETRY_US		500000
+
+/* A peer sending more than this without a newline is dropped */
+#define LEASE_MAX_LINE		(256 * 1024)
+
+static int64_t lease_now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool lease_is_unix(std::string const& address)
+{
+    return address.find('/') != std::string::npos;
+}
+
+/* Opens a listening or connected socket for "host:port" or a Unix path */
+static int lease_socket(std::string const& address, bool listening,
+    std::string& error)
+{
+    int fd = -1;
+
+    if (lease_is_unix(address)) {
+        struct sockaddr_un un;
+
+        if (address.size() >= sizeof(un.sun_path)) {
+            error = "socket path too long";
+            return -1;
+        }
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        memcpy(un.sun_path, address.c_str(), address.size());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && listening)
+            unlink(address.c_str());
+        if (fd >= 0 && !(listening ?
+            bind(fd, (struct sockaddr *)&un, sizeof(un)) || listen(fd, 64) :
+            connect(fd, (struct sockaddr *)&un, sizeof(un))))
+            return fd;
+        error = strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    size_t colon = address.rfind(':');
+    struct addrinfo hints, *found, *ai;
+    int status, one = 1;
+
+    if (colon == std::string::npos) {
+        error = "address must be host:port or a socket path";
+        return -1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    status = getaddrinfo(address.substr(0, colon).c_str(),
+        address.substr(colon + 1).c_str(), &hints, &found);
+    if (status) {
+        error = gai_strerror(status);
+        return -1;
+    }
+    for (ai = found; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (listening)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (!(listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) || listen(fd, 64) :
+            connect(fd, ai->ai_addr, ai->ai_addrlen)))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        error = strerror(errno);
+    freeaddrinfo(found);
+    return fd;
+}
+
+static uint64_t lease_space(scan_job const& job)
+{
+    uint64_t count = job.extranonce2_count();
+    return count >> 32 ? UINT64_MAX : count << 32;
+}
+
+lease_coordinator::lease_coordinator(std::string const& address,
+    uint64_t lease_size, unsigned int timeout_ms)
+    : address(address), timeout_ms(timeout_ms), listen_fd(-1),
+      running(false), next_position(0), next_lease(1), leases(0),
+      released(0), retired_hashes(0), retired_shares(0)
+{
+    /* Whole scanner chunks, so ranges never split one */
+    this->lease_size = lease_size < 64 ? 64 : lease_size & ~(uint64_t)63;
+    wake_fds[0] = wake_fds[1] = -1;
+}
+
+lease_coordinator::~lease_coordinator()
+{
+    stop();
+}
+
+bool lease_coordinator::start()
+{
+    if (running)
+        return true;
+    listen_fd = lease_socket(address, true, last_error);
+    if (listen_fd < 0)
+        return false;
+    if (pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC)) {
+        last_error = strerror(errno);
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    running = true;
+    server = std::thread(&lease_coordinator::run, this);
+    return true;
+}
+
+void lease_coordinator::stop()
+{
+    if (!running.exchange(false))
+        return;
+    char one = 1;
+    ssize_t written = write(wake_fds[1], &one, 1);
+    (void)written;
+    server.join();
+
+    for (size_t i = 0; i < peers.size(); i++)
+        close(peers[i].fd);
+    peers.clear();
+    close(listen_fd);
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    listen_fd = wake_fds[0] = wake_fds[1] = -1;
+    if (lease_is_unix(address))
+        unlink(address.c_str());
+}
+
+void lease_coordinator::set_job(std::shared_ptr<scan_job const> job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->job = job;
+        next_position = 0;
+        returned.clear();
+        for (size_t i = 0; i < peers.size(); i++) {
+            peers[i].leases.clear();
+            send_job(peers[i]);
+        }
+    }
+    char one = 1;
+    ssize_t written = write(wake_fds[1], &one, 1);
+    (void)written;
+}
+
+bool lease_coordinator::next_share(lease_share& share)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (found.empty())
+        return false;
+    share = found.front();
+    found.pop_front();
+    return true;
+}
+
+lease_stats lease_coordinator::stats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    lease_stats stats;
+
+    stats.workers = peers.size();
+    stats.leases = leases;
+    stats.released = released;
+    stats.hashes = retired_hashes;
+    stats.shares = retired_shares;
+    stats.hashrate = 0;
+    for (size_t i = 0; i < peers.size(); i++) {
+        stats.hashes += peers[i].hashes;
+        stats.shares += peers[i].shares;
+        stats.hashrate += peers[i].hashrate;
+    }
+    return stats;
+}
+
+void lease_coordinator::send_line(peer& worker, std::string const& line)
+{
+    worker.output += line;
+    worker.output += '\n';
+}
+
+void lease_coordinator::send_job(peer& worker)
+{
+    if (!job)
+        return;
+    char size[16];
+    snprintf(size, sizeof(size), "%u", job->extranonce2_size);
+    send_line(worker, "{\"id\":null,\"method\":\"lease.job\",\"params\":" +
+        stratum_notify_params(*job, true) + ",\"extranonce1\":\"" +
+        json_hex(job->extranonce1.data(), job->extranonce1.size()) +
+        "\",\"extranonce2_size\":" + size + ",\"target\":\"" +
+        json_hex(job->target, sizeof(job->target)) + "\"}");
+}
+
+/* Hands the worker's leases back and forgets it; caller holds lock */
+void lease_coordinator::drop(peer& worker)
+{
+    for (size_t i = worker.leases.size(); i > 0; i--)
+        returned.push_front(worker.leases[i - 1]);
+    released += worker.leases.size();
+    worker.leases.clear();
+    retired_hashes += worker.hashes;
+    retired_shares += worker.shares;
+    close(worker.fd);
+    worker.fd = -1;
+}
+
+void lease_coordinator::grant(peer& worker, json_value const& id)
+{
+    char reply[160];
+    lease granted;
+
+    snprintf(reply, sizeof(reply), "{\"id\":%.0f,\"result\":null}", id.number);
+    if (!job) {
+        send_line(worker, reply);
+        return;
+    }
+    if (!returned.empty()) {
+        granted = returned.front();
+        returned.pop_front();
+    } else {
+        uint64_t space = lease_space(*job);
+        if (next_position >= space) {
+            send_line(worker, reply);
+            return;
+        }
+        granted.begin = next_position;
+        granted.end = space - next_position < lease_size ? space :
+            next_position + lease_size;
+        next_position = granted.end;
+    }
+    granted.id = next_lease++;
+    worker.leases.push_back(granted);
+    leases++;
+
+    snprintf(reply, sizeof(reply), ",%llu,\"%llx\",\"%llx\"]}",
+        (unsigned long long)granted.id, (unsigned long long)granted.begin,
+        (unsigned long long)granted.end);
+    char head[48];
+    snprintf(head, sizeof(head), "{\"id\":%.0f,\"result\":[", id.number);
+    send_line(worker, head + json_quote(job->id) + reply);
+}
+
+void lease_coordinator::handle(peer& worker, json_value const& message)
+{
+    json_value const* method = message.get("method");
+    json_value const* params = message.get("params");
+    json_value const* id = message.get("id");
+
+    if (!method || method->type != json_value::string_value ||
+        !params || params->type != json_value::array_value)
+        return;
+    std::vector<json_value> const& items = params->items;
+
+    if (method->string == "lease.hello") {
+        if (!items.empty() && items[0].type == json_value::string_value)
+            worker.name = items[0].string;
+    } else if (method->string == "lease.request") {
+        for (size_t i = 0; i < items.size(); i++) {
+            for (size_t j = 0; j < worker.leases.size(); j++) {
+                if (items[i].type == json_value::number_value &&
+                    worker.leases[j].id == (uint64_t)items[i].number) {
+                    worker.leases.erase(worker.leases.begin() + j);
+                    break;
+                }
+            }
+        }
+        if (id && id->type == json_value::number_value)
+            grant(worker, *id);
+    } else if (method->string == "lease.report") {
+        if (items.size() < 2 || items[0].type != json_value::number_value ||
+            items[1].type != json_value::number_value)
+            return;
+        int64_t now = lease_now_us();
+        uint64_t hashes = (uint64_t)items[0].number;
+        if (!worker.rate_since_us) {
+            worker.rate_since_us = now;
+            worker.rate_hashes = hashes;
+        } else if (now - worker.rate_since_us >= LEASE_REPORT_US) {
+            worker.hashrate = (hashes - worker.rate_hashes) * 1e6 /
+                (now - worker.rate_since_us);
+            worker.rate_since_us = now;
+            worker.rate_hashes = hashes;
+        }
+        worker.hashes = hashes;
+        worker.shares = (uint64_t)items[1].number;
+    } else if (method->string == "lease.share") {
+        lease_share share;
+        std::string hash;
+        if (items.size() < 5)
+            return;
+        for (size_t i = 0; i < 5; i++)
+            if (items[i].type != json_value::string_value)
+                return;
+        if (!json_unhex(items[4].string, hash) || hash.size() != NUDD_HASH_SIZE)
+            return;
+        share.worker = worker.name;
+        share.job_id = items[0].string;
+        share.extranonce2 = strtoull(items[1].string.c_str(), NULL, 16);
+        share.ntime = (uint32_t)strtoul(items[2].string.c_str(), NULL, 16);
+        share.nonce = (uint32_t)strtoul(items[3].string.c_str(), NULL, 16);
+        memcpy(share.hash, hash.data(), NUDD_HASH_SIZE);
+        found.push_back(share);
+    }
+}
+
+void lease_coordinator::run()
+{
+    std::vector<struct pollfd> fds;
+
+    while (running) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            fds.resize(2 + peers.size());
+            for (size_t i = 0; i < peers.size(); i++) {
+                fds[2 + i].fd = peers[i].fd;
+                fds[2 + i].events = POLLIN | (peers[i].output.empty() ? 0 : POLLOUT);
+            }
+        }
+        fds[0].fd = listen_fd;
+        fds[1].fd = wake_fds[0];
+        fds[0].events = fds[1].events = POLLIN;
+
+        if (poll(&fds[0], fds.size(), 100) < 0 && errno != EINTR)
+            break;
+
+        std::lock_guard<std::mutex> guard(lock);
+        int64_t now = lease_now_us();
+        char buffer[4096];
+        int fd;
+
+        while (read(wake_fds[0], buffer, sizeof(buffer)) > 0)
+            ;
+
+        /* Peers are only added here and removed at the end, so fds line up */
+        for (size_t i = 0; i + 2 < fds.size(); i++) {
+            peer& worker = peers[i];
+            if (!(fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ssize_t n = recv(worker.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                drop(worker);
+                continue;
+            }
+            if (n < 0)
+                continue;
+            worker.last_seen_us = now;
+            worker.input.append(buffer, n);
+
+            size_t start = 0, newline;
+            while ((newline = worker.input.find('\n', start)) != std::string::npos) {
+                json_value message;
+                if (json_parse(worker.input.substr(start, newline - start), message))
+                    handle(worker, message);
+                start = newline + 1;
+            }
+            worker.input.erase(0, start);
+            if (worker.fd >= 0 && worker.input.size() > LEASE_MAX_LINE)
+                drop(worker);
+        }
+
+        if (fds[0].revents) {
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+                peer worker;
+                worker.fd = fd;
+                worker.last_seen_us = now;
+                worker.hashes = worker.shares = worker.rate_hashes = 0;
+                worker.rate_since_us = 0;
+                worker.hashrate = 0;
+                peers.push_back(worker);
+                send_job(peers.back());
+            }
+        }
+
+        for (size_t i = 0; i < peers.size(); ) {
+            peer& worker = peers[i];
+            if (worker.fd >= 0 && now - worker.last_seen_us > timeout_ms * (int64_t)1000)
+                drop(worker);
+            while (worker.fd >= 0 && !worker.output.empty()) {
+                ssize_t n = send(worker.fd, worker.output.data(),
+                    worker.output.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                    break;
+                if (n <= 0)
+                    drop(worker);
+                else
+                    worker.output.erase(0, n);
+            }
+            if (worker.fd < 0)
+                peers.erase(peers.begin() + i);
+            else
+                i++;
+        }
+    }
+}
+
+lease_worker::lease_worker(std::string const& address, unsigned int threads,
+    std::string const& name)
+    : address(address), name(name), scanner(threads), fd(-1), running(false),
+      connected(false), active_lease(0), has_lease(false), requested(false),
+      retry_us(0), next_id(1), leases(0)
+{
+}
+
+lease_worker::~lease_worker()
+{
+    stop();
+}
+
+bool lease_worker::start()
+{
+    if (running)
+        return true;
+    fd = lease_socket(address, false, last_error);
+    if (fd < 0)
+        return false;
+
+    running = true;
+    connected = true;
+    reader = std::thread(&lease_worker::read_loop, this);
+    control = std::thread(&lease_worker::control_loop, this);
+    send_line("{\"id\":null,\"method\":\"lease.hello\",\"params\":[" +
+        json_quote(name) + "]}");
+    return true;
+}
+
+void lease_worker::stop()
+{
+    if (!running.exchange(false))
+        return;
+    scanner.set_job(std::shared_ptr<scan_job const>());
+    shutdown(fd, SHUT_RDWR);
+    reader.join();
+    control.join();
+    close(fd);
+    fd = -1;
+    connected = false;
+}
+
+lease_worker_stats lease_worker::stats() const
+{
+    lease_worker_stats stats;
+
+    stats.hashes = scanner.hashes();
+    stats.shares = scanner.shares();
+    stats.leases = leases;
+    stats.connected = connected;
+    return stats;
+}
+
+bool lease_worker::send_line(std::string const& line)
+{
+    std::string data = line + "\n";
+    std::lock_guard<std::mutex> guard(write_lock);
+    size_t sent = 0;
+
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+void lease_worker::read_loop()
+{
+    std::string pending;
+    char buffer[4096];
+
+    while (pending.size() <= LEASE_MAX_LINE) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        pending.append(buffer, n);
+
+        size_t start = 0, newline;
+        while ((newline = pending.find('\n', start)) != std::string::npos) {
+            json_value message;
+            if (json_parse(pending.substr(start, newline - start), message))
+                handle(message);
+            start = newline + 1;
+        }
+        pending.erase(0, start);
+    }
+
+    connected = false;
+    if (pending.size() > LEASE_MAX_LINE)
+        shutdown(fd, SHUT_RDWR);
+    scanner.set_job(std::shared_ptr<scan_job const>());
+}
+
+void lease_worker::handle(json_value const& message)
+{
+    json_value const* method = message.get("method");
+    json_value const* result = message.get("result");
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (method && method->type == json_value::string_value &&
+        method->string == "lease.job") {
+        std::shared_ptr<scan_job> next(new scan_job());
+        json_value const* params = message.get("params");
+        json_value const* extranonce1 = message.get("extranonce1");
+        json_value const* size = message.get("extranonce2_size");
+        json_value const* target = message.get("target");
+        std::string raw;
+
+        if (!params || !stratum_job_from_notify(*params, *next) ||
+            !extranonce1 || extranonce1->type != json_value::string_value ||
+            !json_unhex(extranonce1->string, next->extranonce1) ||
+            !size || !stratum_extranonce2_size(*size, next->extranonce2_size) ||
+            !target || target->type != json_value::string_value ||
+            !json_unhex(target->string, raw) || raw.size() != NUDD_HASH_SIZE)
+            return;
+        memcpy(next->target, raw.data(), NUDD_HASH_SIZE);
+
+        job = next;
+        has_lease = false;
+        requested = false;
+        scanner.set_job(std::shared_ptr<scan_job const>());
+        return;
+    }
+
+    if (!message.get("id") || !result)
+        return;
+    requested = false;
+    if (result->is_null())
+        retry_us = lease_now_us() + LEASE_RETRY_US;
+    if (result->type != json_value::array_value || result->items.size() < 4 ||
+        result->items[0].type != json_value::string_value ||
+        result->items[1].type != json_value::number_value ||
+        result->items[2].type != json_value::string_value ||
+        result->items[3].type != json_value::string_value)
+        return;
+    if (!job || result->items[0].string != job->id)
+        return;
+
+    active_lease = (uint64_t)result->items[1].number;
+    has_lease = true;
+    leases++;
+    scanner.set_job(job, strtoull(result->items[2].string.c_str(), NULL, 16),
+        strtoull(result->items[3].string.c_str(), NULL, 16), false);
+}
+
+void lease_worker::control_loop()
+{
+    int64_t reported_us = 0;
+    scan_share share;
+    char line[256];
+
+    while (running) {
+        if (scanner.next_share(share, 50)) {
+            snprintf(line, sizeof(line), ",\"%llx\",\"%08x\",\"%08x\",\"",
+                (unsigned long long)share.extranonce2, share.ntime, share.nonce);
+            send_line("{\"id\":null,\"method\":\"lease.share\",\"params\":[" +
+                json_quote(share.job_id) + line +
+                json_hex(share.hash, sizeof(share.hash)) + "\"]}");
+        }
+
+        int64_t now = lease_now_us();
+        if (now - reported_us >= LEASE_REPORT_US) {
+            snprintf(line, sizeof(line),
+                "{\"id\":null,\"method\":\"lease.report\",\"params\":[%llu,%llu]}",
+                (unsigned long long)scanner.hashes(),
+                (unsigned long long)scanner.shares());
+            send_line(line);
+            reported_us = now;
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        if (!job || requested || now < retry_us || scanner.remaining())
+            continue;
+        if (has_lease)
+            snprintf(line, sizeof(line),
+                "{\"id\":%llu,\"method\":\"lease.request\",\"params\":[%llu]}",
+                (unsigned long long)next_id++, (unsigned long long)active_lease);
+        else
+            snprintf(line, sizeof(line),
+                "{\"id\":%llu,\"method\":\"lease.request\",\"params\":[]}",
+                (unsigned long long)next_id++);
+        requested = true;
+        guard.unlock();
+        send_line(line);
+    }
+}
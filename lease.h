@@ -0,0 +1,181 @@
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scanner.h"
+
+struct json_value;
+
+/*
+ * Splits one job's search space between worker processes.
+ *
+ * The coordinator hands out leases: disjoint ranges of scanner positions
+ * (extranonce2 << 32 | nonce, see nonce_scanner).  Workers renew their
+ * leases by reporting their hash count; a worker that stays silent for
+ * timeout_ms is dropped and its leases go back to the front of the queue.
+ * Addresses are "host:port" for TCP or a filesystem path for a Unix socket.
+ *
+ * The wire protocol is line-delimited JSON:
+ *
+ *   <- lease.job [mining.notify params], extranonce1, extranonce2_size, target
+ *   -> lease.request [finished lease ids...]
+ *   <- result [job_id, lease_id, begin, end] or null when out of work
+ *   -> lease.report [hashes, shares]
+ *   -> lease.share [job_id, extranonce2, ntime, nonce, hash]
+ *
+ * begin, end and extranonce2 are hex numbers; a lease counts as finished
+ * once every position in it has been claimed by a scanner thread.
+ */
+struct lease_stats {
+    uint64_t workers;
+    uint64_t leases;
+    uint64_t released;
+    uint64_t hashes;
+    uint64_t shares;
+    double hashrate;
+};
+
+struct lease_share {
+    std::string worker;
+    std::string job_id;
+    uint64_t extranonce2;
+    uint32_t ntime;
+    uint32_t nonce;
+    unsigned char hash[NUDD_HASH_SIZE];
+};
+
+class lease_coordinator {
+public:
+    lease_coordinator(std::string const& address, uint64_t lease_size,
+        unsigned int timeout_ms);
+    ~lease_coordinator();
+
+    bool start();
+    void stop();
+
+    /* Replaces the job; every outstanding lease is void from here on */
+    void set_job(std::shared_ptr<scan_job const> job);
+
+    /* Pops the oldest share reported by any worker */
+    bool next_share(lease_share& share);
+
+    std::string const& error() const { return last_error; }
+    lease_stats stats();
+
+private:
+    struct lease {
+        uint64_t id;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct peer {
+        int fd;
+        std::string name;
+        std::string input;
+        std::string output;
+        int64_t last_seen_us;
+        uint64_t hashes;
+        uint64_t shares;
+        int64_t rate_since_us;
+        uint64_t rate_hashes;
+        double hashrate;
+        std::vector<lease> leases;
+    };
+
+    lease_coordinator(lease_coordinator const&);
+    lease_coordinator& operator=(lease_coordinator const&);
+
+    void run();
+    void handle(peer& worker, json_value const& message);
+    void grant(peer& worker, json_value const& id);
+    void drop(peer& worker);
+    void send_job(peer& worker);
+    void send_line(peer& worker, std::string const& line);
+
+    std::string address;
+    uint64_t lease_size;
+    unsigned int timeout_ms;
+
+    int listen_fd;
+    int wake_fds[2];
+    std::thread server;
+    std::atomic<bool> running;
+    std::string last_error;
+
+    /* Everything below is shared with the caller's thread */
+    std::mutex lock;
+    std::shared_ptr<scan_job const> job;
+    uint64_t next_position;
+    uint64_t next_lease;
+    std::deque<lease> returned;
+    std::vector<peer> peers;
+    std::deque<lease_share> found;
+
+    uint64_t leases;
+    uint64_t released;
+    uint64_t retired_hashes;
+    uint64_t retired_shares;
+};
+
+struct lease_worker_stats {
+    uint64_t hashes;
+    uint64_t shares;
+    uint64_t leases;
+    bool connected;
+};
+
+/* Runs a nonce_scanner over whatever ranges the coordinator leases to it */
+class lease_worker {
+public:
+    lease_worker(std::string const& address, unsigned int threads,
+        std::string const& name);
+    ~lease_worker();
+
+    bool start();
+    void stop();
+
+    std::string const& error() const { return last_error; }
+    lease_worker_stats stats() const;
+
+private:
+    lease_worker(lease_worker const&);
+    lease_worker& operator=(lease_worker const&);
+
+    bool send_line(std::string const& line);
+    void read_loop();
+    void control_loop();
+    void handle(json_value const& message);
+
+    std::string address;
+    std::string name;
+    nonce_scanner scanner;
+    int fd;
+    std::mutex write_lock;
+    std::thread reader;
+    std::thread control;
+    std::atomic<bool> running;
+    std::atomic<bool> connected;
+    std::string last_error;
+
+    std::mutex lock;
+    std::shared_ptr<scan_job const> job;
+    uint64_t active_lease;
+    bool has_lease;
+    bool requested;
+    int64_t retry_us;
+    uint64_t next_id;
+
+    std::atomic<uint64_t> leases;
+};
+
+#endif
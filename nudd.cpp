@@ -0,0 +1,171 @@
+#include "nudd.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "algorithms.h"
+#include "bcrypt.h"
+#include "pow.h"
+#include "threadpool.h"
+
+static_assert(NUDD_HEADER_BYTES == NUDD_HEADER_SIZE, "header size");
+static_assert(NUDD_HASH_BYTES == NUDD_HASH_SIZE, "hash size");
+
+/* nudd_algorithm is never defined; the handles are the registry's own */
+static pow_algorithm const *unwrap(const nudd_algorithm *algorithm)
+{
+    return reinterpret_cast<pow_algorithm const *>(algorithm);
+}
+
+static const nudd_algorithm *wrap(pow_algorithm const *algorithm)
+{
+    return reinterpret_cast<const nudd_algorithm *>(algorithm);
+}
+
+int nudd_api_version(void)
+{
+    return NUDD_API_VERSION;
+}
+
+/*
+ * Nothing may unwind into a C caller.  The registry, the host profile and
+ * the pool's threads are all made on first use, and hashing allocates, so
+ * every entry catches whatever is thrown and reports it as its failure
+ * value; a hash that could not be computed comes back the same way.
+ */
+
+size_t nudd_algorithm_count(void)
+{
+    try {
+        return pow_algorithms().size();
+    } catch (...) {
+        return 0;
+    }
+}
+
+const nudd_algorithm *nudd_algorithm_at(size_t index)
+{
+    try {
+        if (index >= pow_algorithms().size())
+            return NULL;
+        return wrap(pow_algorithms()[index]);
+    } catch (...) {
+        return NULL;
+    }
+}
+
+const nudd_algorithm *nudd_algorithm_find(const char *name)
+{
+    try {
+        return name ? wrap(pow_find(name)) : NULL;
+    } catch (...) {
+        return NULL;
+    }
+}
+
+const char *nudd_algorithm_name(const nudd_algorithm *algorithm)
+{
+    return algorithm ? unwrap(algorithm)->name() : NULL;
+}
+
+const char *nudd_algorithm_kernel(const nudd_algorithm *algorithm)
+{
+    try {
+        return algorithm ? unwrap(algorithm)->kernel() : NULL;
+    } catch (...) {
+        return NULL;
+    }
+}
+
+int nudd_algorithm_self_test(const nudd_algorithm *algorithm)
+{
+    try {
+        return algorithm && unwrap(algorithm)->self_test(hashing_pool());
+    } catch (...) {
+        return 0;
+    }
+}
+
+int nudd_pow_hash(const nudd_algorithm *algorithm,
+    const unsigned char *header, unsigned char *hash)
+{
+    if (!algorithm)
+        return -1;
+    try {
+        return unwrap(algorithm)->hash((const char *)header, (char *)hash) ?
+            0 : -1;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int nudd_pow_hash_batch(const nudd_algorithm *algorithm,
+    const unsigned char *headers, size_t count, unsigned char *hashes)
+{
+    if (!algorithm)
+        return -1;
+    try {
+        if (!unwrap(algorithm)->hash_batch((const char *)headers, count,
+                (char *)hashes, hashing_pool()))
+            return -1;
+    } catch (...) {
+        return -1;
+    }
+    return 0;
+}
+
+int nudd_pow_scan(const nudd_algorithm *algorithm,
+    const unsigned char *header, const unsigned char *target,
+    uint32_t first, uint32_t count, nudd_share *shares, size_t capacity,
+    size_t *found)
+{
+    if (!algorithm || (uint64_t)first + count > ((uint64_t)1 << 32))
+        return -1;
+    try {
+        std::vector<pow_found> results;
+
+        if (!unwrap(algorithm)->scan_batch((const char *)header, target,
+                first, count, results, hashing_pool()))
+            return -1;
+        for (size_t i = 0; i < results.size() && i < capacity; i++) {
+            shares[i].nonce = results[i].nonce;
+            memcpy(shares[i].hash, results[i].hash, NUDD_HASH_BYTES);
+        }
+        if (found)
+            *found = results.size();
+    } catch (...) {
+        return -1;
+    }
+    return 0;
+}
+
+int nudd_pow_check_batch(const nudd_algorithm *algorithm,
+    const unsigned char *headers, size_t count, unsigned char *valid,
+    unsigned char *hashes)
+{
+    unsigned char target[NUDD_HASH_SIZE];
+
+    if (!algorithm)
+        return -1;
+    try {
+        std::vector<char> computed(count * NUDD_HASH_SIZE);
+
+        if (!unwrap(algorithm)->hash_batch((const char *)headers, count,
+                computed.data(), hashing_pool()))
+            return -1;
+        for (size_t i = 0; i < count; i++) {
+            const unsigned char *header = headers + i * NUDD_HEADER_SIZE;
+            const char *hash = &computed[i * NUDD_HASH_SIZE];
+
+            valid[i] = nudd_target_from_compact(
+                    le32dec(header + NUDD_HEADER_NBITS), target) &&
+                nudd_hash_meets_target(hash, target);
+        }
+        if (hashes)
+            memcpy(hashes, computed.data(), computed.size());
+    } catch (...) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef NUDD_H
+#define NUDD_H
+
+/*
+ * C interface to the proof of work code, for programs that link libnudd
+ * directly instead of going through the Python module.  Only what is
+ * declared here is exported from libnudd.so; new entry points are added,
+ * existing ones keep their signatures, and NUDD_API_VERSION goes up with
+ * each addition.
+ *
+ * Headers are 80 bytes and hashes and targets 32 little-endian bytes.
+ * Batches and scans run on the process-wide hashing pool, sized by the
+ * host profile that nudd_hash.tune() writes.  Every function is safe to
+ * call from several threads at once.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define NUDD_EXPORT	__attribute__((visibility("default")))
+#else
+#define NUDD_EXPORT
+#endif
+
+#define NUDD_API_VERSION	1
+
+#define NUDD_HEADER_BYTES	80
+#define NUDD_HASH_BYTES		32
+
+typedef struct nudd_algorithm nudd_algorithm;
+
+typedef struct {
+    uint32_t nonce;
+    unsigned char hash[NUDD_HASH_BYTES];
+} nudd_share;
+
+/* NUDD_API_VERSION of the library actually loaded */
+NUDD_EXPORT int nudd_api_version(void);
+
+/*
+ * Registered algorithms: "nudd", "scrypt".  The lookups give 0 or NULL if
+ * the registry cannot be built for want of memory.
+ */
+NUDD_EXPORT size_t nudd_algorithm_count(void);
+NUDD_EXPORT const nudd_algorithm *nudd_algorithm_at(size_t index);
+NUDD_EXPORT const nudd_algorithm *nudd_algorithm_find(const char *name);
+NUDD_EXPORT const char *nudd_algorithm_name(const nudd_algorithm *algorithm);
+NUDD_EXPORT const char *nudd_algorithm_kernel(const nudd_algorithm *algorithm);
+
+/* 1 if the algorithm reproduces its known answers on this host */
+NUDD_EXPORT int nudd_algorithm_self_test(const nudd_algorithm *algorithm);
+
+/*
+ * The functions below return 0 on success and -1 if algorithm is NULL,
+ * a range runs past nonce 2^32 - 1, memory runs out or the hashing
+ * threads cannot be started.
+ */
+
+NUDD_EXPORT int nudd_pow_hash(const nudd_algorithm *algorithm,
+    const unsigned char *header, unsigned char *hash);
+
+/* count contiguous headers into count contiguous hashes */
+NUDD_EXPORT int nudd_pow_hash_batch(const nudd_algorithm *algorithm,
+    const unsigned char *headers, size_t count, unsigned char *hashes);
+
+/*
+ * Tries nonces first .. first + count - 1 in header, hashing the part of
+ * the header before the nonce once where the algorithm allows.  Hashes at
+ * or below target are written to shares in nonce order, up to capacity of
+ * them; *found receives how many there were in all.
+ */
+NUDD_EXPORT int nudd_pow_scan(const nudd_algorithm *algorithm,
+    const unsigned char *header, const unsigned char *target,
+    uint32_t first, uint32_t count, nudd_share *shares, size_t capacity,
+    size_t *found);
+
+/*
+ * Checks headers against their own compact targets.  valid[i] is set to
+ * 0 or 1, and hashes (if not NULL) receive every header's hash.
+ */
+NUDD_EXPORT int nudd_pow_check_batch(const nudd_algorithm *algorithm,
+    const unsigned char *headers, size_t count, unsigned char *valid,
+    unsigned char *hashes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
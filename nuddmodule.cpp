@@ -1,20 +1,33 @@
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include "algorithms.h"
 #include "bcrypt.h"
+#include "bench.h"
+#include "credstore.h"
+#include "lease.h"
+#include "pow.h"
+#include "prefilter.h"
+#include "radix64.h"
+#include "scrypt.h"
+#include "shareserver.h"
+#include "stratum.h"
+#include "threadpool.h"
+#include "tune.h"
 
-void nudd_hash(const char* input, char* output)
-{
-    uint32_t hash[8];
-    std::string const hash_data = bcrypt_iterated(
-        std::string(
-                reinterpret_cast<char const*>(input),80
-        )
-    );
-
-    memcpy(output, hash_data.data(), 32);
+#include <vector>
 
-}
+#if PY_MAJOR_VERSION >= 3
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
 
 static PyObject *nudd_getpowhash(PyObject *self, PyObject *args)
 {
@@ -37,35 +50,2246 @@ static PyObject *nudd_getpowhash(PyObject *self, PyObject *args)
 #endif
     Py_DECREF(input);
 #if PY_MAJOR_VERSION >= 3
-    value = Py_BuildValue("y#", output, 32);
+    value = Py_BuildValue("y#", output, (Py_ssize_t)32);
 #else
-    value = Py_BuildValue("s#", output, 32);
+    value = Py_BuildValue("s#", output, (Py_ssize_t)32);
 #endif
     PyMem_Free(output);
     return value;
 }
 
-static PyMethodDef NuddMethods[] = {
-    { "getPoWHash", nudd_getpowhash, METH_VARARGS, "Returns the proof of work hash using nudd hash" },
-    { NULL, NULL, 0, NULL }
-};
+static PyObject *nudd_getpowhash_low_latency(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "header", "threaded", NULL };
+    char hash[NUDD_HASH_SIZE];
+    char header[NUDD_HEADER_SIZE];
+    PyObject *input;
+    int threaded = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "S|i", (char **)keywords,
+            &input, &threaded))
+        return NULL;
+    if (PyBytes_GET_SIZE(input) < NUDD_HEADER_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "block header must be 80 bytes");
+        return NULL;
+    }
+    memcpy(header, PyBytes_AS_STRING(input), NUDD_HEADER_SIZE);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (threaded)
+        nudd_hash_threaded(header, hash, hashing_pool());
+    else
+        nudd_hash_interleaved(header, hash);
+    Py_END_ALLOW_THREADS
+
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("y#", hash, (Py_ssize_t)NUDD_HASH_SIZE);
+#else
+    return Py_BuildValue("s#", hash, (Py_ssize_t)NUDD_HASH_SIZE);
+#endif
+}
+
+static PyObject *nudd_bcrypt_iterated(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "data", "parallel", NULL };
+    const char *data;
+    Py_ssize_t size;
+    int parallel = 0;
+    std::string input, output;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y#|i", (char **)keywords,
+#else
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s#|i", (char **)keywords,
+#endif
+            &data, &size, &parallel))
+        return NULL;
+    input.assign(data, size);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (parallel)
+        output = bcrypt_iterated_128_parallel(input, hashing_pool());
+    else
+        output = bcrypt_iterated_128(input);
+    Py_END_ALLOW_THREADS
+    return PyBytes_FromStringAndSize(output.data(), output.size());
+}
+
+static PyObject *nudd_bcrypt_hash(PyObject *self, PyObject *args)
+{
+    const char *password, *setting;
+    Py_ssize_t password_size;
+    char output[7 + 22 + 31 + 1];
+    std::string key, prefix;
+    char *hashed;
+
+    if (!PyArg_ParseTuple(args, "s#s", &password, &password_size, &setting))
+        return NULL;
+    key.assign(password, password_size);
+    prefix = setting;
+
+    Py_BEGIN_ALLOW_THREADS
+    hashed = _crypt_blowfish_rn(key.c_str(), key.size(), prefix.c_str(),
+        output, sizeof(output));
+    Py_END_ALLOW_THREADS
+    if (!hashed) {
+        PyErr_SetString(PyExc_ValueError, "invalid bcrypt setting");
+        return NULL;
+    }
+    return Py_BuildValue("s", hashed);
+}
+
+/*
+ * PySequence_Fast(), but always a tuple.  A list comes back as itself from
+ * PySequence_Fast(), and without the GIL another thread may resize it or
+ * drop its items while they are being read.
+ */
+static PyObject *nudd_sequence_snapshot(PyObject *sequence, const char *message)
+{
+    PyObject *items = PySequence_Fast(sequence, message);
+    PyObject *snapshot;
+
+    if (!items || PyTuple_Check(items))
+        return items;
+    snapshot = PyList_AsTuple(items);
+    Py_DECREF(items);
+    return snapshot;
+}
+
+/* The characters of a str (or bytes) item; NULL without an exception if neither */
+static const char *nudd_text(PyObject *item, Py_ssize_t *size)
+{
+    char *text;
+
+#if PY_MAJOR_VERSION >= 3
+    if (PyUnicode_Check(item))
+        return PyUnicode_AsUTF8AndSize(item, size);
+#endif
+    if (PyBytes_Check(item) && !PyBytes_AsStringAndSize(item, &text, size))
+        return text;
+    return NULL;
+}
+
+static PyObject *nudd_parse_bcrypt(PyObject *self, PyObject *args)
+{
+    PyObject *input, *sequence, *result;
+    Py_ssize_t count;
+
+    if (!PyArg_ParseTuple(args, "O", &input))
+        return NULL;
+    sequence = nudd_sequence_snapshot(input, "hashes must be a sequence");
+    if (!sequence)
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(sequence);
+
+    std::vector<const char *> hashes(count);
+    std::vector<size_t> lengths(count);
+    std::vector<bcrypt_parsed> parsed(count);
+    for (Py_ssize_t i = 0; i < count; i++) {
+        Py_ssize_t size;
+        hashes[i] = nudd_text(PySequence_Fast_GET_ITEM(sequence, i), &size);
+        if (!hashes[i]) {
+            if (PyErr_Occurred()) {
+                Py_DECREF(sequence);
+                return NULL;
+            }
+            hashes[i] = "";
+            size = 0;
+        }
+        lengths[i] = size;
+    }
+
+    /* The item buffers stay alive as long as the tuple holds the items */
+    Py_BEGIN_ALLOW_THREADS
+    bcrypt_parse_batch(hashes.data(), lengths.data(), count, parsed.data());
+    Py_END_ALLOW_THREADS
+    Py_DECREF(sequence);
+
+    result = PyList_New(count);
+    for (Py_ssize_t i = 0; result && i < count; i++) {
+        PyObject *item;
+        if (!parsed[i].cost) {
+            Py_INCREF(Py_None);
+            item = Py_None;
+        } else {
+#if PY_MAJOR_VERSION >= 3
+            item = Py_BuildValue("(Ciy#y#)",
+#else
+            item = Py_BuildValue("(cis#s#)",
+#endif
+                parsed[i].subtype, (int)parsed[i].cost,
+                parsed[i].salt, (Py_ssize_t)BCRYPT_SALT_SIZE,
+                parsed[i].hash, (Py_ssize_t)BCRYPT_HASH_SIZE);
+        }
+        if (!item) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+    return result;
+}
+
+static PyObject *nudd_format_bcrypt(PyObject *self, PyObject *args)
+{
+    bcrypt_parsed parsed;
+    char output[BCRYPT_HASH_LENGTH + 1];
+    const char *subtype, *salt, *hash;
+    Py_ssize_t subtype_size, salt_size, hash_size;
+    int cost;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTuple(args, "s#iy#y#", &subtype, &subtype_size, &cost,
+            &salt, &salt_size, &hash, &hash_size))
+#else
+    if (!PyArg_ParseTuple(args, "s#is#s#", &subtype, &subtype_size, &cost,
+            &salt, &salt_size, &hash, &hash_size))
+#endif
+        return NULL;
+    if (subtype_size != 1 || (*subtype != 'a' && *subtype != 'x' && *subtype != 'y')) {
+        PyErr_SetString(PyExc_ValueError, "subtype must be \"a\", \"x\" or \"y\"");
+        return NULL;
+    }
+    if (cost < 4 || cost > 31) {
+        PyErr_SetString(PyExc_ValueError, "cost must be 4..31");
+        return NULL;
+    }
+    if (salt_size != BCRYPT_SALT_SIZE || hash_size != BCRYPT_HASH_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "salt must be 16 bytes and hash 23");
+        return NULL;
+    }
+    parsed.subtype = *subtype;
+    parsed.cost = (unsigned char)cost;
+    memcpy(parsed.salt, salt, BCRYPT_SALT_SIZE);
+    memcpy(parsed.hash, hash, BCRYPT_HASH_SIZE);
+    bcrypt_format(parsed, output);
+    return Py_BuildValue("s", output);
+}
+
+static PyObject *nudd_scrypt(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "password", "salt", "n", "r", "p", "dklen",
+        "tmto", "interleave", "parallel", NULL };
+    const char *password, *salt;
+    Py_ssize_t password_size, salt_size, dklen = 64;
+    unsigned long long n;
+    unsigned int r, p;
+    scrypt_tuning tuning = { 1, 1 };
+    int parallel = 1;
+    std::string key, nacl;
+    PyObject *output;
+    int failed;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y#y#KII|nIIi", (char **)keywords,
+#else
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s#s#KII|nIIi", (char **)keywords,
+#endif
+            &password, &password_size, &salt, &salt_size, &n, &r, &p, &dklen,
+            &tuning.tmto, &tuning.interleave, &parallel))
+        return NULL;
+    if (dklen < 1) {
+        PyErr_SetString(PyExc_ValueError, "dklen must be positive");
+        return NULL;
+    }
+    output = PyBytes_FromStringAndSize(NULL, dklen);
+    if (!output)
+        return NULL;
+    key.assign(password, password_size);
+    nacl.assign(salt, salt_size);
+
+    Py_BEGIN_ALLOW_THREADS
+    failed = scrypt((const uint8_t *)key.data(), key.size(),
+        (const uint8_t *)nacl.data(), nacl.size(), n, r, p,
+        (uint8_t *)PyBytes_AS_STRING(output), dklen,
+        parallel && p > 1 ? &hashing_pool() : NULL, NULL, &tuning);
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        Py_DECREF(output);
+        if (errno == ENOMEM)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError,
+            "n must be a power of 2 above 1 and below 2**(16*r), r*p below 2**30, "
+            "tmto from 1 to n and interleave from 1 to 16");
+        return NULL;
+    }
+    return output;
+}
+
+static PyObject *nudd_scrypt_batch(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "inputs", "n", "r", "dklen", "tmto",
+        "interleave", "parallel", NULL };
+    PyObject *input, *sequence, *result;
+    Py_ssize_t count, length = 0, dklen = 32;
+    unsigned long long n = 1024;
+    unsigned int r = 1;
+    scrypt_tuning tuning = { 1, 1 };
+    int parallel = 1;
+    int failed;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|KInIIi", (char **)keywords,
+            &input, &n, &r, &dklen, &tuning.tmto, &tuning.interleave, &parallel))
+        return NULL;
+    if (dklen < 1) {
+        PyErr_SetString(PyExc_ValueError, "dklen must be positive");
+        return NULL;
+    }
+    sequence = nudd_sequence_snapshot(input, "inputs must be a sequence");
+    if (!sequence)
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(sequence);
+
+    std::string inputs;
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(sequence, i);
+        if (!PyBytes_Check(item) ||
+                (i && PyBytes_GET_SIZE(item) != length)) {
+            Py_DECREF(sequence);
+            PyErr_SetString(PyExc_ValueError,
+                "inputs must be bytes of equal length");
+            return NULL;
+        }
+        length = PyBytes_GET_SIZE(item);
+        inputs.append(PyBytes_AS_STRING(item), length);
+    }
+    Py_DECREF(sequence);
+
+    std::vector<uint8_t> output((size_t)count * dklen);
+    Py_BEGIN_ALLOW_THREADS
+    failed = scrypt_batch((const uint8_t *)inputs.data(), length, count, n, r,
+        output.data(), dklen,
+        parallel && (size_t)count > tuning.interleave ? &hashing_pool() : NULL,
+        NULL, &tuning);
+    Py_END_ALLOW_THREADS
+    if (failed) {
+        if (errno == ENOMEM)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError,
+            "n must be a power of 2 above 1 and below 2**(16*r), r below 2**30, "
+            "tmto from 1 to n and interleave from 1 to 16");
+        return NULL;
+    }
+
+    result = PyList_New(count);
+    for (Py_ssize_t i = 0; result && i < count; i++) {
+        PyObject *item = PyBytes_FromStringAndSize(
+            (const char *)&output[i * dklen], dklen);
+        if (!item) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+    return result;
+}
+
+static PyObject *nudd_checkpow(PyObject *self, PyObject *args)
+{
+    char hash[NUDD_HASH_SIZE];
+    char header[NUDD_HEADER_SIZE];
+    PyObject *input;
+    int valid;
+
+    if (!PyArg_ParseTuple(args, "S", &input))
+        return NULL;
+    if (PyBytes_GET_SIZE(input) < NUDD_HEADER_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "block header must be 80 bytes");
+        return NULL;
+    }
+    memcpy(header, PyBytes_AS_STRING(input), NUDD_HEADER_SIZE);
+
+    Py_BEGIN_ALLOW_THREADS
+    valid = nudd_check_pow(header, hash);
+    Py_END_ALLOW_THREADS
+
+#if PY_MAJOR_VERSION >= 3
+    return Py_BuildValue("Ny#", PyBool_FromLong(valid), hash, (Py_ssize_t)NUDD_HASH_SIZE);
+#else
+    return Py_BuildValue("Ns#", PyBool_FromLong(valid), hash, (Py_ssize_t)NUDD_HASH_SIZE);
+#endif
+}
+
+/* Copies a sequence of block headers into one contiguous string; -1 on error */
+static Py_ssize_t nudd_collect_headers(PyObject *sequence, std::string& headers)
+{
+    PyObject *items;
+    Py_ssize_t count, i;
+
+    items = nudd_sequence_snapshot(sequence, "expected a sequence of block headers");
+    if (!items)
+        return -1;
+    count = PySequence_Fast_GET_SIZE(items);
+    headers.resize(count * NUDD_HEADER_SIZE);
+    for (i = 0; i < count; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(items, i);
+        if (!PyBytes_Check(item) || PyBytes_GET_SIZE(item) < NUDD_HEADER_SIZE) {
+            Py_DECREF(items);
+            PyErr_SetString(PyExc_ValueError, "block header must be 80 bytes");
+            return -1;
+        }
+        memcpy(&headers[i * NUDD_HEADER_SIZE], PyBytes_AS_STRING(item), NUDD_HEADER_SIZE);
+    }
+    Py_DECREF(items);
+    return count;
+}
+
+static PyObject *nudd_checkpow_batch(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "headers", "background", NULL };
+    PyObject *sequence, *bitmap;
+    std::string headers;
+    Py_ssize_t count;
+    int background = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", (char **)keywords,
+            &sequence, &background))
+        return NULL;
+    if ((count = nudd_collect_headers(sequence, headers)) < 0)
+        return NULL;
+
+    bitmap = PyBytes_FromStringAndSize(NULL, (count + 7) / 8);
+    if (!bitmap)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    nudd_check_pow_batch(headers.data(), count,
+        (unsigned char *)PyBytes_AS_STRING(bitmap), hashing_pool(),
+        background ? pool_background : pool_foreground);
+    Py_END_ALLOW_THREADS
+    return bitmap;
+}
+
+/* The registered algorithm called name; NULL with ValueError if there is none */
+static pow_algorithm const *nudd_pow_algorithm(const char *name)
+{
+    pow_algorithm const *algorithm = pow_find(name);
+
+    if (!algorithm)
+        PyErr_Format(PyExc_ValueError, "unknown proof of work algorithm: %s", name);
+    return algorithm;
+}
+
+static PyObject *nudd_pow_algorithms(PyObject *self, PyObject *unused)
+{
+    PyObject *result = PyDict_New();
+
+    if (!result)
+        return NULL;
+    for (pow_algorithm const *algorithm : pow_algorithms()) {
+        PyObject *kernel = Py_BuildValue("s", algorithm->kernel());
+        if (!kernel || PyDict_SetItemString(result, algorithm->name(), kernel)) {
+            Py_XDECREF(kernel);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(kernel);
+    }
+    return result;
+}
+
+static PyObject *nudd_pow_hash(PyObject *self, PyObject *args)
+{
+    pow_algorithm const *algorithm;
+    const char *name, *input;
+    Py_ssize_t size;
+    char header[NUDD_HEADER_SIZE], hash[NUDD_HASH_SIZE];
+    bool computed;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTuple(args, "sy#", &name, &input, &size))
+#else
+    if (!PyArg_ParseTuple(args, "ss#", &name, &input, &size))
+#endif
+        return NULL;
+    if (!(algorithm = nudd_pow_algorithm(name)))
+        return NULL;
+    if (size < NUDD_HEADER_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "block header must be 80 bytes");
+        return NULL;
+    }
+    memcpy(header, input, NUDD_HEADER_SIZE);
+
+    Py_BEGIN_ALLOW_THREADS
+    computed = algorithm->hash(header, hash);
+    Py_END_ALLOW_THREADS
+    if (!computed)
+        return PyErr_NoMemory();
+    return PyBytes_FromStringAndSize(hash, NUDD_HASH_SIZE);
+}
+
+static PyObject *nudd_pow_hash_batch(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "algorithm", "headers", "background", NULL };
+    pow_algorithm const *algorithm;
+    const char *name;
+    PyObject *sequence, *result;
+    std::string headers, hashes;
+    Py_ssize_t count, i;
+    int background = 0;
+    bool computed;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sO|i", (char **)keywords,
+            &name, &sequence, &background))
+        return NULL;
+    if (!(algorithm = nudd_pow_algorithm(name)))
+        return NULL;
+    if ((count = nudd_collect_headers(sequence, headers)) < 0)
+        return NULL;
+    hashes.resize(count * NUDD_HASH_SIZE);
+
+    Py_BEGIN_ALLOW_THREADS
+    computed = algorithm->hash_batch(headers.data(), count, &hashes[0],
+        hashing_pool(), background ? pool_background : pool_foreground);
+    Py_END_ALLOW_THREADS
+    if (!computed)
+        return PyErr_NoMemory();
+
+    if (!(result = PyList_New(count)))
+        return NULL;
+    for (i = 0; i < count; i++) {
+        PyObject *hash = PyBytes_FromStringAndSize(&hashes[i * NUDD_HASH_SIZE], NUDD_HASH_SIZE);
+        if (!hash) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, hash);
+    }
+    return result;
+}
+
+static PyObject *nudd_pow_scan(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "algorithm", "header", "target", "first", "count",
+        "background", NULL };
+    pow_algorithm const *algorithm;
+    const char *name, *input, *target;
+    Py_ssize_t size, target_size;
+    unsigned int first, count;
+    int background = 0;
+    char header[NUDD_HEADER_SIZE];
+    unsigned char share_target[NUDD_HASH_SIZE];
+    std::vector<pow_found> found;
+    PyObject *result;
+    bool computed;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sy#y#II|i", (char **)keywords,
+#else
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss#s#II|i", (char **)keywords,
+#endif
+            &name, &input, &size, &target, &target_size, &first, &count, &background))
+        return NULL;
+    if (!(algorithm = nudd_pow_algorithm(name)))
+        return NULL;
+    if (size < NUDD_HEADER_SIZE || target_size != NUDD_HASH_SIZE) {
+        PyErr_SetString(PyExc_ValueError, "block header must be 80 bytes and target 32");
+        return NULL;
+    }
+    if ((uint64_t)first + count > ((uint64_t)1 << 32)) {
+        PyErr_SetString(PyExc_ValueError, "nonce range runs past 2**32");
+        return NULL;
+    }
+    memcpy(header, input, NUDD_HEADER_SIZE);
+    memcpy(share_target, target, NUDD_HASH_SIZE);
+
+    Py_BEGIN_ALLOW_THREADS
+    computed = algorithm->scan_batch(header, share_target, first, count, found,
+        hashing_pool(), background ? pool_background : pool_foreground);
+    Py_END_ALLOW_THREADS
+    if (!computed)
+        return PyErr_NoMemory();
+
+    if (!(result = PyList_New(found.size())))
+        return NULL;
+    for (size_t i = 0; i < found.size(); i++) {
+#if PY_MAJOR_VERSION >= 3
+        PyObject *share = Py_BuildValue("(Iy#)", found[i].nonce,
+#else
+        PyObject *share = Py_BuildValue("(Is#)", found[i].nonce,
+#endif
+            found[i].hash, (Py_ssize_t)NUDD_HASH_SIZE);
+        if (!share) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(result, i, share);
+    }
+    return result;
+}
+
+static PyObject *nudd_pow_self_test(PyObject *self, PyObject *args)
+{
+    pow_algorithm const *algorithm;
+    const char *name;
+    bool passed;
+
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    if (!(algorithm = nudd_pow_algorithm(name)))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    passed = algorithm->self_test(hashing_pool());
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(passed);
+}
+
+static PyObject *nudd_profile_dict(nudd_profile const& profile)
+{
+    return Py_BuildValue("{sIsOsssIsd}", "threads", profile.threads,
+        "smt", profile.smt ? Py_True : Py_False,
+        "engine", profile.engine == BCRYPT_ENGINE_GENERIC ? "generic" : "specialized",
+        "lanes", profile.lanes, "hashrate", profile.hashrate);
+}
+
+static PyObject *nudd_configure_pool(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "cpu_budget", "latency_target_us", NULL };
+    double budget = 0, target = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|dd", (char **)keywords,
+            &budget, &target))
+        return NULL;
+    if (budget < 0 || target < 0) {
+        PyErr_SetString(PyExc_ValueError, "cpu_budget and latency_target_us must not be negative");
+        return NULL;
+    }
+    hashing_pool().set_cpu_budget(budget);
+    hashing_pool().set_latency_target(std::chrono::microseconds((long long)target));
+    Py_RETURN_NONE;
+}
+
+static PyObject *nudd_pool_stats(PyObject *self, PyObject *unused)
+{
+    thread_pool_stats stats = hashing_pool().stats();
+
+    return Py_BuildValue("{snsnsIsIsKsKsdsd}",
+        "foreground_queued", (Py_ssize_t)stats.foreground_queued,
+        "background_queued", (Py_ssize_t)stats.background_queued,
+        "background_running", stats.background_running,
+        "background_limit", stats.background_limit,
+        "foreground_done", (unsigned long long)stats.foreground_done,
+        "background_done", (unsigned long long)stats.background_done,
+        "foreground_wait_p50_us", stats.foreground_wait_p50_us,
+        "foreground_wait_p99_us", stats.foreground_wait_p99_us);
+}
+
+static PyObject *nudd_tune_host(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "seconds", "save", NULL };
+    double seconds = 5.0;
+    int save = 1, saved = 1;
+    nudd_profile best;
+    std::string path = nudd_profile_path();
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|di", (char **)keywords,
+            &seconds, &save))
+        return NULL;
+    if (seconds <= 0) {
+        PyErr_SetString(PyExc_ValueError, "seconds must be positive");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    best = nudd_tune(seconds);
+    if (save)
+        saved = nudd_profile_save(path, best);
+    Py_END_ALLOW_THREADS
+    if (!saved)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+    return nudd_profile_dict(best);
+}
+
+static PyObject *nudd_host_profile_info(PyObject *self, PyObject *unused)
+{
+    return nudd_profile_dict(nudd_host_profile());
+}
+
+static PyObject *nudd_benchmark(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "kernel", "count", "counters", "n", "r", "tmto",
+        "interleave", NULL };
+    const char *kernel;
+    int counters = 1;
+    bench_params params;
+    bench_result result;
+    bool known;
+    PyObject *report, *value;
+    int i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|IiKIII", (char **)keywords,
+            &kernel, &params.count, &counters, &params.n, &params.r,
+            &params.tuning.tmto, &params.tuning.interleave))
+        return NULL;
+    params.counters = counters != 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    known = nudd_bench(kernel, params, result);
+    Py_END_ALLOW_THREADS
+    if (!known) {
+        PyErr_Format(PyExc_ValueError, "unknown kernel %s, or scrypt parameters out of range", kernel);
+        return NULL;
+    }
+
+    report = Py_BuildValue("{s:s,s:K,s:d}", "kernel", kernel,
+        "hashes", (unsigned long long)result.hashes, "seconds", result.seconds);
+    if (!report)
+        return NULL;
+    for (i = 0; i < perf_event_count; i++) {
+        if (!result.available[i])
+            continue;
+        value = PyLong_FromUnsignedLongLong(result.counts[i]);
+        if (!value || PyDict_SetItemString(report, perf_counters::name((perf_event_id)i), value)) {
+            Py_XDECREF(value);
+            Py_DECREF(report);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    if (params.counters && !result.counted) {
+        value = Py_BuildValue("s", result.counter_error.c_str());
+        if (!value || PyDict_SetItemString(report, "counter_error", value)) {
+            Py_XDECREF(value);
+            Py_DECREF(report);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    return report;
+}
 
 #if PY_MAJOR_VERSION >= 3
+/*
+ * Asynchronous hashing.  Every event loop gets one completion channel:
+ * hashing threads append finished results to it and only signal the
+ * channel's eventfd (or self-pipe) when the list goes from empty to
+ * non-empty, so a burst of shares costs the loop a single wakeup and a
+ * single pass through the reader callback.
+ *
+ * Hashing threads only see a future's id.  The channel keeps the futures
+ * themselves, touched only with the GIL held, so closing the loop releases
+ * every future still waiting, and results that finish afterwards are
+ * dropped without going near Python.
+ */
+struct async_result {
+    uint64_t id;
+    char hash[32];
+};
+
+struct async_channel {
+    int read_fd;
+    int write_fd;
+    std::mutex lock;
+    bool closed;
+    uint64_t next_id;
+    std::vector<async_result> done;
+    std::unordered_map<uint64_t, PyObject *> waiting;
+
+    async_channel() : read_fd(-1), write_fd(-1), closed(false), next_id(0) {}
+    ~async_channel()
+    {
+        if (write_fd >= 0 && write_fd != read_fd)
+            close(write_fd);
+        if (read_fd >= 0)
+            close(read_fd);
+    }
+};
+
+typedef std::shared_ptr<async_channel> async_channel_ref;
+
+struct async_header {
+    char data[80];
+};
+
+/*
+ * Per-interpreter module state.  The native thread pool stays process-wide,
+ * shared by every interpreter that imports the module, so there is one set
+ * of hashing threads per host however many interpreters use it; only the
+ * Python objects it hands results back to live here.
+ */
+struct nudd_state {
+    /* Event loop -> capsule of its async_channel_ref */
+    PyObject *async_channels;
+};
+
+static nudd_state *nudd_get_state(PyObject *module)
+{
+    return (nudd_state *)PyModule_GetState(module);
+}
+
+/* Only free-threaded builds (3.13+) need these; elsewhere the GIL suffices */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op)	{
+#define Py_END_CRITICAL_SECTION()	}
+#endif
+
+static int async_channel_open(async_channel *channel)
+{
+#ifdef __linux__
+    channel->read_fd = channel->write_fd =
+        eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return channel->read_fd < 0 ? -1 : 0;
+#else
+    int fds[2];
+    if (pipe(fds))
+        return -1;
+    channel->read_fd = fds[0];
+    channel->write_fd = fds[1];
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return 0;
+#endif
+}
+
+/* Called from hashing threads, without the GIL */
+static void async_channel_complete(async_channel_ref const& channel,
+    uint64_t id, const char *hash)
+{
+    async_result result;
+    bool wake;
+
+    result.id = id;
+    memcpy(result.hash, hash, 32);
+    {
+        std::lock_guard<std::mutex> guard(channel->lock);
+        if (channel->closed)
+            return;
+        wake = channel->done.empty();
+        channel->done.push_back(result);
+    }
+    if (wake) {
+#ifdef __linux__
+        uint64_t one = 1;
+        ssize_t written = write(channel->write_fd, &one, sizeof(one));
+#else
+        char one = 1;
+        ssize_t written = write(channel->write_fd, &one, sizeof(one));
+#endif
+        (void)written; /* a full pipe already guarantees a wakeup */
+    }
+}
+
+/* Hands a future to the channel; returns the id its hash comes back under */
+static uint64_t async_channel_wait(async_channel_ref const& channel,
+    PyObject *future)
+{
+    std::lock_guard<std::mutex> guard(channel->lock);
+    uint64_t id = channel->next_id++;
+
+    Py_INCREF(future);
+    channel->waiting[id] = future;
+    return id;
+}
+
+/*
+ * Runs when a closed loop is pruned or the module state is cleared.  The
+ * capsule's context is its loop, whose reader is removed first.
+ */
+static void async_channel_destroy(PyObject *capsule)
+{
+    async_channel_ref *channel =
+        (async_channel_ref *)PyCapsule_GetPointer(capsule, "nudd_hash.channel");
+    PyObject *loop = (PyObject *)PyCapsule_GetContext(capsule);
+    PyObject *type, *value, *traceback, *removed;
+    std::unordered_map<uint64_t, PyObject *> waiting;
+
+    if (loop) {
+        PyErr_Fetch(&type, &value, &traceback);
+        removed = PyObject_CallMethod(loop, "remove_reader", "i",
+            (*channel)->read_fd);
+        Py_XDECREF(removed);
+        Py_DECREF(loop);
+        PyErr_Restore(type, value, traceback);
+    }
+
+    /* Hashing threads may still hold the channel; they will find it closed */
+    {
+        std::lock_guard<std::mutex> guard((*channel)->lock);
+        (*channel)->closed = true;
+        (*channel)->done.clear();
+        waiting.swap((*channel)->waiting);
+    }
+    for (std::unordered_map<uint64_t, PyObject *>::iterator i = waiting.begin();
+            i != waiting.end(); ++i)
+        Py_DECREF(i->second);
+    delete channel;
+}
+
+/* Reader callback, runs on the event loop thread */
+static PyObject *async_channel_drain(PyObject *capsule, PyObject *unused)
+{
+    async_channel_ref channel =
+        *(async_channel_ref *)PyCapsule_GetPointer(capsule, "nudd_hash.channel");
+    std::vector<async_result> done;
+    char buffer[64];
+
+    while (read(channel->read_fd, buffer, sizeof(buffer)) > 0)
+        ;
+    {
+        std::lock_guard<std::mutex> guard(channel->lock);
+        done.swap(channel->done);
+    }
+
+    for (size_t i = 0; i < done.size(); i++) {
+        PyObject *future = NULL;
+        {
+            std::lock_guard<std::mutex> guard(channel->lock);
+            std::unordered_map<uint64_t, PyObject *>::iterator found =
+                channel->waiting.find(done[i].id);
+            if (found != channel->waiting.end()) {
+                future = found->second;
+                channel->waiting.erase(found);
+            }
+        }
+        if (!future)
+            continue;
+        PyObject *cancelled = PyObject_CallMethod(future, "cancelled", NULL);
+        if (cancelled == Py_False) {
+            PyObject *result = PyObject_CallMethod(future, "set_result", "y#",
+                done[i].hash, (Py_ssize_t)32);
+            if (!result)
+                PyErr_WriteUnraisable(future);
+            Py_XDECREF(result);
+        } else if (!cancelled) {
+            PyErr_WriteUnraisable(future);
+        }
+        Py_XDECREF(cancelled);
+        Py_DECREF(future);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef async_channel_drain_def = {
+    "_drain", async_channel_drain, METH_NOARGS, NULL
+};
+
+/* Forget channels of loops that have been closed since the last lookup */
+static int async_channels_prune(PyObject *async_channels)
+{
+    PyObject *loop, *capsule, *closed;
+    PyObject *stale = PyList_New(0);
+    Py_ssize_t pos = 0;
+    int status = 0;
+
+    if (!stale)
+        return -1;
+    while (PyDict_Next(async_channels, &pos, &loop, &capsule)) {
+        closed = PyObject_CallMethod(loop, "is_closed", NULL);
+        if (!closed || (closed == Py_True && PyList_Append(stale, loop))) {
+            Py_XDECREF(closed);
+            status = -1;
+            break;
+        }
+        Py_DECREF(closed);
+    }
+    for (pos = 0; !status && pos < PyList_GET_SIZE(stale); pos++)
+        status = PyDict_DelItem(async_channels, PyList_GET_ITEM(stale, pos));
+    Py_DECREF(stale);
+    return status;
+}
+
+static async_channel_ref *async_channel_lookup(PyObject *async_channels,
+    PyObject *loop)
+{
+    PyObject *capsule, *drain, *registered;
+    async_channel_ref *channel;
+
+    /* A loop's capsule only leaves the dict once the loop is closed */
+    capsule = PyDict_GetItem(async_channels, loop);
+    if (capsule)
+        return (async_channel_ref *)PyCapsule_GetPointer(capsule, "nudd_hash.channel");
+    if (async_channels_prune(async_channels))
+        return NULL;
+
+    channel = new async_channel_ref(new async_channel());
+    if (async_channel_open(channel->get())) {
+        delete channel;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    capsule = PyCapsule_New(channel, "nudd_hash.channel", async_channel_destroy);
+    if (!capsule) {
+        delete channel;
+        return NULL;
+    }
+    drain = PyCFunction_New(&async_channel_drain_def, capsule);
+    registered = drain ? PyObject_CallMethod(loop, "add_reader", "iO",
+        (*channel)->read_fd, drain) : NULL;
+    Py_XDECREF(drain);
+    if (registered && !PyCapsule_SetContext(capsule, loop))
+        Py_INCREF(loop);
+    if (!registered || PyDict_SetItem(async_channels, loop, capsule)) {
+        Py_XDECREF(registered);
+        Py_DECREF(capsule);
+        return NULL;
+    }
+    Py_DECREF(registered);
+    Py_DECREF(capsule);
+    return channel;
+}
+
+/* Finds or creates the channel for loop; one thread at a time per module */
+static async_channel_ref *async_channel_for(PyObject *module, PyObject *loop)
+{
+    PyObject *async_channels = nudd_get_state(module)->async_channels;
+    async_channel_ref *channel;
+
+    Py_BEGIN_CRITICAL_SECTION(async_channels);
+    channel = async_channel_lookup(async_channels, loop);
+    Py_END_CRITICAL_SECTION();
+    return channel;
+}
+
+static PyObject *nudd_getpowhash_async(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "header", "background", NULL };
+    PyBytesObject *input;
+    PyObject *asyncio, *loop, *future;
+    async_channel_ref *channel;
+    async_header header;
+    int background = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "S|i", (char **)keywords,
+            &input, &background))
+        return NULL;
+    if (PyBytes_GET_SIZE(input) < 80) {
+        PyErr_SetString(PyExc_ValueError, "block header must be 80 bytes");
+        return NULL;
+    }
+    memcpy(header.data, PyBytes_AS_STRING(input), 80);
+
+    asyncio = PyImport_ImportModule("asyncio");
+    if (!asyncio)
+        return NULL;
+#if PY_VERSION_HEX >= 0x03070000
+    loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+#else
+    loop = PyObject_CallMethod(asyncio, "get_event_loop", NULL);
+#endif
+    Py_DECREF(asyncio);
+    if (!loop)
+        return NULL;
+    channel = async_channel_for(self, loop);
+    future = channel ? PyObject_CallMethod(loop, "create_future", NULL) : NULL;
+    Py_DECREF(loop);
+    if (!future)
+        return NULL;
+
+    async_channel_ref target = *channel;
+    uint64_t id = async_channel_wait(target, future);
+    hashing_pool().submit([target, id, header]() {
+        char hash[32];
+        nudd_hash(header.data, hash);
+        async_channel_complete(target, id, hash);
+    }, background ? pool_background : pool_foreground);
+    return future;
+}
+
+/* Miner: the native stratum client, driven from Python */
+typedef struct {
+    PyObject_HEAD
+    stratum_miner *miner;
+} MinerObject;
+
+static PyObject *miner_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "host", "port", "user", "password", "threads", NULL };
+    const char *host, *user, *password = "x";
+    int port;
+    unsigned int threads = 0;
+    MinerObject *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sis|sI", (char **)keywords,
+            &host, &port, &user, &password, &threads))
+        return NULL;
+    self = (MinerObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->miner = new stratum_miner(host, port, user, password, threads);
+    return (PyObject *)self;
+}
+
+static void miner_dealloc(MinerObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    Py_BEGIN_ALLOW_THREADS
+    delete self->miner;
+    Py_END_ALLOW_THREADS
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *miner_start(MinerObject *self, PyObject *unused)
+{
+    bool started;
+
+    Py_BEGIN_ALLOW_THREADS
+    started = self->miner->start();
+    Py_END_ALLOW_THREADS
+    if (!started) {
+        PyErr_SetString(PyExc_OSError, self->miner->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *miner_stop(MinerObject *self, PyObject *unused)
+{
+    Py_BEGIN_ALLOW_THREADS
+    self->miner->stop();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject *miner_stats(MinerObject *self, PyObject *unused)
+{
+    stratum_stats stats = self->miner->stats();
+
+    return Py_BuildValue("{sKsKsKsKsKsdsN}",
+        "hashes", (unsigned long long)stats.hashes,
+        "shares", (unsigned long long)stats.shares,
+        "accepted", (unsigned long long)stats.accepted,
+        "rejected", (unsigned long long)stats.rejected,
+        "jobs", (unsigned long long)stats.jobs,
+        "switch_latency_us", stats.switch_latency_us,
+        "connected", PyBool_FromLong(stats.connected));
+}
+
+static PyMethodDef miner_methods[] = {
+    { "start", (PyCFunction)miner_start, METH_NOARGS, "Connects to the pool and starts mining" },
+    { "stop", (PyCFunction)miner_stop, METH_NOARGS, "Disconnects and stops all mining threads" },
+    { "stats", (PyCFunction)miner_stats, METH_NOARGS, "Returns a dict of hash, share and job counters" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot miner_slots[] = {
+    { Py_tp_new, (void *)miner_new },
+    { Py_tp_dealloc, (void *)miner_dealloc },
+    { Py_tp_methods, (void *)miner_methods },
+    { Py_tp_doc, (void *)"Miner(host, port, user, password='x', threads=0)\n\n"
+        "Native stratum-style mining client." },
+    { 0, NULL }
+};
+
+static PyType_Spec miner_spec = {
+    "nudd_hash.Miner",
+    sizeof(MinerObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    miner_slots
+};
+
+/* ShareServer: batched pool-side share validation on a Unix socket */
+typedef struct {
+    PyObject_HEAD
+    share_server *server;
+} ShareServerObject;
+
+static PyObject *shareserver_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "path", "max_batch", "max_wait_ms", NULL };
+    const char *path;
+    Py_ssize_t max_batch = 64;
+    double max_wait_ms = 2.0;
+    ShareServerObject *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|nd", (char **)keywords,
+            &path, &max_batch, &max_wait_ms))
+        return NULL;
+    if (max_batch < 1 || !(max_wait_ms >= 0)) {
+        PyErr_SetString(PyExc_ValueError, "max_batch must be positive and max_wait_ms non-negative");
+        return NULL;
+    }
+    self = (ShareServerObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->server = new share_server(path, max_batch,
+        (unsigned int)(max_wait_ms * 1000));
+    return (PyObject *)self;
+}
+
+static void shareserver_dealloc(ShareServerObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    Py_BEGIN_ALLOW_THREADS
+    delete self->server;
+    Py_END_ALLOW_THREADS
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *shareserver_start(ShareServerObject *self, PyObject *unused)
+{
+    if (!self->server->start()) {
+        PyErr_SetString(PyExc_OSError, self->server->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *shareserver_stop(ShareServerObject *self, PyObject *unused)
+{
+    Py_BEGIN_ALLOW_THREADS
+    self->server->stop();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject *shareserver_set_worker_difficulty(ShareServerObject *self, PyObject *args)
+{
+    unsigned int worker;
+    double difficulty;
+
+    if (!PyArg_ParseTuple(args, "Id", &worker, &difficulty))
+        return NULL;
+    self->server->set_worker_difficulty(worker, difficulty);
+    Py_RETURN_NONE;
+}
+
+static PyObject *shareserver_enable_vardiff(ShareServerObject *self,
+    PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "shares_per_minute", "budget",
+        "min_difficulty", "max_difficulty", "retarget_seconds", NULL };
+    vardiff_config config;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ddddd", (char **)keywords,
+            &config.shares_per_minute, &config.budget, &config.min_difficulty,
+            &config.max_difficulty, &config.retarget_seconds))
+        return NULL;
+    if (!(config.shares_per_minute > 0) || !(config.budget >= 0) ||
+        !(config.min_difficulty > 0) ||
+        !(config.max_difficulty >= config.min_difficulty) ||
+        !(config.retarget_seconds > 0)) {
+        PyErr_SetString(PyExc_ValueError, "vardiff rates, difficulties and interval must be positive (budget 0 for none)");
+        return NULL;
+    }
+    if (!self->server->enable_vardiff(config)) {
+        PyErr_SetString(PyExc_RuntimeError, self->server->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *shareserver_difficulty_changes(ShareServerObject *self, PyObject *unused)
+{
+    std::vector<std::pair<uint32_t, double> > changes;
+    PyObject *list;
+
+    self->server->difficulty_changes(changes);
+    list = PyList_New(changes.size());
+    if (!list)
+        return NULL;
+    for (size_t i = 0; i < changes.size(); i++) {
+        PyObject *item = Py_BuildValue("(kd)", (unsigned long)changes[i].first,
+            changes[i].second);
+        if (!item) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+static PyObject *shareserver_worker_difficulty(ShareServerObject *self, PyObject *args)
+{
+    vardiff_controller const *controller = self->server->vardiff();
+    unsigned int worker;
+    double difficulty;
+
+    if (!PyArg_ParseTuple(args, "I", &worker))
+        return NULL;
+    if (!controller || !(difficulty = controller->difficulty(worker)))
+        Py_RETURN_NONE;
+    return PyFloat_FromDouble(difficulty);
+}
+
+static PyObject *shareserver_remove_worker(ShareServerObject *self, PyObject *args)
+{
+    unsigned int worker;
+
+    if (!PyArg_ParseTuple(args, "I", &worker))
+        return NULL;
+    self->server->remove_worker(worker);
+    Py_RETURN_NONE;
+}
+
+static PyObject *shareserver_stats(ShareServerObject *self, PyObject *unused)
+{
+    share_server_stats stats = self->server->stats();
+    vardiff_controller const *controller = self->server->vardiff();
+
+    return Py_BuildValue("{sKsKsKsKsKsKsKsKsKsdsd}",
+        "received", (unsigned long long)stats.received,
+        "accepted", (unsigned long long)stats.accepted,
+        "rejected", (unsigned long long)stats.rejected,
+        "duplicates", (unsigned long long)stats.duplicates,
+        "unknown_workers", (unsigned long long)stats.unknown_workers,
+        "batches", (unsigned long long)stats.batches,
+        "connections", (unsigned long long)stats.connections,
+        "retargets", (unsigned long long)stats.retargets,
+        "over_budget", (unsigned long long)stats.over_budget,
+        "target_share_rate", controller ? controller->target_rate() : 0.0,
+        "expected_share_rate", controller ? controller->expected_rate() : 0.0);
+}
+
+static PyMethodDef shareserver_methods[] = {
+    { "start", (PyCFunction)shareserver_start, METH_NOARGS, "Binds the socket and starts validating shares" },
+    { "stop", (PyCFunction)shareserver_stop, METH_NOARGS, "Closes all connections and removes the socket" },
+    { "set_worker_difficulty", (PyCFunction)shareserver_set_worker_difficulty, METH_VARARGS, "Sets the share difficulty for a worker id" },
+    { "remove_worker", (PyCFunction)shareserver_remove_worker, METH_VARARGS, "Forgets a worker id; its shares are then refused" },
+    { "enable_vardiff", (PyCFunction)(void (*)(void))shareserver_enable_vardiff, METH_VARARGS | METH_KEYWORDS, "Retargets worker difficulties from their share rates; only while stopped" },
+    { "difficulty_changes", (PyCFunction)shareserver_difficulty_changes, METH_NOARGS, "Returns and clears the [(worker, difficulty)] retargets to send on" },
+    { "worker_difficulty", (PyCFunction)shareserver_worker_difficulty, METH_VARARGS, "Returns a worker's vardiff difficulty, or None" },
+    { "stats", (PyCFunction)shareserver_stats, METH_NOARGS, "Returns a dict of share and batch counters" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot shareserver_slots[] = {
+    { Py_tp_new, (void *)shareserver_new },
+    { Py_tp_dealloc, (void *)shareserver_dealloc },
+    { Py_tp_methods, (void *)shareserver_methods },
+    { Py_tp_doc, (void *)"ShareServer(path, max_batch=64, max_wait_ms=2.0)\n\n"
+        "Validates shares sent to a Unix socket in batches; see shareserver.h\n"
+        "for the record format.  Verdict status is 0 accepted, 1 low difficulty,\n"
+        "2 duplicate, 3 unknown worker, 4 over budget.\n\n"
+        "enable_vardiff(shares_per_minute=20, budget=0, min_difficulty=2**-16,\n"
+        "max_difficulty=2**32, retarget_seconds=30) steers each worker to\n"
+        "shares_per_minute, and with a budget (shares per second across all\n"
+        "workers) lowers that as every known worker joins, and answers shares\n"
+        "beyond it (bursts of up to a second's worth) over budget unhashed." },
+    { 0, NULL }
+};
+
+static PyType_Spec shareserver_spec = {
+    "nudd_hash.ShareServer",
+    sizeof(ShareServerObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    shareserver_slots
+};
+
+/*
+ * Job template from set_job(job_id, prevhash, coinb1, coinb2, merkle_branch,
+ * version, nbits, ntime, extranonce1=b'', extranonce2_size=4, difficulty=1.0)
+ */
+static scan_job *nudd_job_from_args(PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "job_id", "prevhash", "coinb1", "coinb2",
+        "merkle_branch", "version", "nbits", "ntime", "extranonce1",
+        "extranonce2_size", "difficulty", NULL };
+    std::unique_ptr<scan_job> job(new scan_job());
+    const char *id, *prevhash, *coinb1, *coinb2, *extranonce1 = "";
+    Py_ssize_t prevhash_size, coinb1_size, coinb2_size, extranonce1_size = 0;
+    PyObject *branch, *items;
+    unsigned int extranonce2_size = 4;
+    double difficulty = 1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sy#y#y#OIII|y#Id", (char **)keywords,
+            &id, &prevhash, &prevhash_size, &coinb1, &coinb1_size, &coinb2,
+            &coinb2_size, &branch, &job->version, &job->nbits, &job->ntime,
+            &extranonce1, &extranonce1_size, &extranonce2_size, &difficulty))
+        return NULL;
+    if (prevhash_size != 32) {
+        PyErr_SetString(PyExc_ValueError, "prevhash must be 32 bytes");
+        return NULL;
+    }
+    items = nudd_sequence_snapshot(branch, "merkle_branch must be a sequence");
+    if (!items)
+        return NULL;
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(items); i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(items, i);
+        if (!PyBytes_Check(item) || PyBytes_GET_SIZE(item) != 32) {
+            Py_DECREF(items);
+            PyErr_SetString(PyExc_ValueError, "merkle branch hashes must be 32 bytes");
+            return NULL;
+        }
+        job->merkle_branch.push_back(std::string(PyBytes_AS_STRING(item), 32));
+    }
+    Py_DECREF(items);
+
+    job->id = id;
+    memcpy(job->prevhash, prevhash, 32);
+    job->coinb1.assign(coinb1, coinb1_size);
+    job->coinb2.assign(coinb2, coinb2_size);
+    job->extranonce1.assign(extranonce1, extranonce1_size);
+    job->extranonce2_size = extranonce2_size;
+    stratum_target_from_difficulty(difficulty, job->target);
+    return job.release();
+}
+
+/* LeaseCoordinator / LeaseWorker: one job's search space across processes */
+typedef struct {
+    PyObject_HEAD
+    lease_coordinator *coordinator;
+} LeaseCoordinatorObject;
+
+static PyObject *coordinator_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "address", "lease_size", "timeout_ms", NULL };
+    const char *address;
+    unsigned long long lease_size = 1 << 16;
+    unsigned int timeout_ms = 2000;
+    LeaseCoordinatorObject *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|KI", (char **)keywords,
+            &address, &lease_size, &timeout_ms))
+        return NULL;
+    self = (LeaseCoordinatorObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->coordinator = new lease_coordinator(address, lease_size, timeout_ms);
+    return (PyObject *)self;
+}
+
+static void coordinator_dealloc(LeaseCoordinatorObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    Py_BEGIN_ALLOW_THREADS
+    delete self->coordinator;
+    Py_END_ALLOW_THREADS
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *coordinator_start(LeaseCoordinatorObject *self, PyObject *unused)
+{
+    if (!self->coordinator->start()) {
+        PyErr_SetString(PyExc_OSError, self->coordinator->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *coordinator_stop(LeaseCoordinatorObject *self, PyObject *unused)
+{
+    Py_BEGIN_ALLOW_THREADS
+    self->coordinator->stop();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject *coordinator_set_job(LeaseCoordinatorObject *self, PyObject *args, PyObject *kwds)
+{
+    std::shared_ptr<scan_job const> job(nudd_job_from_args(args, kwds));
+
+    if (!job)
+        return NULL;
+    self->coordinator->set_job(job);
+    Py_RETURN_NONE;
+}
+
+static PyObject *coordinator_shares(LeaseCoordinatorObject *self, PyObject *unused)
+{
+    PyObject *list = PyList_New(0);
+    lease_share share;
+
+    while (list && self->coordinator->next_share(share)) {
+        PyObject *item = Py_BuildValue("(ssKIIy#)", share.worker.c_str(),
+            share.job_id.c_str(), (unsigned long long)share.extranonce2,
+            share.ntime, share.nonce, share.hash, (Py_ssize_t)NUDD_HASH_SIZE);
+        if (!item || PyList_Append(list, item)) {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return list;
+}
+
+static PyObject *coordinator_stats(LeaseCoordinatorObject *self, PyObject *unused)
+{
+    lease_stats stats = self->coordinator->stats();
+
+    return Py_BuildValue("{sKsKsKsKsKsd}",
+        "workers", (unsigned long long)stats.workers,
+        "leases", (unsigned long long)stats.leases,
+        "released", (unsigned long long)stats.released,
+        "hashes", (unsigned long long)stats.hashes,
+        "shares", (unsigned long long)stats.shares,
+        "hashrate", stats.hashrate);
+}
+
+static PyMethodDef coordinator_methods[] = {
+    { "start", (PyCFunction)coordinator_start, METH_NOARGS, "Starts listening for workers" },
+    { "stop", (PyCFunction)coordinator_stop, METH_NOARGS, "Disconnects all workers" },
+    { "set_job", (PyCFunction)(void (*)(void))coordinator_set_job, METH_VARARGS | METH_KEYWORDS,
+        "set_job(job_id, prevhash, coinb1, coinb2, merkle_branch, version, nbits, ntime,\n"
+        "        extranonce1=b'', extranonce2_size=4, difficulty=1.0)\n\n"
+        "Replaces the job and restarts leasing from the first position" },
+    { "shares", (PyCFunction)coordinator_shares, METH_NOARGS,
+        "Returns and forgets the reported shares as (worker, job_id, extranonce2, ntime, nonce, hash)" },
+    { "stats", (PyCFunction)coordinator_stats, METH_NOARGS, "Returns a dict of lease counters and the aggregate hashrate" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot coordinator_slots[] = {
+    { Py_tp_new, (void *)coordinator_new },
+    { Py_tp_dealloc, (void *)coordinator_dealloc },
+    { Py_tp_methods, (void *)coordinator_methods },
+    { Py_tp_doc, (void *)"LeaseCoordinator(address, lease_size=65536, timeout_ms=2000)\n\n"
+        "Leases disjoint nonce ranges of one job to LeaseWorker processes.\n"
+        "address is host:port or a Unix socket path." },
+    { 0, NULL }
+};
+
+static PyType_Spec coordinator_spec = {
+    "nudd_hash.LeaseCoordinator",
+    sizeof(LeaseCoordinatorObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    coordinator_slots
+};
+
+typedef struct {
+    PyObject_HEAD
+    lease_worker *worker;
+} LeaseWorkerObject;
+
+static PyObject *leaseworker_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "address", "threads", "name", NULL };
+    const char *address, *name = "";
+    unsigned int threads = 0;
+    LeaseWorkerObject *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|Is", (char **)keywords,
+            &address, &threads, &name))
+        return NULL;
+    self = (LeaseWorkerObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->worker = new lease_worker(address, threads, name);
+    return (PyObject *)self;
+}
+
+static void leaseworker_dealloc(LeaseWorkerObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    Py_BEGIN_ALLOW_THREADS
+    delete self->worker;
+    Py_END_ALLOW_THREADS
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *leaseworker_start(LeaseWorkerObject *self, PyObject *unused)
+{
+    bool started;
+
+    Py_BEGIN_ALLOW_THREADS
+    started = self->worker->start();
+    Py_END_ALLOW_THREADS
+    if (!started) {
+        PyErr_SetString(PyExc_OSError, self->worker->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *leaseworker_stop(LeaseWorkerObject *self, PyObject *unused)
+{
+    Py_BEGIN_ALLOW_THREADS
+    self->worker->stop();
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject *leaseworker_stats(LeaseWorkerObject *self, PyObject *unused)
+{
+    lease_worker_stats stats = self->worker->stats();
+
+    return Py_BuildValue("{sKsKsKsN}",
+        "hashes", (unsigned long long)stats.hashes,
+        "shares", (unsigned long long)stats.shares,
+        "leases", (unsigned long long)stats.leases,
+        "connected", PyBool_FromLong(stats.connected));
+}
+
+static PyMethodDef leaseworker_methods[] = {
+    { "start", (PyCFunction)leaseworker_start, METH_NOARGS, "Connects to the coordinator and starts scanning" },
+    { "stop", (PyCFunction)leaseworker_stop, METH_NOARGS, "Disconnects and stops all scanner threads" },
+    { "stats", (PyCFunction)leaseworker_stats, METH_NOARGS, "Returns a dict of hash, share and lease counters" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot leaseworker_slots[] = {
+    { Py_tp_new, (void *)leaseworker_new },
+    { Py_tp_dealloc, (void *)leaseworker_dealloc },
+    { Py_tp_methods, (void *)leaseworker_methods },
+    { Py_tp_doc, (void *)"LeaseWorker(address, threads=0, name='')\n\n"
+        "Scans the nonce ranges a LeaseCoordinator leases to it." },
+    { 0, NULL }
+};
+
+static PyType_Spec leaseworker_spec = {
+    "nudd_hash.LeaseWorker",
+    sizeof(LeaseWorkerObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    leaseworker_slots
+};
+
+/* Scanner: the native nonce scanner, with found shares drained from Python */
+typedef struct {
+    PyObject_HEAD
+    nonce_scanner *scanner;
+} ScannerObject;
+
+static PyObject *scanner_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "threads", "capacity", NULL };
+    unsigned int threads = 0;
+    Py_ssize_t capacity = 4096;
+    ScannerObject *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|In", (char **)keywords,
+            &threads, &capacity))
+        return NULL;
+    if (capacity < 1) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be positive");
+        return NULL;
+    }
+    self = (ScannerObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->scanner = new nonce_scanner(threads, capacity);
+    return (PyObject *)self;
+}
+
+static void scanner_dealloc(ScannerObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    Py_BEGIN_ALLOW_THREADS
+    delete self->scanner;
+    Py_END_ALLOW_THREADS
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *scanner_set_job(ScannerObject *self, PyObject *args, PyObject *kwds)
+{
+    std::shared_ptr<scan_job const> job(nudd_job_from_args(args, kwds));
+
+    if (!job)
+        return NULL;
+    self->scanner->set_job(job);
+    Py_RETURN_NONE;
+}
+
+static PyObject *scanner_clear(ScannerObject *self, PyObject *unused)
+{
+    self->scanner->set_job(std::shared_ptr<scan_job const>());
+    Py_RETURN_NONE;
+}
+
+static PyObject *scanner_share_tuple(scan_share const& share)
+{
+    return Py_BuildValue("(sKIIy#)", share.job_id.c_str(),
+        (unsigned long long)share.extranonce2, share.ntime, share.nonce,
+        share.hash, (Py_ssize_t)NUDD_HASH_SIZE);
+}
+
+static PyObject *scanner_wait(ScannerObject *self, PyObject *args)
+{
+    double timeout = 0;
+    scan_share share;
+    bool found;
+
+    if (!PyArg_ParseTuple(args, "|d", &timeout))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    found = self->scanner->next_share(share, (int)(timeout * 1000));
+    Py_END_ALLOW_THREADS
+    if (!found)
+        Py_RETURN_NONE;
+    return scanner_share_tuple(share);
+}
+
+static PyObject *scanner_iternext(ScannerObject *self)
+{
+    scan_share share;
+
+    if (!self->scanner->try_share(share))
+        return NULL;
+    return scanner_share_tuple(share);
+}
+
+static PyObject *scanner_fileno(ScannerObject *self, PyObject *unused)
+{
+    return PyLong_FromLong(self->scanner->notify_fd());
+}
+
+static PyObject *scanner_stats(ScannerObject *self, PyObject *unused)
+{
+    return Py_BuildValue("{sKsKsKsd}",
+        "hashes", (unsigned long long)self->scanner->hashes(),
+        "shares", (unsigned long long)self->scanner->shares(),
+        "dropped", (unsigned long long)self->scanner->dropped(),
+        "switch_latency_us", self->scanner->switch_latency_us());
+}
+
+static PyMethodDef scanner_methods[] = {
+    { "set_job", (PyCFunction)(void (*)(void))scanner_set_job, METH_VARARGS | METH_KEYWORDS,
+        "set_job(job_id, prevhash, coinb1, coinb2, merkle_branch, version, nbits, ntime,\n"
+        "        extranonce1=b'', extranonce2_size=4, difficulty=1.0)\n\n"
+        "Switches every scanner thread to the job" },
+    { "clear", (PyCFunction)scanner_clear, METH_NOARGS, "Abandons the current job and leaves the threads idle" },
+    { "wait", (PyCFunction)scanner_wait, METH_VARARGS,
+        "wait(timeout=0) -> share or None\n\nBlocks up to timeout seconds for the next share" },
+    { "fileno", (PyCFunction)scanner_fileno, METH_NOARGS,
+        "Descriptor that turns readable when a share arrives after iteration ran dry" },
+    { "stats", (PyCFunction)scanner_stats, METH_NOARGS, "Returns a dict of hash, share and dropped-share counters" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot scanner_slots[] = {
+    { Py_tp_new, (void *)scanner_new },
+    { Py_tp_dealloc, (void *)scanner_dealloc },
+    { Py_tp_methods, (void *)scanner_methods },
+    { Py_tp_iter, (void *)PyObject_SelfIter },
+    { Py_tp_iternext, (void *)scanner_iternext },
+    { Py_tp_doc, (void *)"Scanner(threads=0, capacity=4096)\n\n"
+        "Native nonce scanner.  Iterating yields the shares found so far as\n"
+        "(job_id, extranonce2, ntime, nonce, hash) and stops when none are\n"
+        "queued; fileno() can then be watched for more.  Shares found while\n"
+        "capacity are already queued are dropped and counted." },
+    { 0, NULL }
+};
+
+static PyType_Spec scanner_spec = {
+    "nudd_hash.Scanner",
+    sizeof(ScannerObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    scanner_slots
+};
+
+/* CredentialStore: credential_store, taking and returning "$2a$NN$..." strings */
+typedef struct {
+    PyObject_HEAD
+    credential_store *store;
+} CredentialStoreObject;
+
+static PyObject *credstore_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "path", "writable", NULL };
+    const char *path;
+    int writable = 0;
+    CredentialStoreObject *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|p", (char **)keywords,
+            &path, &writable))
+        return NULL;
+    self = (CredentialStoreObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->store = new credential_store();
+    if (!self->store->open(path, writable)) {
+        PyErr_SetString(PyExc_OSError, self->store->error().c_str());
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+static void credstore_dealloc(CredentialStoreObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    delete self->store;
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *credstore_get(CredentialStoreObject *self, PyObject *args)
+{
+    unsigned long long user;
+    credential_record record;
+    char hash[BCRYPT_HASH_LENGTH + 1];
+
+    if (!PyArg_ParseTuple(args, "K", &user))
+        return NULL;
+    if (!self->store->get(user, record))
+        Py_RETURN_NONE;
+    bcrypt_format(record, hash);
+    return PyUnicode_FromString(hash);
+}
+
+static PyObject *credstore_put(CredentialStoreObject *self, PyObject *args)
+{
+    unsigned long long user;
+    const char *hash;
+    Py_ssize_t length;
+    size_t size;
+    credential_record record;
+
+    if (!PyArg_ParseTuple(args, "Ks#", &user, &hash, &length))
+        return NULL;
+    size = length;
+    if (!bcrypt_parse_batch(&hash, &size, 1, &record)) {
+        PyErr_SetString(PyExc_ValueError, "not a bcrypt hash");
+        return NULL;
+    }
+    if (!self->store->put(user, record)) {
+        PyErr_SetString(PyExc_OSError, self->store->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *credstore_remove(CredentialStoreObject *self, PyObject *args)
+{
+    unsigned long long user;
+
+    if (!PyArg_ParseTuple(args, "K", &user))
+        return NULL;
+    if (!self->store->remove(user)) {
+        PyErr_SetString(PyExc_OSError, self->store->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *credstore_verify(CredentialStoreObject *self, PyObject *args)
+{
+    unsigned long long user;
+    const char *password;
+    Py_ssize_t length;
+    int result;
+
+    if (!PyArg_ParseTuple(args, "Ks#", &user, &password, &length))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    result = self->store->verify(user, password, length);
+    Py_END_ALLOW_THREADS
+    if (result < 0)
+        Py_RETURN_NONE;
+    return PyBool_FromLong(result);
+}
+
+static PyObject *credstore_sync(CredentialStoreObject *self, PyObject *unused)
+{
+    bool synced;
+
+    Py_BEGIN_ALLOW_THREADS
+    synced = self->store->sync();
+    Py_END_ALLOW_THREADS
+    if (!synced) {
+        PyErr_SetString(PyExc_OSError, self->store->error().c_str());
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *credstore_capacity(CredentialStoreObject *self, PyObject *unused)
+{
+    return PyLong_FromUnsignedLongLong(self->store->capacity());
+}
+
+static PyMethodDef credstore_methods[] = {
+    { "get", (PyCFunction)credstore_get, METH_VARARGS, "get(user) -> str or None\n\nThe stored hash, formatted back into a string" },
+    { "put", (PyCFunction)credstore_put, METH_VARARGS, "put(user, hash)\n\nStores a bcrypt hash string as a binary record" },
+    { "remove", (PyCFunction)credstore_remove, METH_VARARGS, "remove(user)\n\nEmpties user's record" },
+    { "verify", (PyCFunction)credstore_verify, METH_VARARGS,
+        "verify(user, password) -> bool or None\n\n"
+        "Checks password against user's record without building or parsing a hash string;\n"
+        "None if user has no record" },
+    { "sync", (PyCFunction)credstore_sync, METH_NOARGS, "Flushes the records to disk" },
+    { "capacity", (PyCFunction)credstore_capacity, METH_NOARGS, "One past the highest user id the file has room for" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot credstore_slots[] = {
+    { Py_tp_new, (void *)credstore_new },
+    { Py_tp_dealloc, (void *)credstore_dealloc },
+    { Py_tp_methods, (void *)credstore_methods },
+    { Py_tp_doc, (void *)"CredentialStore(path, writable=False)\n\n"
+        "Memory-mapped file of 41-byte bcrypt records indexed by integer user id." },
+    { 0, NULL }
+};
+
+static PyType_Spec credstore_spec = {
+    "nudd_hash.CredentialStore",
+    sizeof(CredentialStoreObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    credstore_slots
+};
+
+/* HeaderFilter: header_filter, and the filtered form of checkPoWBatch() */
+typedef struct {
+    PyObject_HEAD
+    header_filter *filter;
+} HeaderFilterObject;
+
+static int headerfilter_add_prev_hashes(header_filter *filter, PyObject *hashes)
+{
+    PyObject *items = nudd_sequence_snapshot(hashes, "prev_hashes must be a sequence of bytes");
+    Py_ssize_t i;
+
+    if (!items)
+        return -1;
+    for (i = 0; i < PySequence_Fast_GET_SIZE(items); i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(items, i);
+        if (!PyBytes_Check(item) || PyBytes_GET_SIZE(item) != 32) {
+            Py_DECREF(items);
+            PyErr_SetString(PyExc_ValueError, "previous block hashes must be 32 bytes");
+            return -1;
+        }
+        filter->add_prev_hash((const unsigned char *)PyBytes_AS_STRING(item));
+    }
+    Py_DECREF(items);
+    return 0;
+}
+
+/* Enables one check from its keyword argument; -1 with an exception if it is malformed */
+static int headerfilter_require(header_filter *filter, const char *name, PyObject *value)
+{
+    unsigned int low, high;
+
+    if (!strcmp(name, "versions") || !strcmp(name, "time_window")) {
+        if (!PyArg_ParseTuple(value, "II", &low, &high))
+            return -1;
+        if (name[0] == 'v')
+            filter->require_version(low, high);
+        else
+            filter->require_time(low, high);
+    } else if (!strcmp(name, "max_nbits")) {
+        unsigned long limit = PyLong_AsUnsignedLong(value);
+        if (PyErr_Occurred())
+            return -1;
+        filter->require_nbits((uint32_t)limit);
+    } else if (!strcmp(name, "prev_hashes")) {
+        if (headerfilter_add_prev_hashes(filter, value))
+            return -1;
+        filter->require_prev_hash();
+    } else {
+        PyErr_Format(PyExc_TypeError, "unexpected keyword argument '%s'", name);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *headerfilter_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    HeaderFilterObject *self;
+    PyObject *key, *value;
+    Py_ssize_t position = 0;
+
+    if (PyTuple_GET_SIZE(args)) {
+        PyErr_SetString(PyExc_TypeError, "HeaderFilter() takes keyword arguments only");
+        return NULL;
+    }
+    self = (HeaderFilterObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->filter = new header_filter();
+
+    /* Keyword arguments keep their order, and so do the checks */
+    while (kwds && PyDict_Next(kwds, &position, &key, &value)) {
+        const char *name = PyUnicode_AsUTF8(key);
+        if (!name || headerfilter_require(self->filter, name, value)) {
+            Py_DECREF(self);
+            return NULL;
+        }
+    }
+    return (PyObject *)self;
+}
+
+static void headerfilter_dealloc(HeaderFilterObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+
+    delete self->filter;
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static PyObject *headerfilter_set_time_window(HeaderFilterObject *self, PyObject *args)
+{
+    unsigned int earliest, latest;
+
+    if (!PyArg_ParseTuple(args, "II", &earliest, &latest))
+        return NULL;
+    self->filter->set_time_window(earliest, latest);
+    Py_RETURN_NONE;
+}
+
+static PyObject *headerfilter_add_prev_hash(HeaderFilterObject *self, PyObject *args)
+{
+    const char *hash;
+    Py_ssize_t size;
+
+    if (!PyArg_ParseTuple(args, "y#", &hash, &size))
+        return NULL;
+    if (size != 32) {
+        PyErr_SetString(PyExc_ValueError, "previous block hashes must be 32 bytes");
+        return NULL;
+    }
+    self->filter->add_prev_hash((const unsigned char *)hash);
+    Py_RETURN_NONE;
+}
+
+static PyObject *headerfilter_clear_prev_hashes(HeaderFilterObject *self, PyObject *unused)
+{
+    self->filter->clear_prev_hashes();
+    Py_RETURN_NONE;
+}
+
+static PyObject *headerfilter_check_pow_batch(HeaderFilterObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *keywords[] = { "headers", "background", NULL };
+    PyObject *sequence, *bitmap;
+    std::string headers;
+    Py_ssize_t count;
+    int background = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", (char **)keywords,
+            &sequence, &background))
+        return NULL;
+    if ((count = nudd_collect_headers(sequence, headers)) < 0)
+        return NULL;
+
+    bitmap = PyBytes_FromStringAndSize(NULL, (count + 7) / 8);
+    if (!bitmap)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    nudd_check_pow_batch(headers.data(), count,
+        (unsigned char *)PyBytes_AS_STRING(bitmap), hashing_pool(),
+        background ? pool_background : pool_foreground, self->filter);
+    Py_END_ALLOW_THREADS
+    return bitmap;
+}
+
+static PyObject *headerfilter_stats(HeaderFilterObject *self, PyObject *unused)
+{
+    PyObject *stats = PyDict_New();
+    int i;
+
+    if (!stats)
+        return NULL;
+    /* One entry per check, then "admitted" */
+    for (i = 0; i <= header_filter::check_count; i++) {
+        header_filter::check which = (header_filter::check)i;
+        PyObject *value = PyLong_FromUnsignedLongLong(i < header_filter::check_count ?
+            self->filter->rejected(which) : self->filter->admitted());
+        if (!value || PyDict_SetItemString(stats, i < header_filter::check_count ?
+                header_filter::name(which) : "admitted", value)) {
+            Py_XDECREF(value);
+            Py_DECREF(stats);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    return stats;
+}
+
+static PyMethodDef headerfilter_methods[] = {
+    { "set_time_window", (PyCFunction)headerfilter_set_time_window, METH_VARARGS,
+        "set_time_window(earliest, latest)\n\nMoves the accepted range of header timestamps" },
+    { "add_prev_hash", (PyCFunction)headerfilter_add_prev_hash, METH_VARARGS,
+        "add_prev_hash(hash)\n\nAccepts headers building on this 32-byte block hash, as it appears in a header" },
+    { "clear_prev_hashes", (PyCFunction)headerfilter_clear_prev_hashes, METH_NOARGS,
+        "Forgets every previous block hash" },
+    { "check_pow_batch", (PyCFunction)(void (*)(void))headerfilter_check_pow_batch, METH_VARARGS | METH_KEYWORDS,
+        "check_pow_batch(headers, background=True)\n\n"
+        "checkPoWBatch() that reports headers failing a check as invalid without hashing them" },
+    { "stats", (PyCFunction)headerfilter_stats, METH_NOARGS,
+        "Returns a dict of headers rejected by each check, and of those admitted to hashing" },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyType_Slot headerfilter_slots[] = {
+    { Py_tp_new, (void *)headerfilter_new },
+    { Py_tp_dealloc, (void *)headerfilter_dealloc },
+    { Py_tp_methods, (void *)headerfilter_methods },
+    { Py_tp_doc, (void *)"HeaderFilter(*, versions=None, max_nbits=None, time_window=None, prev_hashes=None)\n\n"
+        "Cheap checks run on block headers before they are hashed, in the order given:\n"
+        "versions and time_window are inclusive (low, high) pairs, max_nbits the compact\n"
+        "form of the easiest target allowed, prev_hashes the block hashes headers may build on." },
+    { 0, NULL }
+};
+
+static PyType_Spec headerfilter_spec = {
+    "nudd_hash.HeaderFilter",
+    sizeof(HeaderFilterObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    headerfilter_slots
+};
+#endif
+
+static PyMethodDef NuddMethods[] = {
+    { "getPoWHash", nudd_getpowhash, METH_VARARGS, "Returns the proof of work hash using nudd hash" },
+    { "getPoWHashLowLatency", (PyCFunction)(void (*)(void))nudd_getpowhash_low_latency, METH_VARARGS | METH_KEYWORDS,
+        "getPoWHashLowLatency(header, threaded=False)\n\n"
+        "getPoWHash() with both halves of the header hashed at once: interleaved in this\n"
+        "thread, or with one half on the native thread pool" },
+    { "bcryptIterated", (PyCFunction)(void (*)(void))nudd_bcrypt_iterated, METH_VARARGS | METH_KEYWORDS,
+        "bcryptIterated(data, parallel=False) -> bytes\n\n"
+        "The 23-byte iterated bcrypt reduction of data of any length; with parallel the\n"
+        "blocks of each round are hashed on the native thread pool" },
+    { "bcryptHash", nudd_bcrypt_hash, METH_VARARGS,
+        "bcryptHash(password, setting) -> str\n\n"
+        "crypt(3)-style bcrypt of password under a \"$2a$\", \"$2x$\" or \"$2y$\" setting;\n"
+        "passing a stored hash as the setting verifies it" },
+    { "parseBcrypt", nudd_parse_bcrypt, METH_VARARGS,
+        "parseBcrypt(hashes) -> list\n\n"
+        "Splits stored bcrypt hashes into (subtype, cost, salt, hash) tuples, with the\n"
+        "16-byte salt and 23-byte hash decoded; None for any bcryptHash() would reject" },
+    { "formatBcrypt", nudd_format_bcrypt, METH_VARARGS,
+        "formatBcrypt(subtype, cost, salt, hash) -> str\n\n"
+        "The inverse of parseBcrypt() for a single hash" },
+    { "scrypt", (PyCFunction)(void (*)(void))nudd_scrypt, METH_VARARGS | METH_KEYWORDS,
+        "scrypt(password, salt, n, r, p, dklen=64, tmto=1, interleave=1, parallel=True) -> bytes\n\n"
+        "RFC 7914 scrypt; with p > 1 and parallel the lanes run on the native thread pool.\n"
+        "tmto keeps every tmto-th V block and recomputes the rest, interleave steps that\n"
+        "many lanes together on one thread; neither changes the result" },
+    { "scryptBatch", (PyCFunction)(void (*)(void))nudd_scrypt_batch, METH_VARARGS | METH_KEYWORDS,
+        "scryptBatch(inputs, n=1024, r=1, dklen=32, tmto=1, interleave=1, parallel=True) -> list\n\n"
+        "scrypt(x, x, n, r, 1, dklen) of each of the equal-length bytes inputs, the\n"
+        "proof-of-work shape; interleave steps that many different inputs through ROMix\n"
+        "together, and with parallel the groups run on the native thread pool" },
+    { "checkPoW", nudd_checkpow, METH_VARARGS, "Returns (valid, hash) for a block header checked against its own compact target" },
+    { "checkPoWBatch", (PyCFunction)(void (*)(void))nudd_checkpow_batch, METH_VARARGS | METH_KEYWORDS,
+        "checkPoWBatch(headers, background=True)\n\n"
+        "Checks a sequence of block headers, returning a bitmap with bit i set if header i is valid.\n"
+        "Background batches yield the hashing pool to foreground work between headers" },
+    { "powAlgorithms", nudd_pow_algorithms, METH_NOARGS,
+        "powAlgorithms() -> dict\n\n"
+        "Maps the name of every proof of work algorithm to the kernel it runs on this host" },
+    { "powHash", nudd_pow_hash, METH_VARARGS,
+        "powHash(algorithm, header) -> bytes\n\n"
+        "The named algorithm's 32-byte hash of an 80-byte block header" },
+    { "powHashBatch", (PyCFunction)(void (*)(void))nudd_pow_hash_batch, METH_VARARGS | METH_KEYWORDS,
+        "powHashBatch(algorithm, headers, background=False) -> list\n\n"
+        "powHash() of every header in a sequence, spread over the native thread pool" },
+    { "powScan", (PyCFunction)(void (*)(void))nudd_pow_scan, METH_VARARGS | METH_KEYWORDS,
+        "powScan(algorithm, header, target, first, count, background=False) -> list\n\n"
+        "Tries nonces first to first + count - 1 in header on the native thread pool and\n"
+        "returns (nonce, hash) for each hash at or below the 32-byte little-endian target" },
+    { "powSelfTest", nudd_pow_self_test, METH_VARARGS,
+        "powSelfTest(algorithm) -> bool\n\n"
+        "Checks the algorithm against a known answer and its batch and scan paths against it" },
+    { "configurePool", (PyCFunction)(void (*)(void))nudd_configure_pool, METH_VARARGS | METH_KEYWORDS,
+        "configurePool(cpu_budget=0.0, latency_target_us=0.0)\n\n"
+        "Caps background hashing at cpu_budget cores (0: no cap) and backs it off whenever\n"
+        "foreground work waits longer than latency_target_us (0: never)" },
+    { "poolStats", nudd_pool_stats, METH_NOARGS, "Returns queue depths, background limits and foreground wait percentiles" },
+    { "tune", (PyCFunction)(void (*)(void))nudd_tune_host, METH_VARARGS | METH_KEYWORDS,
+        "tune(seconds=5.0, save=True) -> dict\n\n"
+        "Measures thread counts, SMT placement, bcrypt engines and serial against\n"
+        "interleaved halves (lanes 1 or 2) on this host and returns the fastest.  With save, it is written to the host profile, which\n"
+        "processes started afterwards load" },
+    { "hostProfile", nudd_host_profile_info, METH_NOARGS, "Returns the profile this process loaded at startup" },
+    { "benchmark", (PyCFunction)(void (*)(void))nudd_benchmark, METH_VARARGS | METH_KEYWORDS,
+        "benchmark(kernel, count=100, counters=True, n=1024, r=1, tmto=1, interleave=1) -> dict\n\n"
+        "Runs a hashing kernel (\"nudd\", \"nudd_interleaved\", \"bcrypt\" or \"scrypt\") count times\n"
+        "on this thread and returns hashes and seconds.  With counters, hardware counts for\n"
+        "the run are added where perf_event_open allows, and counter_error says why not" },
+#if PY_MAJOR_VERSION >= 3
+    { "getPoWHashAsync", (PyCFunction)(void (*)(void))nudd_getpowhash_async, METH_VARARGS | METH_KEYWORDS,
+        "getPoWHashAsync(header, background=False)\n\n"
+        "Returns an asyncio future for the proof of work hash, computed on the native thread pool" },
+#endif
+    { NULL, NULL, 0, NULL }
+};
+
+#if PY_MAJOR_VERSION >= 3
+static int nudd_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    nudd_state *state = nudd_get_state(module);
+
+    Py_VISIT(state->async_channels);
+    return 0;
+}
+
+static int nudd_clear(PyObject *module)
+{
+    nudd_state *state = nudd_get_state(module);
+
+    Py_CLEAR(state->async_channels);
+    return 0;
+}
+
+static void nudd_free(void *module)
+{
+    nudd_clear((PyObject *)module);
+}
+
+static int nudd_add_type(PyObject *module, const char *name, PyType_Spec *spec)
+{
+    PyObject *type = PyType_FromSpec(spec);
+
+    if (!type || PyModule_AddObject(module, name, type)) {
+        Py_XDECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+static int nudd_exec(PyObject *module)
+{
+    nudd_state *state = nudd_get_state(module);
+
+    nudd_host_profile();
+    state->async_channels = PyDict_New();
+    if (!state->async_channels ||
+        nudd_add_type(module, "Miner", &miner_spec) ||
+        nudd_add_type(module, "ShareServer", &shareserver_spec) ||
+        nudd_add_type(module, "LeaseCoordinator", &coordinator_spec) ||
+        nudd_add_type(module, "LeaseWorker", &leaseworker_spec) ||
+        nudd_add_type(module, "Scanner", &scanner_spec) ||
+        nudd_add_type(module, "CredentialStore", &credstore_spec) ||
+        nudd_add_type(module, "HeaderFilter", &headerfilter_spec))
+        return -1;
+    return 0;
+}
+
+/*
+ * Everything the module keeps is per interpreter or native and locked, so
+ * it can be imported into isolated subinterpreters and, on a free-threaded
+ * build, run without the GIL.
+ */
+static PyModuleDef_Slot nudd_slots[] = {
+    { Py_mod_exec, (void *)nudd_exec },
+#ifdef Py_mod_multiple_interpreters
+    { Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },
+#endif
+#ifdef Py_mod_gil
+    { Py_mod_gil, Py_MOD_GIL_NOT_USED },
+#endif
+    { 0, NULL }
+};
+
 static struct PyModuleDef NuddModule = {
     PyModuleDef_HEAD_INIT,
     "nudd_hash",
     "...",
-    -1,
-    NuddMethods
+    sizeof(nudd_state),
+    NuddMethods,
+    nudd_slots,
+    nudd_traverse,
+    nudd_clear,
+    nudd_free
 };
 
 PyMODINIT_FUNC PyInit_nudd_hash(void) {
-    return PyModule_Create(&NuddModule);
+    return PyModuleDef_Init(&NuddModule);
 }
 
 #else
 
 PyMODINIT_FUNC initnudd_hash(void) {
     (void) Py_InitModule("nudd_hash", NuddMethods);
+    nudd_host_profile();
 }
 #endif
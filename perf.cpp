@@ -0,0 +1,135 @@
+#include "perf.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+perf_counters::perf_counters()
+{
+    for (int i = 0; i < perf_event_count; i++) {
+        fds[i] = -1;
+        values[i] = 0;
+    }
+}
+
+perf_counters::~perf_counters()
+{
+    close();
+}
+
+#ifdef __linux__
+#define PERF_CACHE_MISS(cache) \
+    ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | \
+        PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_events[perf_event_count] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+};
+
+bool perf_counters::open()
+{
+    int opened = 0, failure = 0;
+
+    close();
+    for (int i = 0; i < perf_event_count; i++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_events[i].type;
+        attr.config = perf_events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] >= 0)
+            opened++;
+        else if (!failure)
+            failure = errno;
+    }
+    if (!opened) {
+        last_error = std::string("perf_event_open: ") + strerror(failure);
+        return false;
+    }
+    return true;
+}
+
+void perf_counters::start()
+{
+    for (int i = 0; i < perf_event_count; i++) {
+        values[i] = 0;
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perf_counters::stop()
+{
+    /* value, time enabled, time running */
+    uint64_t sample[3];
+
+    for (int i = 0; i < perf_event_count; i++) {
+        if (fds[i] < 0)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[i], sample, sizeof(sample)) != sizeof(sample) || !sample[2])
+            values[i] = 0;
+        else if (sample[2] < sample[1])
+            values[i] = (uint64_t)((double)sample[0] * sample[1] / sample[2]);
+        else
+            values[i] = sample[0];
+    }
+}
+#else
+bool perf_counters::open()
+{
+    last_error = "hardware counters need perf_event_open (Linux)";
+    return false;
+}
+
+void perf_counters::start()
+{
+}
+
+void perf_counters::stop()
+{
+}
+#endif
+
+void perf_counters::close()
+{
+    for (int i = 0; i < perf_event_count; i++) {
+        if (fds[i] >= 0)
+            ::close(fds[i]);
+        fds[i] = -1;
+        values[i] = 0;
+    }
+}
+
+const char *perf_counters::name(perf_event_id event)
+{
+    static const char *names[perf_event_count] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses",
+        "branch_misses", "dtlb_misses"
+    };
+
+    return event < perf_event_count ? names[event] : "unknown";
+}
@@ -0,0 +1,61 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * Hardware counters for the calling thread, through perf_event_open(2),
+ * read around a measured kernel.  Each event is opened on its own, so the
+ * ones the CPU or kernel lacks are simply unavailable, and values are
+ * scaled up when the kernel had to multiplex the PMU between them.
+ * Containers and VMs often expose no PMU at all (or perf_event_paranoid
+ * forbids it); open() then fails and the caller reports wall time alone.
+ *
+ * The generic cache events only name L1D and the last-level cache, so
+ * perf_llc_misses stands in for L2: on parts with an L3 it counts fewer
+ * misses than L2 would.
+ */
+enum perf_event_id {
+    perf_cycles,
+    perf_instructions,
+    perf_l1d_misses,
+    perf_llc_misses,
+    perf_branch_misses,
+    perf_dtlb_misses,
+    perf_event_count
+};
+
+class perf_counters {
+public:
+    perf_counters();
+    ~perf_counters();
+
+    /* Opens every event it can; false if none could be opened */
+    bool open();
+    void close();
+
+    bool available(perf_event_id event) const { return fds[event] >= 0; }
+
+    /* Zeroes and starts the open counters, or stops them */
+    void start();
+    void stop();
+
+    /* Count between the last start() and stop(); 0 if unavailable */
+    uint64_t value(perf_event_id event) const { return values[event]; }
+
+    static const char *name(perf_event_id event);
+
+    std::string const& error() const { return last_error; }
+
+private:
+    perf_counters(perf_counters const&);
+    perf_counters& operator=(perf_counters const&);
+
+    int fds[perf_event_count];
+    uint64_t values[perf_event_count];
+    std::string last_error;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "pow.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "bcrypt.h"
+#include "prefilter.h"
+#include "threadpool.h"
+#include "trace.h"
+
+/*
+ * bcrypt_iterated() splits a header 60/20 and keeps 23 bytes of the first
+ * half's hash followed by 9 of the second's, so the 20-byte suffix alone
+ * decides the most significant bytes of the proof of work.
+ */
+#define NUDD_HIGH		BCRYPT_ITERATED_OUTPUT
+
+void nudd_hash(const char* input, char* output)
+{
+    NUDD_PROBE2(hash__entry, input, 0);
+    std::string const hash_data = bcrypt_iterated(
+        std::string(
+                reinterpret_cast<char const*>(input),80
+        )
+    );
+
+    memcpy(output, hash_data.data(), 32);
+    NUDD_PROBE2(hash__return, input, 0);
+}
+
+static void nudd_hash_half(const char *data, size_t length,
+    unsigned char *output)
+{
+    bcrypt_iterated_ctx ctx;
+
+    bcrypt_iterated_init(&ctx);
+    bcrypt_iterated_update(&ctx, data, length);
+    bcrypt_iterated_final(&ctx, output);
+}
+
+void nudd_hash_interleaved(const char *input, char *output)
+{
+    unsigned char low[BCRYPT_ITERATED_OUTPUT], high[BCRYPT_ITERATED_OUTPUT];
+
+    NUDD_PROBE2(hash__entry, input, 1);
+    bcrypt_iterated_pair(input, NUDD_SPLIT, input + NUDD_SPLIT,
+        NUDD_HEADER_SIZE - NUDD_SPLIT, low, high);
+    memcpy(output, low, NUDD_HIGH);
+    memcpy(output + NUDD_HIGH, high, NUDD_HASH_SIZE - NUDD_HIGH);
+    NUDD_PROBE2(hash__return, input, 1);
+}
+
+void nudd_hash_threaded(const char *input, char *output, thread_pool& pool)
+{
+    unsigned char halves[2][BCRYPT_ITERATED_OUTPUT];
+
+    NUDD_PROBE2(hash__entry, input, 2);
+    pool.parallel_for(2, [input, &halves](size_t i) {
+        if (i)
+            bcrypt_iterated_single(input, NUDD_SPLIT, halves[0], NULL);
+        else
+            bcrypt_iterated_single(input + NUDD_SPLIT,
+                NUDD_HEADER_SIZE - NUDD_SPLIT, halves[1], NULL);
+    });
+    memcpy(output, halves[0], NUDD_HIGH);
+    memcpy(output + NUDD_HIGH, halves[1], NUDD_HASH_SIZE - NUDD_HIGH);
+    NUDD_PROBE2(hash__return, input, 2);
+}
+
+int nudd_target_from_compact(uint32_t nbits, unsigned char target[NUDD_HASH_SIZE])
+{
+    int size = nbits >> 24;
+    uint32_t word = nbits & 0x007fffff;
+    int i, position;
+
+    if (!word || (nbits & 0x00800000))
+        return 0;
+    if (size > 34 || (word > 0xff && size > 33) ||
+        (word > 0xffff && size > 32))
+        return 0;
+
+    memset(target, 0, NUDD_HASH_SIZE);
+    for (i = 0; i < 3; i++) {
+        position = size - 3 + i;
+        /* Bytes past the top are zero, or the size check would have failed */
+        if (position >= 0 && position < NUDD_HASH_SIZE)
+            target[position] = (word >> (8 * i)) & 0xff;
+    }
+    for (i = 0; i < NUDD_HASH_SIZE; i++)
+        if (target[i])
+            return 1;
+    return 0;
+}
+
+int nudd_hash_meets_target(const char *hash, const unsigned char *target)
+{
+    int i;
+
+    for (i = NUDD_HASH_SIZE / 4 - 1; i >= 0; i--) {
+        uint32_t h = le32dec(hash + 4 * i);
+        uint32_t t = le32dec(target + 4 * i);
+        if (h != t)
+            return h < t;
+    }
+    return 1;
+}
+
+int nudd_check_pow(const char *header, char *hash)
+{
+    unsigned char target[NUDD_HASH_SIZE];
+
+    nudd_hash_interleaved(header, hash);
+    if (!nudd_target_from_compact(le32dec(header + NUDD_HEADER_NBITS), target))
+        return 0;
+    return nudd_hash_meets_target(hash, target);
+}
+
+/*
+ * Checks header against target, starting with the half of the hash that
+ * holds the most significant bytes.  With full set, hash is complete for
+ * every header that passes; otherwise the second half is only computed
+ * when the first one leaves the outcome open.
+ */
+static int nudd_check_target_early(const char *header,
+    const unsigned char *target, unsigned char *hash, int full)
+{
+    int i;
+
+    nudd_hash_half(header + NUDD_SPLIT, NUDD_HEADER_SIZE - NUDD_SPLIT,
+        hash + NUDD_HIGH);
+    for (i = NUDD_HASH_SIZE - 1; i >= NUDD_HIGH; i--) {
+        if (hash[i] > target[i])
+            return 0;
+        if (hash[i] < target[i] && !full)
+            return 1;
+        if (hash[i] < target[i])
+            break;
+    }
+
+    nudd_hash_half(header, NUDD_SPLIT, hash);
+    return nudd_hash_meets_target((const char *)hash, target);
+}
+
+static int nudd_check_pow_early(const char *header)
+{
+    unsigned char target[NUDD_HASH_SIZE];
+    unsigned char hash[2 * BCRYPT_ITERATED_OUTPUT];
+
+    if (!nudd_target_from_compact(le32dec(header + NUDD_HEADER_NBITS), target))
+        return 0;
+    return nudd_check_target_early(header, target, hash, 0);
+}
+
+void nudd_check_pow_batch(const char *headers, size_t count,
+    unsigned char *bitmap, thread_pool& pool, pool_priority priority,
+    header_filter *filter)
+{
+    std::vector<unsigned char> valid(count);
+    std::vector<size_t> plausible;
+    unsigned long long started = NUDD_TRACE_START(batch__done);
+
+    /* Filtered out here, so every pool task is a header worth hashing */
+    plausible.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        if (!filter || filter->admit(headers + i * NUDD_HEADER_SIZE))
+            plausible.push_back(i);
+
+    NUDD_PROBE2(batch__submit, plausible.size(), priority);
+    pool.parallel_for(plausible.size(), [headers, &plausible, &valid](size_t k) {
+        size_t i = plausible[k];
+        valid[i] = nudd_check_pow_early(headers + i * NUDD_HEADER_SIZE);
+    }, priority);
+    NUDD_PROBE_ELAPSED(batch__done, count, started);
+
+    memset(bitmap, 0, (count + 7) / 8);
+    for (size_t i = 0; i < count; i++)
+        if (valid[i])
+            bitmap[i / 8] |= 1 << (i % 8);
+}
+
+void nudd_check_targets_batch(const char *headers,
+    const unsigned char *targets, size_t count, unsigned char *valid,
+    char *hashes, thread_pool& pool, pool_priority priority)
+{
+    unsigned long long started = NUDD_TRACE_START(batch__done);
+
+    NUDD_PROBE2(batch__submit, count, priority);
+    pool.parallel_for(count, [=](size_t i) {
+        unsigned char hash[2 * BCRYPT_ITERATED_OUTPUT];
+
+        valid[i] = nudd_check_target_early(headers + i * NUDD_HEADER_SIZE,
+            targets + i * NUDD_HASH_SIZE, hash, 1);
+        if (valid[i])
+            memcpy(hashes + i * NUDD_HASH_SIZE, hash, NUDD_HASH_SIZE);
+        else
+            memset(hashes + i * NUDD_HASH_SIZE, 0, NUDD_HASH_SIZE);
+    }, priority);
+    NUDD_PROBE_ELAPSED(batch__done, count, started);
+}
@@ -0,0 +1,67 @@
+#ifndef POW_H
+#define POW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "threadpool.h"
+
+#define NUDD_HEADER_SIZE	80
+#define NUDD_HASH_SIZE		32
+
+/* Offset of the compact target ("nBits") in a block header */
+#define NUDD_HEADER_NBITS	72
+
+/* nudd_hash() hashes the first NUDD_SPLIT bytes and the rest separately */
+#define NUDD_SPLIT		(NUDD_HEADER_SIZE * 3 / 4)
+
+void nudd_hash(const char *input, char *output);
+
+/*
+ * nudd_hash() with its two halves computed at the same time, for when the
+ * latency of one header matters more than throughput.  The interleaved
+ * form runs both bcrypt calls in the calling thread, round by round; the
+ * threaded form hands one half to the pool.
+ */
+void nudd_hash_interleaved(const char *input, char *output);
+void nudd_hash_threaded(const char *input, char *output, thread_pool& pool);
+
+/*
+ * Expands a compact target into 32 little-endian bytes.  Returns 0 for the
+ * encodings a block can never satisfy: negative, zero or overflowing.
+ */
+int nudd_target_from_compact(uint32_t nbits, unsigned char target[NUDD_HASH_SIZE]);
+
+/* Compares as 256-bit little-endian numbers, most significant word first */
+int nudd_hash_meets_target(const char *hash, const unsigned char *target);
+
+/*
+ * Hashes the header into hash, both halves at once, and checks it against
+ * the header's own nBits.  Returns 1 if the proof of work is valid.
+ */
+int nudd_check_pow(const char *header, char *hash);
+
+class header_filter;
+
+/*
+ * Checks count contiguous headers on the pool, setting bit i % 8 of
+ * bitmap[i / 8] for every valid one.  Headers that filter (if any) turns
+ * away are invalid and never hashed.  The half of the hash that holds the
+ * most significant bytes is computed first, and the rest is skipped for
+ * headers it already rules out.
+ */
+void nudd_check_pow_batch(const char *headers, size_t count,
+    unsigned char *bitmap, thread_pool& pool,
+    pool_priority priority = pool_foreground, header_filter *filter = NULL);
+
+/*
+ * Checks count contiguous headers on the pool, header i against the 32-byte
+ * target at targets + 32 * i, with the same early exit.  Sets valid[i] to
+ * 0 or 1; hash i is written for valid headers and zeroed otherwise.
+ */
+void nudd_check_targets_batch(const char *headers,
+    const unsigned char *targets, size_t count, unsigned char *valid,
+    char *hashes, thread_pool& pool,
+    pool_priority priority = pool_foreground);
+
+#endif
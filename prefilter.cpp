@@ -0,0 +1,122 @@
+#include "prefilter.h"
+
+#include <string.h>
+
+#include <mutex>
+
+#include "bcrypt.h"
+
+/* Field offsets in a block header */
+#define HEADER_VERSION		0
+#define HEADER_PREV_HASH	4
+#define HEADER_TIME		68
+
+header_filter::header_filter()
+    : min_version(0), max_version(0), time_window(0), admits(0)
+{
+    memset(pow_limit, 0, sizeof(pow_limit));
+    for (int i = 0; i < check_count; i++)
+        rejects[i] = 0;
+}
+
+void header_filter::require_version(uint32_t min, uint32_t max)
+{
+    min_version = min;
+    max_version = max;
+    order.push_back(check_version);
+}
+
+void header_filter::require_nbits(uint32_t limit)
+{
+    nudd_target_from_compact(limit, pow_limit);
+    order.push_back(check_nbits);
+}
+
+void header_filter::require_time(uint32_t earliest, uint32_t latest)
+{
+    set_time_window(earliest, latest);
+    order.push_back(check_time);
+}
+
+void header_filter::require_prev_hash()
+{
+    order.push_back(check_prev_hash);
+}
+
+void header_filter::set_time_window(uint32_t earliest, uint32_t latest)
+{
+    time_window = (uint64_t)earliest << 32 | latest;
+}
+
+void header_filter::add_prev_hash(const unsigned char hash[32])
+{
+    block_hash key;
+
+    memcpy(key.data(), hash, key.size());
+    std::unique_lock<std::shared_mutex> hold(prev_hashes_lock);
+    prev_hashes.insert(key);
+}
+
+void header_filter::clear_prev_hashes()
+{
+    std::unique_lock<std::shared_mutex> hold(prev_hashes_lock);
+    prev_hashes.clear();
+}
+
+size_t header_filter::block_hash_hasher::operator()(block_hash const& hash) const
+{
+    size_t value;
+
+    memcpy(&value, hash.data(), sizeof(value));
+    return value;
+}
+
+bool header_filter::passes(check which, const char *header)
+{
+    switch (which) {
+    case check_version: {
+        uint32_t version = le32dec(header + HEADER_VERSION);
+        return version >= min_version && version <= max_version;
+    }
+    case check_nbits: {
+        unsigned char target[NUDD_HASH_SIZE];
+        return nudd_target_from_compact(le32dec(header + NUDD_HEADER_NBITS), target) &&
+            nudd_hash_meets_target((const char *)target, pow_limit);
+    }
+    case check_time: {
+        uint32_t time = le32dec(header + HEADER_TIME);
+        uint64_t window = time_window.load(std::memory_order_relaxed);
+        return time >= (uint32_t)(window >> 32) && time <= (uint32_t)window;
+    }
+    case check_prev_hash: {
+        block_hash key;
+
+        memcpy(key.data(), header + HEADER_PREV_HASH, key.size());
+        std::shared_lock<std::shared_mutex> hold(prev_hashes_lock);
+        return prev_hashes.count(key) != 0;
+    }
+    default:
+        return true;
+    }
+}
+
+bool header_filter::admit(const char *header)
+{
+    for (check which : order) {
+        if (!passes(which, header)) {
+            rejects[which].fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    admits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+const char *header_filter::name(check which)
+{
+    static const char *names[check_count] = {
+        "version", "nbits", "time", "prev_hash"
+    };
+
+    return which < check_count ? names[which] : "unknown";
+}
@@ -0,0 +1,90 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "pow.h"
+
+/*
+ * Field checks that cost a few loads and compares, run on each header of a
+ * batch before any of them is hashed.  A header that fails one is invalid
+ * without spending a bcrypt call on it, which keeps a flood of junk headers
+ * from costing as much as real ones.
+ *
+ * Checks are enabled before the filter is first used and run in the order
+ * they were enabled, each counting the headers it rejected.  The time
+ * window and the set of known previous-block hashes may be changed while
+ * batches are being checked.
+ */
+class header_filter {
+public:
+    enum check {
+        check_version,
+        check_nbits,
+        check_time,
+        check_prev_hash,
+        check_count
+    };
+
+    header_filter();
+
+    /* Accepts versions in [min, max] */
+    void require_version(uint32_t min, uint32_t max);
+
+    /* Accepts compact targets that expand to no more than limit's */
+    void require_nbits(uint32_t limit);
+
+    /* Accepts timestamps in [earliest, latest] */
+    void require_time(uint32_t earliest, uint32_t latest);
+
+    /* Accepts headers whose previous-block hash is in the set */
+    void require_prev_hash();
+
+    void set_time_window(uint32_t earliest, uint32_t latest);
+    void add_prev_hash(const unsigned char hash[32]);
+    void clear_prev_hashes();
+
+    /* Whether header passes every check, counting the one it fails */
+    bool admit(const char *header);
+
+    uint64_t rejected(check which) const { return rejects[which].load(); }
+    uint64_t admitted() const { return admits.load(); }
+
+    static const char *name(check which);
+
+private:
+    typedef std::array<unsigned char, 32> block_hash;
+
+    /* Block hashes are already uniform, so any eight of their bytes will do */
+    struct block_hash_hasher {
+        size_t operator()(block_hash const& hash) const;
+    };
+
+    header_filter(header_filter const&);
+    header_filter& operator=(header_filter const&);
+
+    bool passes(check which, const char *header);
+
+    std::vector<check> order;
+
+    uint32_t min_version;
+    uint32_t max_version;
+    unsigned char pow_limit[NUDD_HASH_SIZE];
+
+    /* earliest << 32 | latest, so a window changes as one */
+    std::atomic<uint64_t> time_window;
+
+    std::shared_mutex prev_hashes_lock;
+    std::unordered_set<block_hash, block_hash_hasher> prev_hashes;
+
+    std::atomic<uint64_t> rejects[check_count];
+    std::atomic<uint64_t> admits;
+};
+
+#endif
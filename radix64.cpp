@@ -0,0 +1,338 @@
+#include "radix64.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define RADIX64_X86	1
+#endif
+
+static const char radix64_alphabet[64 + 1] =
+    "./ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+/* Characters are decoded in groups of four into three bytes */
+#define GROUP_CHARS	4
+#define GROUP_BYTES	3
+
+static inline int radix64_value(unsigned char c)
+{
+    if (c >= '.' && c <= '/')
+        return c - '.';
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A' + 2;
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 28;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 54;
+    return -1;
+}
+
+static void encode_scalar(char *dst, const unsigned char *src, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i + GROUP_BYTES <= size; i += GROUP_BYTES, src += GROUP_BYTES) {
+        *dst++ = radix64_alphabet[src[0] >> 2];
+        *dst++ = radix64_alphabet[((src[0] & 0x03) << 4) | (src[1] >> 4)];
+        *dst++ = radix64_alphabet[((src[1] & 0x0f) << 2) | (src[2] >> 6)];
+        *dst++ = radix64_alphabet[src[2] & 0x3f];
+    }
+    if (size - i == 1) {
+        *dst++ = radix64_alphabet[src[0] >> 2];
+        *dst++ = radix64_alphabet[(src[0] & 0x03) << 4];
+    } else if (size - i == 2) {
+        *dst++ = radix64_alphabet[src[0] >> 2];
+        *dst++ = radix64_alphabet[((src[0] & 0x03) << 4) | (src[1] >> 4)];
+        *dst++ = radix64_alphabet[(src[1] & 0x0f) << 2];
+    }
+}
+
+static int decode_scalar(unsigned char *dst, const char *src, size_t size)
+{
+    size_t length = radix64_length(size), i;
+    unsigned int bits = 0;
+    int held = 0;
+
+    for (i = 0; i < length; i++) {
+        int value = radix64_value((unsigned char)src[i]);
+        if (value < 0)
+            return -1;
+        bits = (bits << 6) | value;
+        held += 6;
+        if (held >= 8) {
+            held -= 8;
+            *dst++ = (unsigned char)(bits >> held);
+        }
+    }
+    return 0;
+}
+
+#ifdef RADIX64_X86
+/*
+ * The SIMD forms follow Mula and Lemire's base64 codecs with bcrypt's
+ * alphabet: characters map to 6-bit values by adding a per-range offset,
+ * and pmaddubsw/pmaddwd plus a byte shuffle pack four values into three
+ * bytes (or the reverse for encoding).  Inputs are padded to whole blocks
+ * in a local buffer, so they never read or write past the caller's data.
+ */
+#define SIMD_PREFIX(isa) __attribute__((target(isa)))
+
+/* Block of 16 characters to 16 six-bit values; mask of valid characters */
+#define DECODE_TRANSLATE(T, W, c, values, valid) do { \
+    T dot = W##_and(W##_cmpgt_epi8(c, W##_set1_epi8(0x2d)), \
+        W##_cmpgt_epi8(W##_set1_epi8(0x30), c)); \
+    T digit = W##_and(W##_cmpgt_epi8(c, W##_set1_epi8(0x2f)), \
+        W##_cmpgt_epi8(W##_set1_epi8(0x3a), c)); \
+    T upper = W##_and(W##_cmpgt_epi8(c, W##_set1_epi8(0x40)), \
+        W##_cmpgt_epi8(W##_set1_epi8(0x5b), c)); \
+    T lower = W##_and(W##_cmpgt_epi8(c, W##_set1_epi8(0x60)), \
+        W##_cmpgt_epi8(W##_set1_epi8(0x7b), c)); \
+    T offset = W##_or(W##_or(W##_and(dot, W##_set1_epi8(-0x2e)), \
+        W##_and(digit, W##_set1_epi8(6))), \
+        W##_or(W##_and(upper, W##_set1_epi8(-0x3f)), \
+        W##_and(lower, W##_set1_epi8(-0x45)))); \
+    valid = W##_or(W##_or(dot, digit), W##_or(upper, lower)); \
+    values = W##_add_epi8(c, offset); \
+} while (0)
+
+#define DECODE_PACK(T, W, values, packed) do { \
+    T pairs = W##_maddubs_epi16(values, W##_set1_epi32(0x01400140)); \
+    packed = W##_madd_epi16(pairs, W##_set1_epi32(0x00011000)); \
+} while (0)
+
+#define ENCODE_UNPACK(T, W, in, values) do { \
+    T t0 = W##_and(in, W##_set1_epi32(0x0fc0fc00)); \
+    T t1 = W##_mulhi_epu16(t0, W##_set1_epi32(0x04000040)); \
+    T t2 = W##_and(in, W##_set1_epi32(0x003f03f0)); \
+    T t3 = W##_mullo_epi16(t2, W##_set1_epi32(0x01000010)); \
+    values = W##_or(t1, t3); \
+} while (0)
+
+#define ENCODE_TRANSLATE(T, W, values, chars) do { \
+    T offset = W##_set1_epi8(0x2e); \
+    offset = W##_add_epi8(offset, W##_and(W##_cmpgt_epi8(values, \
+        W##_set1_epi8(1)), W##_set1_epi8(0x3f - 0x2e))); \
+    offset = W##_add_epi8(offset, W##_and(W##_cmpgt_epi8(values, \
+        W##_set1_epi8(27)), W##_set1_epi8(0x45 - 0x3f))); \
+    offset = W##_add_epi8(offset, W##_and(W##_cmpgt_epi8(values, \
+        W##_set1_epi8(53)), W##_set1_epi8((char)(0xfa - 0x45)))); \
+    chars = W##_add_epi8(values, offset); \
+} while (0)
+
+#define _mm_and		_mm_and_si128
+#define _mm_or		_mm_or_si128
+#define _mm256_and	_mm256_and_si256
+#define _mm256_or	_mm256_or_si256
+
+SIMD_PREFIX("ssse3")
+static int decode_ssse3(unsigned char *dst, const char *src, size_t size)
+{
+    size_t length = radix64_length(size);
+    size_t blocks = (length + 15) / 16;
+    char chars[64];
+    unsigned char bytes[64];
+
+    if (blocks * 16 > sizeof(chars))
+        return decode_scalar(dst, src, size);
+    memset(chars, '.', blocks * 16);
+    memcpy(chars, src, length);
+    for (size_t b = 0; b < blocks; b++) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(chars + 16 * b));
+        __m128i values, valid, packed;
+
+        DECODE_TRANSLATE(__m128i, _mm, c, values, valid);
+        if (_mm_movemask_epi8(valid) != 0xffff)
+            return -1;
+        DECODE_PACK(__m128i, _mm, values, packed);
+        packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4,
+            10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)(bytes + 12 * b), packed);
+    }
+    memcpy(dst, bytes, size);
+    return 0;
+}
+
+SIMD_PREFIX("avx2")
+static int decode_avx2(unsigned char *dst, const char *src, size_t size)
+{
+    size_t length = radix64_length(size);
+    size_t blocks = (length + 31) / 32;
+    char chars[64];
+    unsigned char bytes[64];
+
+    if (blocks * 32 > sizeof(chars))
+        return decode_scalar(dst, src, size);
+    memset(chars, '.', blocks * 32);
+    memcpy(chars, src, length);
+    for (size_t b = 0; b < blocks; b++) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(chars + 32 * b));
+        __m256i values, valid, packed;
+
+        DECODE_TRANSLATE(__m256i, _mm256, c, values, valid);
+        if ((unsigned int)_mm256_movemask_epi8(valid) != 0xffffffffu)
+            return -1;
+        DECODE_PACK(__m256i, _mm256, values, packed);
+        packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128((__m128i *)(bytes + 24 * b),
+            _mm256_castsi256_si128(packed));
+        _mm_storeu_si128((__m128i *)(bytes + 24 * b + 12),
+            _mm256_extracti128_si256(packed, 1));
+    }
+    memcpy(dst, bytes, size);
+    return 0;
+}
+
+SIMD_PREFIX("ssse3")
+static void encode_ssse3(char *dst, const unsigned char *src, size_t size)
+{
+    size_t blocks = (size + 11) / 12;
+    unsigned char bytes[64];
+    char chars[80];
+
+    if (blocks * 12 + 4 > sizeof(bytes)) {
+        encode_scalar(dst, src, size);
+        return;
+    }
+    memset(bytes, 0, blocks * 12 + 4);
+    memcpy(bytes, src, size);
+    for (size_t b = 0; b < blocks; b++) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(bytes + 12 * b));
+        __m128i values, out;
+
+        in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+            7, 6, 8, 7, 10, 9, 11, 10));
+        ENCODE_UNPACK(__m128i, _mm, in, values);
+        ENCODE_TRANSLATE(__m128i, _mm, values, out);
+        _mm_storeu_si128((__m128i *)(chars + 16 * b), out);
+    }
+    memcpy(dst, chars, radix64_length(size));
+}
+
+SIMD_PREFIX("avx2")
+static void encode_avx2(char *dst, const unsigned char *src, size_t size)
+{
+    size_t blocks = (size + 23) / 24;
+    unsigned char bytes[64];
+    char chars[96];
+
+    if (blocks * 24 + 4 > sizeof(bytes)) {
+        encode_scalar(dst, src, size);
+        return;
+    }
+    memset(bytes, 0, blocks * 24 + 4);
+    memcpy(bytes, src, size);
+    for (size_t b = 0; b < blocks; b++) {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+            _mm_loadu_si128((const __m128i *)(bytes + 24 * b))),
+            _mm_loadu_si128((const __m128i *)(bytes + 24 * b + 12)), 1);
+        __m256i values, out;
+
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        ENCODE_UNPACK(__m256i, _mm256, in, values);
+        ENCODE_TRANSLATE(__m256i, _mm256, values, out);
+        _mm256_storeu_si256((__m256i *)(chars + 32 * b), out);
+    }
+    memcpy(dst, chars, radix64_length(size));
+}
+#endif
+
+struct radix64_impl {
+    const char *name;
+    void (*encode)(char *dst, const unsigned char *src, size_t size);
+    int (*decode)(unsigned char *dst, const char *src, size_t size);
+};
+
+static radix64_impl radix64_select()
+{
+    radix64_impl impl = { "scalar", encode_scalar, decode_scalar };
+
+#ifdef RADIX64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        impl.name = "avx2";
+        impl.encode = encode_avx2;
+        impl.decode = decode_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        impl.name = "ssse3";
+        impl.encode = encode_ssse3;
+        impl.decode = decode_ssse3;
+    }
+#endif
+    return impl;
+}
+
+static radix64_impl const& radix64()
+{
+    static radix64_impl const impl = radix64_select();
+    return impl;
+}
+
+void radix64_encode(char *dst, const unsigned char *src, size_t size)
+{
+    radix64().encode(dst, src, size);
+}
+
+int radix64_decode(unsigned char *dst, const char *src, size_t size)
+{
+    return radix64().decode(dst, src, size);
+}
+
+const char *radix64_variant()
+{
+    return radix64().name;
+}
+
+/* "$2a$05$": subtype at 2, cost at 4 and 5, salt from 7, hash from 29 */
+#define SETTING_LENGTH	7
+#define SALT_CHARS	radix64_length(BCRYPT_SALT_SIZE)
+
+static bool bcrypt_parse(const char *hash, size_t length, bcrypt_parsed& out)
+{
+    unsigned int cost;
+
+    out.cost = 0;
+    if (length != BCRYPT_HASH_LENGTH || hash[0] != '$' || hash[1] != '2' ||
+        (hash[2] != 'a' && hash[2] != 'x' && hash[2] != 'y') ||
+        hash[3] != '$' || hash[4] < '0' || hash[4] > '3' ||
+        hash[5] < '0' || hash[5] > '9' || hash[6] != '$')
+        return false;
+    cost = (hash[4] - '0') * 10 + (hash[5] - '0');
+    if (cost < 4 || cost > 31)
+        return false;
+    if (radix64_decode(out.salt, hash + SETTING_LENGTH, BCRYPT_SALT_SIZE) ||
+        radix64_decode(out.hash, hash + SETTING_LENGTH + SALT_CHARS,
+            BCRYPT_HASH_SIZE))
+        return false;
+    out.subtype = hash[2];
+    out.cost = (unsigned char)cost;
+    return true;
+}
+
+size_t bcrypt_parse_batch(const char *const *hashes, const size_t *lengths,
+    size_t count, bcrypt_parsed *out)
+{
+    size_t parsed = 0;
+
+    for (size_t i = 0; i < count; i++)
+        parsed += bcrypt_parse(hashes[i], lengths[i], out[i]);
+    return parsed;
+}
+
+void bcrypt_format(bcrypt_parsed const& parsed, char out[BCRYPT_HASH_LENGTH + 1])
+{
+    out[0] = '$';
+    out[1] = '2';
+    out[2] = parsed.subtype;
+    out[3] = '$';
+    out[4] = '0' + parsed.cost / 10;
+    out[5] = '0' + parsed.cost % 10;
+    out[6] = '$';
+    radix64_encode(out + SETTING_LENGTH, parsed.salt, BCRYPT_SALT_SIZE);
+    radix64_encode(out + SETTING_LENGTH + SALT_CHARS, parsed.hash,
+        BCRYPT_HASH_SIZE);
+    out[BCRYPT_HASH_LENGTH] = '\0';
+}
@@ -0,0 +1,51 @@
+#ifndef RADIX64_H
+#define RADIX64_H
+
+#include <stddef.h>
+
+/*
+ * bcrypt's radix-64: the "./A-Za-z0-9" alphabet, bits taken most
+ * significant first, no padding characters.  A final partial group leaves
+ * the unused low bits of its last character zero on encode and ignores them
+ * on decode, exactly as BF_encode() and BF_decode() do.  Where the CPU has
+ * them, SSSE3 and AVX2 translate and repack 16 or 32 characters at a time.
+ */
+#define radix64_length(size)	(((size) * 4 + 2) / 3)
+
+void radix64_encode(char *dst, const unsigned char *src, size_t size);
+
+/* Reads exactly radix64_length(size) characters; -1 if any is not in the alphabet */
+int radix64_decode(unsigned char *dst, const char *src, size_t size);
+
+/* Name of the implementation in use: "avx2", "ssse3" or "scalar" */
+const char *radix64_variant();
+
+/*
+ * A stored bcrypt hash, "$2a$05$" followed by 22 characters of salt and 31
+ * of hash.  Only 23 of the 24 output bytes are ever encoded, and only the
+ * top two bits of the salt's last character count, as in BF_crypt().
+ */
+#define BCRYPT_HASH_LENGTH	60
+#define BCRYPT_SALT_SIZE	16
+#define BCRYPT_HASH_SIZE	23
+
+struct bcrypt_parsed {
+    char subtype;
+    unsigned char cost;
+    unsigned char salt[BCRYPT_SALT_SIZE];
+    unsigned char hash[BCRYPT_HASH_SIZE];
+};
+
+/*
+ * Parses count hashes, hashes[i] being lengths[i] characters long.  A hash
+ * BF_crypt() would reject as a setting (wrong length, subtype other than a,
+ * x or y, cost outside 4..31, characters outside the alphabet) leaves
+ * out[i].cost zero.  Returns the number parsed.
+ */
+size_t bcrypt_parse_batch(const char *const *hashes, const size_t *lengths,
+    size_t count, bcrypt_parsed *out);
+
+/* The canonical string for parsed, NUL-terminated */
+void bcrypt_format(bcrypt_parsed const& parsed, char out[BCRYPT_HASH_LENGTH + 1]);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+/*
+ * Bounded multi-producer, single-consumer queue.  Every cell carries a
+ * sequence number: producers claim a slot with one compare-and-swap on
+ * head and publish it by bumping the cell's sequence, so a push never
+ * waits on a lock and fails outright when the ring is full.  Only one
+ * thread may pop.
+ */
+template <typename T>
+class mpsc_ring {
+public:
+    /* capacity is rounded up to a power of two */
+    explicit mpsc_ring(size_t capacity)
+    {
+        size_t size = 2;
+
+        while (size < capacity)
+            size <<= 1;
+        cells.reset(new cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+        tail = 0;
+    }
+
+    /* Returns false, leaving the ring untouched, when it is full */
+    bool push(T const& value)
+    {
+        size_t position = head.load(std::memory_order_relaxed);
+        cell *target;
+
+        for (;;) {
+            target = &cells[position & mask];
+            size_t sequence = target->sequence.load(std::memory_order_acquire);
+            intptr_t ahead = (intptr_t)sequence - (intptr_t)position;
+            if (ahead == 0) {
+                if (head.compare_exchange_weak(position, position + 1,
+                        std::memory_order_relaxed))
+                    break;
+            } else if (ahead < 0) {
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+        target->value = value;
+        target->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer only */
+    bool pop(T& value)
+    {
+        cell& target = cells[tail & mask];
+
+        if (target.sequence.load(std::memory_order_acquire) != tail + 1)
+            return false;
+        value = target.value;
+        target.value = T();
+        target.sequence.store(tail + mask + 1, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    mpsc_ring(mpsc_ring const&);
+    mpsc_ring& operator=(mpsc_ring const&);
+
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) size_t tail;
+};
+
+#endif
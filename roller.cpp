@@ -0,0 +1,136 @@
+#include "roller.h"
+
+#include <string.h>
+
+#define L	SHA256_LANES
+
+static inline uint32_t roller_be32dec(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+        ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Hashes the 32-byte digest held in state[0..7] once more, in place */
+static void roller_rehash(uint32_t state[8][L])
+{
+    uint32_t words[16][L];
+    int i, l;
+
+    for (i = 0; i < 8; i++)
+        for (l = 0; l < L; l++)
+            words[i][l] = state[i][l];
+    for (l = 0; l < L; l++) {
+        words[8][l] = 0x80000000;
+        for (i = 9; i < 15; i++)
+            words[i][l] = 0;
+        words[15][l] = 256;
+    }
+    for (i = 0; i < 8; i++)
+        for (l = 0; l < L; l++)
+            state[i][l] = sha256_initial_state[i];
+    sha256_transform_lanes(state, words);
+}
+
+header_roller::header_roller(scan_job const& job)
+    : extranonce2_size(job.extranonce2_size)
+{
+    std::string prefix = job.coinb1 + job.extranonce1;
+    size_t whole = prefix.size() - prefix.size() % SHA256_BLOCK_SIZE;
+    uint64_t bits = 8 * (uint64_t)(prefix.size() + extranonce2_size + job.coinb2.size());
+    size_t i;
+
+    memcpy(midstate, sha256_initial_state, sizeof(midstate));
+    for (i = 0; i < whole; i += SHA256_BLOCK_SIZE)
+        sha256_transform(midstate, (const unsigned char *)prefix.data() + i);
+
+    tail.assign(prefix.begin() + whole, prefix.end());
+    extranonce2_offset = tail.size();
+    tail.resize(tail.size() + extranonce2_size);
+    tail.insert(tail.end(), job.coinb2.begin(), job.coinb2.end());
+    tail.push_back(0x80);
+    while (tail.size() % SHA256_BLOCK_SIZE != SHA256_BLOCK_SIZE - 8)
+        tail.push_back(0);
+    for (i = 0; i < 8; i++)
+        tail.push_back((unsigned char)(bits >> (56 - 8 * i)));
+
+    for (i = 0; i < job.merkle_branch.size(); i++)
+        for (size_t w = 0; w < 8; w++)
+            branch.push_back(roller_be32dec(
+                (const unsigned char *)job.merkle_branch[i].data() + 4 * w));
+
+    scan_build_header(job, 0, header);
+}
+
+void header_roller::build(uint64_t first, size_t count,
+    unsigned char *headers) const
+{
+    for (size_t done = 0; done < count; done += L)
+        build_lanes(first + done, headers + done * NUDD_HEADER_SIZE,
+            count - done < L ? count - done : L);
+}
+
+void header_roller::build_lanes(uint64_t first, unsigned char *headers,
+    size_t count) const
+{
+    uint32_t state[8][L], words[16][L];
+    size_t block, i, j;
+    int l;
+
+    for (i = 0; i < 8; i++)
+        for (l = 0; l < L; l++)
+            state[i][l] = midstate[i];
+
+    /* Remaining coinbase blocks; only extranonce2 differs between lanes */
+    for (block = 0; block < tail.size(); block += SHA256_BLOCK_SIZE) {
+        for (l = 0; l < L; l++) {
+            unsigned char data[SHA256_BLOCK_SIZE];
+            uint64_t extranonce2 = first + l;
+
+            memcpy(data, &tail[block], SHA256_BLOCK_SIZE);
+            for (i = 0; i < extranonce2_size; i++) {
+                size_t at = extranonce2_offset + i;
+                size_t shift = extranonce2_size - 1 - i;
+                if (at >= block && at < block + SHA256_BLOCK_SIZE)
+                    data[at - block] = shift >= 8 ? 0 :
+                        (unsigned char)(extranonce2 >> (8 * shift));
+            }
+            for (i = 0; i < 16; i++)
+                words[i][l] = roller_be32dec(data + 4 * i);
+        }
+        sha256_transform_lanes(state, words);
+    }
+    roller_rehash(state);
+
+    /* node = sha256d(node || branch[i]) */
+    for (j = 0; j < branch.size(); j += 8) {
+        uint32_t node[8][L];
+
+        memcpy(node, state, sizeof(node));
+        for (i = 0; i < 8; i++)
+            for (l = 0; l < L; l++) {
+                words[i][l] = node[i][l];
+                words[8 + i][l] = branch[j + i];
+                state[i][l] = sha256_initial_state[i];
+            }
+        sha256_transform_lanes(state, words);
+        for (l = 0; l < L; l++) {
+            words[0][l] = 0x80000000;
+            for (i = 1; i < 15; i++)
+                words[i][l] = 0;
+            words[15][l] = 512;
+        }
+        sha256_transform_lanes(state, words);
+        roller_rehash(state);
+    }
+
+    for (l = 0; l < (int)count; l++) {
+        unsigned char *out = headers + l * NUDD_HEADER_SIZE;
+        memcpy(out, header, NUDD_HEADER_SIZE);
+        for (i = 0; i < 8; i++) {
+            out[36 + 4 * i] = state[i][l] >> 24;
+            out[37 + 4 * i] = state[i][l] >> 16;
+            out[38 + 4 * i] = state[i][l] >> 8;
+            out[39 + 4 * i] = state[i][l];
+        }
+    }
+}
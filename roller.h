@@ -0,0 +1,46 @@
+#ifndef ROLLER_H
+#define ROLLER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "scanner.h"
+#include "sha256.h"
+
+/*
+ * Builds headers for successive extranonce2 values of one job without
+ * redoing the constant work.  The SHA-256 midstate of the coinbase bytes
+ * before extranonce2 is computed once, as are the padded blocks from
+ * extranonce2 to the end of coinb2 and the merkle branch words.  Each
+ * build() then runs the remaining coinbase blocks and the whole branch
+ * for SHA256_LANES extranonces at a time.
+ *
+ * Produces exactly what scan_build_header() does.  build() only reads the
+ * roller, so one instance can serve every scanner thread.
+ */
+class header_roller {
+public:
+    explicit header_roller(scan_job const& job);
+
+    /* Writes count consecutive 80-byte headers, nonce zero, from first on */
+    void build(uint64_t first, size_t count, unsigned char *headers) const;
+
+private:
+    void build_lanes(uint64_t first, unsigned char *headers, size_t count) const;
+
+    unsigned int extranonce2_size;
+    uint32_t midstate[8];
+
+    /* Coinbase from the last partial block on, padded, extranonce2 zero */
+    std::vector<unsigned char> tail;
+    size_t extranonce2_offset;
+
+    /* Branch hashes as big-endian words, ready for a block's second half */
+    std::vector<uint32_t> branch;
+
+    unsigned char header[NUDD_HEADER_SIZE];
+};
+
+#endif
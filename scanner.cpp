@@ -0,0 +1,324 @@
+#include "scanner.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <chrono>
+
+#include "bcrypt.h"
+#include "roller.h"
+#include "sha256.h"
+#include "trace.h"
+#include "tune.h"
+
+/* Nonces per claim; a power of two, so a chunk never spans two extranonce2s */
+#define SCAN_CHUNK	64
+
+#define SCAN_SPLIT	(NUDD_HEADER_SIZE * 3 / 4)
+
+static int64_t scan_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t scan_job::extranonce2_count() const
+{
+    return extranonce2_size >= 4 ? (uint64_t)1 << 32 :
+        (uint64_t)1 << (8 * extranonce2_size);
+}
+
+void scan_build_header(scan_job const& job, uint64_t extranonce2,
+    unsigned char header[NUDD_HEADER_SIZE])
+{
+    std::string coinbase = job.coinb1 + job.extranonce1;
+    unsigned char node[64];
+    unsigned int i;
+
+    for (i = job.extranonce2_size; i > 0; i--)
+        coinbase += (char)(i > 8 ? 0 : (extranonce2 >> (8 * (i - 1))) & 0xff);
+    coinbase += job.coinb2;
+
+    sha256d(coinbase.data(), coinbase.size(), node);
+    for (i = 0; i < job.merkle_branch.size(); i++) {
+        memcpy(node + 32, job.merkle_branch[i].data(), 32);
+        sha256d(node, 64, node);
+    }
+
+    le32enc(header, job.version);
+    memcpy(header + 4, job.prevhash, 32);
+    memcpy(header + 36, node, 32);
+    le32enc(header + 68, job.ntime);
+    le32enc(header + 72, job.nbits);
+    le32enc(header + 76, 0);
+}
+
+nonce_scanner::nonce_scanner(unsigned int threads, size_t capacity)
+    : stopping(false), epoch(0), switch_started_ns(0), switch_worst_ns(0),
+      hash_count(0), share_count(0), drop_count(0), found(capacity),
+      consumer_waiting(false), notify_read_fd(-1), notify_write_fd(-1)
+{
+#ifdef __linux__
+    notify_read_fd = notify_write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    int fds[2];
+    if (!pipe(fds)) {
+        notify_read_fd = fds[0];
+        notify_write_fd = fds[1];
+        for (int i = 0; i < 2; i++) {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+#endif
+
+    /* The host profile decides only when the caller leaves it open */
+    nudd_profile const& profile = nudd_host_profile();
+    std::vector<int> cpus;
+    if (!threads) {
+        threads = profile.threads;
+        if (!profile.smt)
+            cpus = nudd_cpu_list(false);
+    }
+    if (!threads)
+        threads = cpus.empty() ? std::thread::hardware_concurrency() :
+            (unsigned int)cpus.size();
+    if (!threads)
+        threads = 1;
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&nonce_scanner::run, this));
+        nudd_pin_thread(workers.back(), cpus, i);
+    }
+}
+
+nonce_scanner::~nonce_scanner()
+{
+    stop();
+    if (notify_write_fd >= 0 && notify_write_fd != notify_read_fd)
+        close(notify_write_fd);
+    if (notify_read_fd >= 0)
+        close(notify_read_fd);
+}
+
+void nonce_scanner::set_job(std::shared_ptr<scan_job const> job)
+{
+    set_job(job, 0, UINT64_MAX);
+}
+
+void nonce_scanner::set_job(std::shared_ptr<scan_job const> job,
+    uint64_t begin, uint64_t end, bool cancel)
+{
+    std::shared_ptr<slot> next;
+
+    if (job) {
+        next.reset(new slot());
+        next->job = job;
+        next->roller.reset(new header_roller(*job));
+        next->next = begin;
+        next->end = end;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (cancel) {
+            switch_started_ns = scan_now_ns();
+            switch_worst_ns = 0;
+            epoch++;
+        }
+        if (next)
+            next->epoch = epoch;
+        current = next;
+        NUDD_PROBE3(scan__job, epoch.load(), begin, end);
+    }
+    wake.notify_all();
+}
+
+uint64_t nonce_scanner::remaining()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t claimed;
+
+    if (!current)
+        return 0;
+    claimed = current->next.load();
+    return claimed < current->end ? current->end - claimed : 0;
+}
+
+void nonce_scanner::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping)
+            return;
+        stopping = true;
+        current.reset();
+        epoch++;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    consumer_waiting = true;
+    report_ready();
+}
+
+/* Wakes a consumer that found the queue empty; safe from any thread */
+void nonce_scanner::report_ready()
+{
+    if (!consumer_waiting.exchange(false))
+        return;
+#ifdef __linux__
+    uint64_t one = 1;
+#else
+    char one = 1;
+#endif
+    ssize_t written = write(notify_write_fd, &one, sizeof(one));
+    (void)written; /* a full pipe or counter already means readable */
+}
+
+void nonce_scanner::report(found_share const& share)
+{
+    share_count.fetch_add(1, std::memory_order_relaxed);
+    if (!found.push(share)) {
+        drop_count.fetch_add(1, std::memory_order_relaxed);
+        NUDD_PROBE2(scan__share, share.nonce, 1);
+        return;
+    }
+    NUDD_PROBE2(scan__share, share.nonce, 0);
+    report_ready();
+}
+
+bool nonce_scanner::try_share(scan_share& share)
+{
+    std::lock_guard<std::mutex> guard(consuming);
+    found_share next;
+    char buffer[64];
+
+    while (read(notify_read_fd, buffer, sizeof(buffer)) > 0)
+        ;
+    if (!found.pop(next)) {
+        /* Arm before the second look, so a push in between still signals */
+        consumer_waiting = true;
+        if (!found.pop(next))
+            return false;
+    }
+    share.job_id = next.job->id;
+    share.extranonce2 = next.extranonce2;
+    share.extranonce2_size = next.job->extranonce2_size;
+    share.ntime = next.job->ntime;
+    share.nonce = next.nonce;
+    memcpy(share.hash, next.hash, sizeof(share.hash));
+    return true;
+}
+
+bool nonce_scanner::next_share(scan_share& share, int timeout_ms)
+{
+    struct pollfd ready;
+
+    if (try_share(share))
+        return true;
+    ready.fd = notify_read_fd;
+    ready.events = POLLIN;
+    if (poll(&ready, 1, timeout_ms) <= 0)
+        return false;
+    return try_share(share);
+}
+
+/* Records how long this worker took to notice the latest job switch */
+void nonce_scanner::switched()
+{
+    int64_t taken = scan_now_ns() - switch_started_ns.load();
+    int64_t worst = switch_worst_ns.load();
+
+    NUDD_PROBE1(scan__switch, taken);
+    while (taken > worst && !switch_worst_ns.compare_exchange_weak(worst, taken))
+        ;
+}
+
+void nonce_scanner::run()
+{
+    unsigned char header[NUDD_HEADER_SIZE];
+    unsigned char hash[NUDD_HASH_SIZE];
+    unsigned char high[BCRYPT_ITERATED_OUTPUT];
+    std::shared_ptr<slot> work, prepared;
+    uint64_t prepared_extranonce2 = 0;
+
+    /* Headers for SHA256_LANES consecutive extranonce2s, built together */
+    unsigned char rolled[SHA256_LANES][NUDD_HEADER_SIZE];
+    std::shared_ptr<header_roller const> rolled_by;
+    uint64_t rolled_first = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!stopping && (!current || current == work))
+                wake.wait(guard);
+            if (stopping)
+                return;
+            work = current;
+        }
+
+        scan_job const& job = *work->job;
+        bcrypt_cancel const cancel = { &epoch, work->epoch };
+        uint64_t const extranonce2_count = job.extranonce2_count();
+
+        for (;;) {
+            uint64_t position = work->next.fetch_add(SCAN_CHUNK);
+            uint64_t extranonce2 = position >> 32;
+            uint32_t nonce = (uint32_t)position;
+            unsigned int n, chunk = SCAN_CHUNK;
+
+            /* Out of work: wait for the next job or range */
+            if (position >= work->end || extranonce2 >= extranonce2_count)
+                break;
+            if (work->end - position < chunk)
+                chunk = (unsigned int)(work->end - position);
+            NUDD_PROBE2(scan__claim, position, chunk);
+
+            if (prepared != work || prepared_extranonce2 != extranonce2) {
+                prepared.reset();
+                if (rolled_by != work->roller || extranonce2 < rolled_first ||
+                    extranonce2 - rolled_first >= SHA256_LANES) {
+                    rolled_by = work->roller;
+                    rolled_first = extranonce2;
+                    rolled_by->build(extranonce2, SHA256_LANES, rolled[0]);
+                }
+                memcpy(header, rolled[extranonce2 - rolled_first], NUDD_HEADER_SIZE);
+                if (bcrypt_iterated_single(header, SCAN_SPLIT, hash, &cancel)) {
+                    switched();
+                    break;
+                }
+                prepared = work;
+                prepared_extranonce2 = extranonce2;
+            }
+
+            for (n = 0; n < chunk; n++, nonce++) {
+                le32enc(header + 76, nonce);
+                if (epoch.load(std::memory_order_relaxed) != work->epoch ||
+                    bcrypt_iterated_single(header + SCAN_SPLIT,
+                        NUDD_HEADER_SIZE - SCAN_SPLIT, high, &cancel))
+                    break;
+                hash_count.fetch_add(1, std::memory_order_relaxed);
+
+                memcpy(hash + BCRYPT_ITERATED_OUTPUT, high,
+                    NUDD_HASH_SIZE - BCRYPT_ITERATED_OUTPUT);
+                if (!nudd_hash_meets_target((const char *)hash, job.target))
+                    continue;
+
+                found_share share;
+                share.job = work->job;
+                share.extranonce2 = extranonce2;
+                share.nonce = nonce;
+                memcpy(share.hash, hash, sizeof(share.hash));
+                report(share);
+            }
+            if (n < chunk) {
+                switched();
+                break;
+            }
+        }
+    }
+}
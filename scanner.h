@@ -0,0 +1,171 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pow.h"
+#include "ring.h"
+
+class header_roller;
+
+/*
+ * One job template, in the shape a stratum pool hands it out.  All byte
+ * strings are raw (already hex-decoded).  The coinbase is coinb1,
+ * extranonce1, extranonce2 (big-endian, extranonce2_size bytes) and coinb2;
+ * its double SHA-256 folded with merkle_branch gives the merkle root.
+ */
+struct scan_job {
+    std::string id;
+    uint32_t version;
+    unsigned char prevhash[32];
+    std::string coinb1;
+    std::string coinb2;
+    std::string extranonce1;
+    unsigned int extranonce2_size;
+    std::vector<std::string> merkle_branch;
+    uint32_t ntime;
+    uint32_t nbits;
+
+    /* Share target, 32 little-endian bytes */
+    unsigned char target[NUDD_HASH_SIZE];
+
+    /* Number of distinct extranonce2 values, capped at 2^32 */
+    uint64_t extranonce2_count() const;
+};
+
+struct scan_share {
+    std::string job_id;
+    uint64_t extranonce2;
+    unsigned int extranonce2_size;
+    uint32_t ntime;
+    uint32_t nonce;
+    unsigned char hash[NUDD_HASH_SIZE];
+};
+
+/*
+ * Builds the 80-byte header for one extranonce2, with a zero nonce.  The
+ * scanner goes through header_roller instead, which batches this.
+ */
+void scan_build_header(scan_job const& job, uint64_t extranonce2,
+    unsigned char header[NUDD_HEADER_SIZE]);
+
+/*
+ * Searches nonces of the current job on its own threads.
+ *
+ * The nonce sits in the 20-byte suffix that bcrypt_iterated() hashes on its
+ * own, so the 60-byte prefix is hashed once per extranonce2 and every nonce
+ * costs a single bcrypt call.  Workers claim chunks of (extranonce2, nonce)
+ * space from a counter that belongs to the job.
+ *
+ * set_job() bumps a cancellation epoch.  Workers compare it between nonces,
+ * and the Eksblowfish loop compares it once per iteration through
+ * bcrypt_cancel, so in-flight work on the previous job is abandoned within
+ * one iteration rather than one whole hash.
+ */
+class nonce_scanner {
+public:
+    explicit nonce_scanner(unsigned int threads = 0, size_t capacity = 4096);
+    ~nonce_scanner();
+
+    /* Switches all workers to job; NULL leaves them idle */
+    void set_job(std::shared_ptr<scan_job const> job);
+
+    /*
+     * Searches only positions [begin, end) of job, where a position is
+     * extranonce2 << 32 | nonce.  Without cancel the current range is not
+     * abandoned: workers finish claiming it before moving on, which lets a
+     * caller queue the next range as soon as remaining() reaches zero.
+     * Ranges should start on a multiple of 64 so chunks stay aligned.
+     */
+    void set_job(std::shared_ptr<scan_job const> job, uint64_t begin,
+        uint64_t end, bool cancel = true);
+
+    /* Positions of the latest range that no worker has claimed yet */
+    uint64_t remaining();
+
+    /*
+     * Found shares go through a bounded lock-free queue, so reporting never
+     * holds up a hashing thread; when it is full the share is counted in
+     * dropped() instead.  The queue has a single consumer end, so threads
+     * consuming at once take turns on it.
+     */
+
+    /* Waits up to timeout_ms for a share; returns false on timeout or stop */
+    bool next_share(scan_share& share, int timeout_ms);
+
+    /* Non-blocking; when the queue is empty, arms notify_fd() first */
+    bool try_share(scan_share& share);
+
+    /*
+     * Becomes readable when a share arrives after a consumer last found the
+     * queue empty.  The consumer resets it by calling try_share().
+     */
+    int notify_fd() const { return notify_read_fd; }
+
+    void stop();
+
+    uint64_t hashes() const { return hash_count.load(); }
+    uint64_t shares() const { return share_count.load(); }
+    uint64_t dropped() const { return drop_count.load(); }
+
+    /*
+     * Slowest worker's reaction to the latest set_job(), in microseconds:
+     * about one Eksblowfish iteration, plus a scheduler timeslice when
+     * there are more workers than cores.
+     */
+    double switch_latency_us() const { return switch_worst_ns.load() / 1e3; }
+
+private:
+    struct slot {
+        std::shared_ptr<scan_job const> job;
+        std::shared_ptr<header_roller const> roller;
+        unsigned int epoch;
+        std::atomic<uint64_t> next;
+        uint64_t end;
+    };
+
+    struct found_share {
+        std::shared_ptr<scan_job const> job;
+        uint64_t extranonce2;
+        uint32_t nonce;
+        unsigned char hash[NUDD_HASH_SIZE];
+    };
+
+    nonce_scanner(nonce_scanner const&);
+    nonce_scanner& operator=(nonce_scanner const&);
+
+    void run();
+    void switched();
+    void report(found_share const& share);
+    void report_ready();
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::shared_ptr<slot> current;
+    bool stopping;
+
+    std::atomic<unsigned int> epoch;
+    std::atomic<int64_t> switch_started_ns;
+    std::atomic<int64_t> switch_worst_ns;
+
+    std::atomic<uint64_t> hash_count;
+    std::atomic<uint64_t> share_count;
+    std::atomic<uint64_t> drop_count;
+
+    mpsc_ring<found_share> found;
+    std::mutex consuming;
+    std::atomic<bool> consumer_waiting;
+    int notify_read_fd;
+    int notify_write_fd;
+};
+
+#endif
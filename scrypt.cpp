@@ -0,0 +1,439 @@
+#include "scrypt.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "bcrypt.h"
+#include "threadpool.h"
+#include "trace.h"
+
+#define SCRYPT_HUGE_PAGE	((size_t)2 << 20)
+
+scrypt_arena::scrypt_arena()
+    : base(NULL), mapped(0), huge_pages(false)
+{
+}
+
+scrypt_arena::~scrypt_arena()
+{
+    trim(0);
+}
+
+void *scrypt_arena::reserve(size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t rounded;
+    void *memory;
+
+    if (size <= mapped)
+        return base;
+    trim(0);
+
+#ifdef MAP_HUGETLB
+    if (size >= SCRYPT_HUGE_PAGE) {
+        rounded = (size + SCRYPT_HUGE_PAGE - 1) & ~(SCRYPT_HUGE_PAGE - 1);
+        memory = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            base = memory;
+            mapped = rounded;
+            huge_pages = true;
+            return base;
+        }
+    }
+#endif
+
+    rounded = (size + page - 1) & ~(page - 1);
+    memory = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (rounded >= SCRYPT_HUGE_PAGE)
+        madvise(memory, rounded, MADV_HUGEPAGE);
+#endif
+    base = memory;
+    mapped = rounded;
+    huge_pages = false;
+    return base;
+}
+
+void scrypt_arena::trim(size_t keep)
+{
+    if (mapped <= keep)
+        return;
+    munmap(base, mapped);
+    base = NULL;
+    mapped = 0;
+    huge_pages = false;
+}
+
+scrypt_arena& scrypt_thread_arena()
+{
+    static thread_local scrypt_arena arena;
+    return arena;
+}
+
+/*
+ * Salsa20/8 over one 64-byte block.  The SSE2 form keeps the block's
+ * diagonals in four vectors, so every quarter-round step works on four
+ * words at once; blocks are stored with word i at position i * 5 % 16
+ * (SALSA_POSITION) so the diagonals load straight from memory.
+ */
+#ifdef __SSE2__
+#define SALSA_POSITION(i)	((i) * 5 % 16)
+
+#define SALSA_ROTATE_XOR(x, t, bits) \
+    x = _mm_xor_si128(x, _mm_slli_epi32(t, bits)); \
+    x = _mm_xor_si128(x, _mm_srli_epi32(t, 32 - (bits)))
+
+static inline void salsa20_8(uint32_t block[16])
+{
+    __m128i *B = (__m128i *)block;
+    __m128i X0 = B[0], X1 = B[1], X2 = B[2], X3 = B[3], T;
+
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on "columns" */
+        T = _mm_add_epi32(X0, X3);
+        SALSA_ROTATE_XOR(X1, T, 7);
+        T = _mm_add_epi32(X1, X0);
+        SALSA_ROTATE_XOR(X2, T, 9);
+        T = _mm_add_epi32(X2, X1);
+        SALSA_ROTATE_XOR(X3, T, 13);
+        T = _mm_add_epi32(X3, X2);
+        SALSA_ROTATE_XOR(X0, T, 18);
+
+        X1 = _mm_shuffle_epi32(X1, 0x93);
+        X2 = _mm_shuffle_epi32(X2, 0x4e);
+        X3 = _mm_shuffle_epi32(X3, 0x39);
+
+        /* Operate on "rows" */
+        T = _mm_add_epi32(X0, X1);
+        SALSA_ROTATE_XOR(X3, T, 7);
+        T = _mm_add_epi32(X3, X0);
+        SALSA_ROTATE_XOR(X2, T, 9);
+        T = _mm_add_epi32(X2, X3);
+        SALSA_ROTATE_XOR(X1, T, 13);
+        T = _mm_add_epi32(X1, X2);
+        SALSA_ROTATE_XOR(X0, T, 18);
+
+        X1 = _mm_shuffle_epi32(X1, 0x39);
+        X2 = _mm_shuffle_epi32(X2, 0x4e);
+        X3 = _mm_shuffle_epi32(X3, 0x93);
+    }
+    B[0] = _mm_add_epi32(B[0], X0);
+    B[1] = _mm_add_epi32(B[1], X1);
+    B[2] = _mm_add_epi32(B[2], X2);
+    B[3] = _mm_add_epi32(B[3], X3);
+}
+
+static inline void block_xor(uint32_t *dst, const uint32_t *src, size_t words)
+{
+    for (size_t i = 0; i < words; i += 4)
+        _mm_store_si128((__m128i *)(dst + i), _mm_xor_si128(
+            _mm_load_si128((const __m128i *)(dst + i)),
+            _mm_load_si128((const __m128i *)(src + i))));
+}
+#else
+#define SALSA_POSITION(i)	(i)
+
+#define R(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
+
+static inline void salsa20_8(uint32_t B[16])
+{
+    uint32_t x[16];
+    int i;
+
+    memcpy(x, B, sizeof(x));
+    for (i = 0; i < 8; i += 2) {
+        /* Operate on columns */
+        x[ 4] ^= R(x[ 0] + x[12],  7);  x[ 9] ^= R(x[ 5] + x[ 1],  7);
+        x[14] ^= R(x[10] + x[ 6],  7);  x[ 3] ^= R(x[15] + x[11],  7);
+        x[ 8] ^= R(x[ 4] + x[ 0],  9);  x[13] ^= R(x[ 9] + x[ 5],  9);
+        x[ 2] ^= R(x[14] + x[10],  9);  x[ 7] ^= R(x[ 3] + x[15],  9);
+        x[12] ^= R(x[ 8] + x[ 4], 13);  x[ 1] ^= R(x[13] + x[ 9], 13);
+        x[ 6] ^= R(x[ 2] + x[14], 13);  x[11] ^= R(x[ 7] + x[ 3], 13);
+        x[ 0] ^= R(x[12] + x[ 8], 18);  x[ 5] ^= R(x[ 1] + x[13], 18);
+        x[10] ^= R(x[ 6] + x[ 2], 18);  x[15] ^= R(x[11] + x[ 7], 18);
+
+        /* Operate on rows */
+        x[ 1] ^= R(x[ 0] + x[ 3],  7);  x[ 6] ^= R(x[ 5] + x[ 4],  7);
+        x[11] ^= R(x[10] + x[ 9],  7);  x[12] ^= R(x[15] + x[14],  7);
+        x[ 2] ^= R(x[ 1] + x[ 0],  9);  x[ 7] ^= R(x[ 6] + x[ 5],  9);
+        x[ 8] ^= R(x[11] + x[10],  9);  x[13] ^= R(x[12] + x[15],  9);
+        x[ 3] ^= R(x[ 2] + x[ 1], 13);  x[ 4] ^= R(x[ 7] + x[ 6], 13);
+        x[ 9] ^= R(x[ 8] + x[11], 13);  x[14] ^= R(x[13] + x[12], 13);
+        x[ 0] ^= R(x[ 3] + x[ 2], 18);  x[ 5] ^= R(x[ 4] + x[ 7], 18);
+        x[10] ^= R(x[ 9] + x[ 8], 18);  x[15] ^= R(x[14] + x[13], 18);
+    }
+    for (i = 0; i < 16; i++)
+        B[i] += x[i];
+}
+
+#undef R
+
+static inline void block_xor(uint32_t *dst, const uint32_t *src, size_t words)
+{
+    for (size_t i = 0; i < words; i++)
+        dst[i] ^= src[i];
+}
+#endif
+
+/*
+ * BlockMix: out receives the 2r Salsa20/8 outputs, even ones in the first
+ * half and odd ones in the second.  With mix, in ^ mix is what gets
+ * mixed, which saves ROMix's second loop a pass over the block.
+ */
+static void blockmix_salsa8(const uint32_t *in, const uint32_t *mix,
+    uint32_t *out, size_t r)
+{
+    uint32_t X[16] __attribute__((aligned(64)));
+    size_t i;
+
+    memcpy(X, &in[(2 * r - 1) * 16], 64);
+    if (mix)
+        block_xor(X, &mix[(2 * r - 1) * 16], 16);
+    for (i = 0; i < 2 * r; i++) {
+        block_xor(X, &in[i * 16], 16);
+        if (mix)
+            block_xor(X, &mix[i * 16], 16);
+        salsa20_8(X);
+        memcpy(&out[((i & 1) * r + i / 2) * 16], X, 64);
+    }
+}
+
+/* The last block's first 64 bits, the index ROMix jumps by */
+static inline uint64_t integerify(const uint32_t *B, size_t r)
+{
+    const uint32_t *last = &B[(2 * r - 1) * 16];
+
+    return ((uint64_t)last[SALSA_POSITION(1)] << 32) | last[SALSA_POSITION(0)];
+}
+
+/*
+ * ROMix on count lanes of 128 r bytes each, in place, stepped together so
+ * their independent Salsa20/8 chains overlap in the pipeline.  Each lane
+ * keeps only every tmto-th of its N V blocks and rebuilds the others from
+ * the one stored before them when the second loop asks, costing
+ * (tmto - 1) / 2 extra BlockMixes per step on average.  V holds
+ * ceil(N / tmto) blocks per lane, work four per lane; both 64-byte aligned.
+ */
+static void smix(uint8_t *B, size_t count, size_t r, uint64_t N,
+    unsigned int tmto, uint32_t *V, uint32_t *work)
+{
+    size_t words = 32 * r;
+    size_t stored = (N + tmto - 1) / tmto;
+    uint32_t *X[SCRYPT_INTERLEAVE_MAX], *Y[SCRYPT_INTERLEAVE_MAX];
+    uint32_t *Z[SCRYPT_INTERLEAVE_MAX], *W[SCRYPT_INTERLEAVE_MAX];
+    uint64_t i, j;
+    size_t lane, k, w;
+
+    for (lane = 0; lane < count; lane++) {
+        X[lane] = work + 4 * lane * words;
+        Y[lane] = X[lane] + words;
+        Z[lane] = Y[lane] + words;
+        W[lane] = Z[lane] + words;
+        for (k = 0; k < 2 * r; k++)
+            for (w = 0; w < 16; w++)
+                X[lane][k * 16 + w] = le32dec(&B[lane * 4 * words +
+                    (k * 16 + SALSA_POSITION(w)) * 4]);
+    }
+
+    for (i = 0; i < N; i++) {
+        for (lane = 0; lane < count; lane++) {
+            if (i % tmto == 0)
+                memcpy(&V[(lane * stored + i / tmto) * words], X[lane], words * 4);
+            blockmix_salsa8(X[lane], NULL, Y[lane], r);
+            std::swap(X[lane], Y[lane]);
+        }
+    }
+    for (i = 0; i < N; i++) {
+        for (lane = 0; lane < count; lane++) {
+            const uint32_t *V_j;
+            uint64_t missing;
+
+            j = integerify(X[lane], r) & (N - 1);
+            V_j = &V[(lane * stored + j / tmto) * words];
+            if ((missing = j % tmto)) {
+                blockmix_salsa8(V_j, NULL, Z[lane], r);
+                while (--missing) {
+                    blockmix_salsa8(Z[lane], NULL, W[lane], r);
+                    std::swap(Z[lane], W[lane]);
+                }
+                V_j = Z[lane];
+            }
+            blockmix_salsa8(X[lane], V_j, Y[lane], r);
+            std::swap(X[lane], Y[lane]);
+        }
+    }
+
+    for (lane = 0; lane < count; lane++)
+        for (k = 0; k < 2 * r; k++)
+            for (w = 0; w < 16; w++)
+                le32enc(&B[lane * 4 * words + (k * 16 + SALSA_POSITION(w)) * 4],
+                    X[lane][k * 16 + w]);
+}
+
+/* RFC 7914's limits on the parameters, and the tuning's own */
+static bool scrypt_valid(uint64_t N, uint32_t r, uint32_t p, size_t dkLen,
+    unsigned int tmto, unsigned int group)
+{
+    return !(r == 0 || p == 0 || N < 2 || (N & (N - 1)) ||
+        (uint64_t)r * p >= ((uint64_t)1 << 30) ||
+        (r < 4 && N >= ((uint64_t)1 << (16 * r))) ||
+        (uint64_t)dkLen > (((uint64_t)1 << 32) - 1) * 32 ||
+        r > SIZE_MAX / 256 / p || N > SIZE_MAX / 128 / r ||
+        tmto < 1 || tmto > N || group < 1 || group > SCRYPT_INTERLEAVE_MAX);
+}
+
+int scrypt(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
+    size_t saltlen, uint64_t N, uint32_t r, uint32_t p, uint8_t *out,
+    size_t dkLen, thread_pool *pool, scrypt_arena *arena,
+    scrypt_tuning const *tuning)
+{
+    unsigned int tmto = tuning ? tuning->tmto : 1;
+    unsigned int group = tuning ? tuning->interleave : 1;
+    size_t lane_size, v_size, slot_size, slots, groups;
+    uint8_t *B, *memory;
+    std::atomic<uint32_t> next_lane(0);
+
+    if (!scrypt_valid(N, r, p, dkLen, tmto, group)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    lane_size = (size_t)128 * r;
+    v_size = lane_size * ((N + tmto - 1) / tmto);
+    group = std::min<uint32_t>(group, p);
+    groups = (p + group - 1) / group;
+    slots = pool ? std::min<size_t>(groups, pool->size() + 1) : 1;
+    /* Per slot: V, then four working blocks, for each lane of a group */
+    if (v_size > SIZE_MAX / group - 4 * lane_size ||
+        (v_size + 4 * lane_size) * group > (SIZE_MAX - lane_size * p) / slots) {
+        errno = ENOMEM;
+        return -1;
+    }
+    slot_size = (v_size + 4 * lane_size) * group;
+
+    NUDD_PROBE3(scrypt__entry, N, r, p);
+    memory = (uint8_t *)(arena ? arena : &scrypt_thread_arena())->reserve(
+        lane_size * p + slot_size * slots);
+    if (!memory) {
+        NUDD_PROBE2(scrypt__return, N, 1);
+        errno = ENOMEM;
+        return -1;
+    }
+    B = memory + slot_size * slots;
+
+    PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, 1, B, lane_size * p);
+
+    /* Each slot takes groups of lanes until none are left */
+    std::function<void(size_t)> lanes = [&](size_t slot) {
+        uint32_t *V = (uint32_t *)(memory + slot * slot_size);
+        uint32_t *work = (uint32_t *)((uint8_t *)V + v_size * group);
+        uint32_t lane;
+
+        while ((lane = next_lane.fetch_add(group)) < p) {
+            unsigned long long started = NUDD_TRACE_START(scrypt__lane);
+            smix(&B[lane * lane_size], std::min<uint32_t>(group, p - lane),
+                r, N, tmto, V, work);
+            NUDD_PROBE_ELAPSED(scrypt__lane, lane, started);
+        }
+    };
+    if (slots > 1)
+        pool->parallel_for(slots, lanes);
+    else
+        lanes(0);
+
+    PBKDF2_SHA256(passwd, passwdlen, B, lane_size * p, 1, out, dkLen);
+
+    memset(B, 0, lane_size * p);
+    if (!arena)
+        scrypt_thread_arena().trim(SCRYPT_ARENA_KEEP);
+    NUDD_PROBE2(scrypt__return, N, 0);
+    return 0;
+}
+
+int scrypt_batch(const uint8_t *inputs, size_t length, size_t count,
+    uint64_t N, uint32_t r, uint8_t *out, size_t dkLen,
+    thread_pool *pool, scrypt_arena *arena, scrypt_tuning const *tuning)
+{
+    unsigned int tmto = tuning ? tuning->tmto : 1;
+    unsigned int group = tuning ? tuning->interleave : 1;
+    size_t lane_size, v_size, slot_size, slots, groups;
+    uint8_t *memory;
+    std::atomic<size_t> next_input(0);
+
+    if (!scrypt_valid(N, r, 1, dkLen, tmto, group)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!count)
+        return 0;
+
+    lane_size = (size_t)128 * r;
+    v_size = lane_size * ((N + tmto - 1) / tmto);
+    group = (unsigned int)std::min<size_t>(group, count);
+    groups = (count + group - 1) / group;
+    slots = pool ? std::min<size_t>(groups, pool->size() + 1) : 1;
+    /* Per slot: V, then four working blocks and B, for each lane of a group */
+    if (v_size > SIZE_MAX / group - 5 * lane_size ||
+        (v_size + 5 * lane_size) * group > SIZE_MAX / slots) {
+        errno = ENOMEM;
+        return -1;
+    }
+    slot_size = (v_size + 5 * lane_size) * group;
+
+    NUDD_PROBE3(scrypt__entry, N, r, count);
+    memory = (uint8_t *)(arena ? arena : &scrypt_thread_arena())->reserve(
+        slot_size * slots);
+    if (!memory) {
+        NUDD_PROBE2(scrypt__return, N, 1);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* Each slot takes groups of inputs until none are left */
+    std::function<void(size_t)> lanes = [&](size_t slot) {
+        uint32_t *V = (uint32_t *)(memory + slot * slot_size);
+        uint32_t *work = (uint32_t *)((uint8_t *)V + v_size * group);
+        uint8_t *B = (uint8_t *)(work) + 4 * lane_size * group;
+        size_t first, lane, width;
+
+        while ((first = next_input.fetch_add(group)) < count) {
+            unsigned long long started = NUDD_TRACE_START(scrypt__lane);
+            width = std::min<size_t>(group, count - first);
+            for (lane = 0; lane < width; lane++) {
+                const uint8_t *in = inputs + (first + lane) * length;
+                PBKDF2_SHA256(in, length, in, length, 1,
+                    &B[lane * lane_size], lane_size);
+            }
+            smix(B, width, r, N, tmto, V, work);
+            for (lane = 0; lane < width; lane++) {
+                const uint8_t *in = inputs + (first + lane) * length;
+                PBKDF2_SHA256(in, length, &B[lane * lane_size], lane_size, 1,
+                    out + (first + lane) * dkLen, dkLen);
+            }
+            NUDD_PROBE_ELAPSED(scrypt__lane, first, started);
+        }
+        memset(B, 0, lane_size * group);
+    };
+    if (slots > 1)
+        pool->parallel_for(slots, lanes);
+    else
+        lanes(0);
+
+    if (!arena)
+        scrypt_thread_arena().trim(SCRYPT_ARENA_KEEP);
+    NUDD_PROBE2(scrypt__return, N, 0);
+    return 0;
+}
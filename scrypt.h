@@ -0,0 +1,89 @@
+#ifndef NUDD_SCRYPT_H
+#define NUDD_SCRYPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class thread_pool;
+
+/*
+ * Scratch memory for scrypt's V arrays, kept from one call to the next so
+ * a steady stream of hashes does not map and fault in fresh pages every
+ * time.  Requests of a huge page or more come from MAP_HUGETLB when the
+ * host has huge pages reserved, and are advised MADV_HUGEPAGE otherwise.
+ */
+class scrypt_arena {
+public:
+    scrypt_arena();
+    ~scrypt_arena();
+
+    /* At least size bytes, page aligned; valid until the next reserve() or trim() */
+    void *reserve(size_t size);
+
+    /* Unmaps the memory if more than keep bytes are held */
+    void trim(size_t keep = 0);
+
+    size_t size() const { return mapped; }
+    bool huge() const { return huge_pages; }
+
+private:
+    scrypt_arena(scrypt_arena const&);
+    scrypt_arena& operator=(scrypt_arena const&);
+
+    void *base;
+    size_t mapped;
+    bool huge_pages;
+};
+
+/* What scrypt() keeps mapped in a thread's own arena between calls */
+#define SCRYPT_ARENA_KEEP	(64 << 20)
+
+/* The calling thread's arena */
+scrypt_arena& scrypt_thread_arena();
+
+/*
+ * How scrypt() lays out its work; the result does not depend on it.
+ *
+ * tmto: keep only every tmto-th V block and recompute the others when they
+ * are read, trading (tmto - 1) / 2 extra BlockMixes per step of ROMix's
+ * second loop for 1 / tmto of the memory.
+ *
+ * interleave: lanes one thread steps through ROMix together, up to
+ * SCRYPT_INTERLEAVE_MAX.  With a small enough V per lane several fit in
+ * L2 at once and hide each other's latency.
+ */
+struct scrypt_tuning {
+    unsigned int tmto;
+    unsigned int interleave;
+};
+
+#define SCRYPT_INTERLEAVE_MAX	16
+
+/*
+ * scrypt(passwd, salt, N, r, p) as in RFC 7914, writing dkLen bytes to out.
+ * N must be a power of two greater than 1 and below 2^(16 r), and r * p
+ * below 2^30.  The p lanes are independent; given a pool they run on it,
+ * with as many V arrays as lanes can run at once, all carved from arena
+ * (by default the calling thread's, trimmed to SCRYPT_ARENA_KEEP after).
+ * tuning defaults to { 1, 1 }.  Returns 0, or -1 with errno EINVAL for bad
+ * parameters or ENOMEM.
+ */
+int scrypt(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
+    size_t saltlen, uint64_t N, uint32_t r, uint32_t p, uint8_t *out,
+    size_t dkLen, thread_pool *pool = NULL, scrypt_arena *arena = NULL,
+    scrypt_tuning const *tuning = NULL);
+
+/*
+ * scrypt(in, in, N, r, 1) of count inputs of length bytes each, laid end
+ * to end, writing dkLen bytes per input to out.  scrypt()'s interleave can
+ * only group the p lanes of one hash, which a proof of work with p = 1
+ * never has; here tuning->interleave different inputs step through ROMix
+ * together instead.  Groups of inputs run on pool if given.  Returns as
+ * scrypt().
+ */
+int scrypt_batch(const uint8_t *inputs, size_t length, size_t count,
+    uint64_t N, uint32_t r, uint8_t *out, size_t dkLen,
+    thread_pool *pool = NULL, scrypt_arena *arena = NULL,
+    scrypt_tuning const *tuning = NULL);
+
+#endif
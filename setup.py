@@ -2,7 +2,27 @@ from distutils.core import setup, Extension
 
 nudd_hash_module = Extension('nudd_hash',
                                sources = ['nuddmodule.cpp',
-                                          'bcrypt.cpp'])
+                                          'algorithms.cpp',
+                                          'bcrypt.cpp',
+                                          'bench.cpp',
+                                          'credstore.cpp',
+                                          'perf.cpp',
+                                          'pow.cpp',
+                                          'prefilter.cpp',
+                                          'threadpool.cpp',
+                                          'json.cpp',
+                                          'lease.cpp',
+                                          'radix64.cpp',
+                                          'roller.cpp',
+                                          'scanner.cpp',
+                                          'scrypt.cpp',
+                                          'sha256.cpp',
+                                          'shareserver.cpp',
+                                          'stratum.cpp',
+                                          'tune.cpp',
+                                          'vardiff.cpp'],
+                               extra_compile_args = ['-pthread'],
+                               extra_link_args = ['-pthread'])
 
 setup (name = 'nudd_hashs',
        version = '1.0',
@@ -0,0 +1,176 @@
+#include "sha256.h"
+
+#include <string.h>
+
+const uint32_t sha256_initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)	(((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x)		(ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define S1(x)		(ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define s0(x)		(ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define s1(x)		(ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static inline uint32_t be32dec(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+        ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void be32enc(unsigned char *p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+void sha256_transform(uint32_t state[8], const unsigned char block[SHA256_BLOCK_SIZE])
+{
+    uint32_t w[64], s[8], t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = be32dec(block + 4 * i);
+    for (; i < 64; i++)
+        w[i] = s1(w[i - 2]) + w[i - 7] + s0(w[i - 15]) + w[i - 16];
+
+    memcpy(s, state, sizeof(s));
+    for (i = 0; i < 64; i++) {
+        t1 = s[7] + S1(s[4]) + CH(s[4], s[5], s[6]) + sha256_k[i] + w[i];
+        t2 = S0(s[0]) + MAJ(s[0], s[1], s[2]);
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = s[3] + t1;
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)
+        state[i] += s[i];
+}
+
+/* One round across all lanes; callers rotate the roles of a..h */
+#define ROUND_LANES(a, b, c, d, e, f, g, h, i) \
+    for (l = 0; l < SHA256_LANES; l++) { \
+        uint32_t t1 = h[l] + S1(e[l]) + CH(e[l], f[l], g[l]) + sha256_k[i] + w[i][l]; \
+        d[l] += t1; \
+        h[l] = t1 + S0(a[l]) + MAJ(a[l], b[l], c[l]); \
+    }
+
+/* The lane loops widen to 256-bit vectors where the CPU has them */
+#if defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+__attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+void sha256_transform_lanes(uint32_t state[8][SHA256_LANES],
+    const uint32_t words[16][SHA256_LANES])
+{
+    uint32_t w[64][SHA256_LANES], s[8][SHA256_LANES];
+    int i, l;
+
+    memcpy(w, words, 16 * sizeof(w[0]));
+    for (i = 16; i < 64; i++)
+        for (l = 0; l < SHA256_LANES; l++)
+            w[i][l] = s1(w[i - 2][l]) + w[i - 7][l] + s0(w[i - 15][l]) + w[i - 16][l];
+
+    memcpy(s, state, sizeof(s));
+    for (i = 0; i < 64; i += 8) {
+        ROUND_LANES(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], i);
+        ROUND_LANES(s[7], s[0], s[1], s[2], s[3], s[4], s[5], s[6], i + 1);
+        ROUND_LANES(s[6], s[7], s[0], s[1], s[2], s[3], s[4], s[5], i + 2);
+        ROUND_LANES(s[5], s[6], s[7], s[0], s[1], s[2], s[3], s[4], i + 3);
+        ROUND_LANES(s[4], s[5], s[6], s[7], s[0], s[1], s[2], s[3], i + 4);
+        ROUND_LANES(s[3], s[4], s[5], s[6], s[7], s[0], s[1], s[2], i + 5);
+        ROUND_LANES(s[2], s[3], s[4], s[5], s[6], s[7], s[0], s[1], i + 6);
+        ROUND_LANES(s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[0], i + 7);
+    }
+    for (i = 0; i < 8; i++)
+        for (l = 0; l < SHA256_LANES; l++)
+            state[i][l] += s[i][l];
+}
+
+void sha256_init(sha256_ctx *ctx)
+{
+    memcpy(ctx->state, sha256_initial_state, sizeof(ctx->state));
+    ctx->length = 0;
+}
+
+void sha256_update(sha256_ctx *ctx, const void *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t used = ctx->length % SHA256_BLOCK_SIZE;
+
+    ctx->length += length;
+    if (used) {
+        size_t take = SHA256_BLOCK_SIZE - used < length ? SHA256_BLOCK_SIZE - used : length;
+        memcpy(ctx->buffer + used, p, take);
+        p += take;
+        length -= take;
+        if (used + take < SHA256_BLOCK_SIZE)
+            return;
+        sha256_transform(ctx->state, ctx->buffer);
+    }
+    for (; length >= SHA256_BLOCK_SIZE; p += SHA256_BLOCK_SIZE, length -= SHA256_BLOCK_SIZE)
+        sha256_transform(ctx->state, p);
+    memcpy(ctx->buffer, p, length);
+}
+
+void sha256_final(sha256_ctx *ctx, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    size_t used = ctx->length % SHA256_BLOCK_SIZE;
+    uint64_t bits = ctx->length * 8;
+    int i;
+
+    ctx->buffer[used++] = 0x80;
+    if (used > SHA256_BLOCK_SIZE - 8) {
+        memset(ctx->buffer + used, 0, SHA256_BLOCK_SIZE - used);
+        sha256_transform(ctx->state, ctx->buffer);
+        used = 0;
+    }
+    memset(ctx->buffer + used, 0, SHA256_BLOCK_SIZE - 8 - used);
+    be32enc(ctx->buffer + 56, (uint32_t)(bits >> 32));
+    be32enc(ctx->buffer + 60, (uint32_t)bits);
+    sha256_transform(ctx->state, ctx->buffer);
+
+    for (i = 0; i < 8; i++)
+        be32enc(digest + 4 * i, ctx->state[i]);
+}
+
+void sha256(const void *data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    sha256_ctx ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, length);
+    sha256_final(&ctx, digest);
+}
+
+void sha256d(const void *data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    unsigned char once[SHA256_DIGEST_SIZE];
+
+    sha256(data, length, once);
+    sha256(once, sizeof(once), digest);
+}
@@ -0,0 +1,43 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_BLOCK_SIZE	64
+#define SHA256_DIGEST_SIZE	32
+
+/*
+ * Lanes per multi-buffer call.  The lane loops are plain C++ over arrays
+ * laid out word-major, so the compiler can keep one 32-bit word of every
+ * lane in a single vector register.
+ */
+#define SHA256_LANES		8
+
+struct sha256_ctx {
+    uint32_t state[8];
+    unsigned char buffer[SHA256_BLOCK_SIZE];
+    uint64_t length;
+};
+
+void sha256_init(sha256_ctx *ctx);
+void sha256_update(sha256_ctx *ctx, const void *data, size_t length);
+void sha256_final(sha256_ctx *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+void sha256(const void *data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE]);
+void sha256d(const void *data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/* The state a fresh context starts from */
+extern const uint32_t sha256_initial_state[8];
+
+/* One compression of a 64-byte block into state */
+void sha256_transform(uint32_t state[8], const unsigned char block[SHA256_BLOCK_SIZE]);
+
+/*
+ * One compression per lane.  state[i][lane] is word i of that lane's
+ * state; words[i][lane] is big-endian word i of its block.
+ */
+void sha256_transform_lanes(uint32_t state[8][SHA256_LANES],
+    const uint32_t words[16][SHA256_LANES]);
+
+#endif
@@ -0,0 +1,460 @@
+#include "shareserver.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "bcrypt.h"
+#include "stratum.h"
+#include "threadpool.h"
+
+/* How long shares mined at a worker's previous target are still taken */
+#define SHARE_RETARGET_GRACE_US	10000000
+
+static int64_t share_now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+share_server::share_server(std::string const& path, size_t max_batch,
+    unsigned int max_wait_us, size_t dedup_window)
+    : path(path), max_batch(max_batch ? max_batch : 1), max_wait_us(max_wait_us),
+      dedup_window(dedup_window), listen_fd(-1), running(false), budget(0),
+      next_serial(0), pending_since_us(0), budget_tokens(0),
+      budget_refilled_us(0), received(0), accepted(0), rejected(0),
+      duplicates(0), unknown_workers(0), batches(0), connections(0),
+      retargets(0), over_budget(0)
+{
+    wake_fds[0] = wake_fds[1] = -1;
+}
+
+share_server::~share_server()
+{
+    stop();
+}
+
+bool share_server::start()
+{
+    struct sockaddr_un address;
+
+    if (running)
+        return true;
+    if (path.size() >= sizeof(address.sun_path)) {
+        last_error = "socket path too long";
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        last_error = strerror(errno);
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) ||
+        listen(listen_fd, 64) || pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC)) {
+        last_error = strerror(errno);
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+
+    /* The bucket starts full */
+    budget_tokens = std::max(budget, 1.0);
+    budget_refilled_us = share_now_us();
+    running = true;
+    server = std::thread(&share_server::run, this);
+    return true;
+}
+
+void share_server::stop()
+{
+    if (!running.exchange(false))
+        return;
+    char one = 1;
+    ssize_t written = write(wake_fds[1], &one, 1);
+    (void)written;
+    server.join();
+
+    for (size_t i = 0; i < clients.size(); i++)
+        close(clients[i].fd);
+    clients.clear();
+    pending.clear();
+    close(listen_fd);
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    listen_fd = wake_fds[0] = wake_fds[1] = -1;
+    unlink(path.c_str());
+}
+
+void share_server::set_worker_target(uint32_t worker,
+    const unsigned char target[NUDD_HASH_SIZE])
+{
+    std::lock_guard<std::mutex> guard(workers_lock);
+    worker_target& entry = workers[worker];
+
+    entry.target.assign((const char *)target, NUDD_HASH_SIZE);
+    entry.previous.clear();
+    entry.previous_until_us = 0;
+    if (controller)
+        controller->set_workers(workers.size());
+}
+
+void share_server::remove_worker(uint32_t worker)
+{
+    std::lock_guard<std::mutex> guard(workers_lock);
+    workers.erase(worker);
+    changed.erase(worker);
+    if (controller) {
+        controller->remove_worker(worker);
+        controller->set_workers(workers.size());
+    }
+}
+
+void share_server::set_worker_difficulty(uint32_t worker, double difficulty)
+{
+    unsigned char target[NUDD_HASH_SIZE];
+
+    {
+        std::lock_guard<std::mutex> guard(workers_lock);
+        if (controller)
+            difficulty = controller->add_worker(worker, difficulty,
+                share_now_us());
+    }
+    stratum_target_from_difficulty(difficulty, target);
+    set_worker_target(worker, target);
+}
+
+bool share_server::enable_vardiff(vardiff_config const& config)
+{
+    std::lock_guard<std::mutex> guard(workers_lock);
+
+    if (running) {
+        last_error = "vardiff cannot be changed while the server is running";
+        return false;
+    }
+    controller.reset(new vardiff_controller(config));
+    controller->set_workers(workers.size());
+    budget = config.budget;
+    return true;
+}
+
+void share_server::difficulty_changes(
+    std::vector<std::pair<uint32_t, double> >& changes)
+{
+    std::lock_guard<std::mutex> guard(workers_lock);
+
+    changes.assign(changed.begin(), changed.end());
+    changed.clear();
+}
+
+share_server_stats share_server::stats() const
+{
+    share_server_stats stats;
+
+    stats.received = received;
+    stats.accepted = accepted;
+    stats.rejected = rejected;
+    stats.duplicates = duplicates;
+    stats.unknown_workers = unknown_workers;
+    stats.batches = batches;
+    stats.connections = connections;
+    stats.retargets = retargets;
+    stats.over_budget = over_budget;
+    return stats;
+}
+
+void share_server::run()
+{
+    std::vector<struct pollfd> fds;
+
+    while (running) {
+        struct timespec timeout, *wait = NULL;
+
+        fds.resize(2 + clients.size());
+        fds[0].fd = listen_fd;
+        fds[1].fd = wake_fds[0];
+        for (size_t i = 0; i < clients.size(); i++) {
+            fds[2 + i].fd = clients[i].fd;
+            fds[2 + i].events = POLLIN | (clients[i].output.empty() ? 0 : POLLOUT);
+        }
+        fds[0].events = fds[1].events = POLLIN;
+
+        if (!pending.empty()) {
+            int64_t left = pending_since_us + max_wait_us - share_now_us();
+            if (left < 0)
+                left = 0;
+            timeout.tv_sec = left / 1000000;
+            timeout.tv_nsec = (left % 1000000) * 1000;
+            wait = &timeout;
+        }
+        if (ppoll(&fds[0], fds.size(), wait, NULL) < 0 && errno != EINTR)
+            break;
+
+        if (fds[1].revents) {
+            char buffer[64];
+            while (read(wake_fds[0], buffer, sizeof(buffer)) > 0)
+                ;
+        }
+        if (fds[0].revents)
+            accept_connections();
+
+        /* accept_connections() only appends, so indices still line up */
+        for (size_t i = 0; i + 2 < fds.size(); i++) {
+            if ((fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                !read_connection(clients[i])) {
+                close(clients[i].fd);
+                clients[i].fd = -1;
+            }
+        }
+
+        if (!pending.empty() &&
+            share_now_us() - pending_since_us >= (int64_t)max_wait_us)
+            flush();
+
+        for (size_t i = 0; i < clients.size(); ) {
+            if (clients[i].fd >= 0 && !clients[i].output.empty() &&
+                !write_connection(clients[i])) {
+                close(clients[i].fd);
+                clients[i].fd = -1;
+            }
+            if (clients[i].fd < 0)
+                clients.erase(clients.begin() + i);
+            else
+                i++;
+        }
+    }
+}
+
+void share_server::accept_connections()
+{
+    int fd;
+
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        connection client;
+        client.serial = next_serial++;
+        client.fd = fd;
+        clients.push_back(client);
+        connections++;
+    }
+}
+
+bool share_server::read_connection(connection& client)
+{
+    char buffer[SHARE_REQUEST_SIZE * 256];
+    size_t used = 0;
+
+    for (;;) {
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+            return false;
+        client.input.append(buffer, n);
+
+        for (used = 0; client.input.size() - used >= SHARE_REQUEST_SIZE;
+             used += SHARE_REQUEST_SIZE)
+            receive(client, client.input.data() + used);
+        client.input.erase(0, used);
+    }
+    return true;
+}
+
+bool share_server::write_connection(connection& client)
+{
+    while (!client.output.empty()) {
+        ssize_t n = send(client.fd, client.output.data(), client.output.size(),
+            MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (n <= 0)
+            return false;
+        client.output.erase(0, n);
+    }
+    return true;
+}
+
+bool share_server::seen(const char *header) const
+{
+    std::string key(header, NUDD_HEADER_SIZE);
+
+    return recent[0].count(key) || recent[1].count(key);
+}
+
+/* Remembers between dedup_window / 2 and dedup_window recent headers */
+void share_server::remember(const char *header)
+{
+    recent[0].insert(std::string(header, NUDD_HEADER_SIZE));
+    if (recent[0].size() >= dedup_window / 2) {
+        recent[1].swap(recent[0]);
+        recent[0].clear();
+    }
+}
+
+/* Takes a token for one share, if the budget has one */
+bool share_server::within_budget(int64_t now)
+{
+    if (budget <= 0)
+        return true;
+    budget_tokens = std::min(std::max(budget, 1.0),
+        budget_tokens + (now - budget_refilled_us) * budget / 1e6);
+    budget_refilled_us = now;
+    if (budget_tokens < 1)
+        return false;
+    budget_tokens -= 1;
+    return true;
+}
+
+void share_server::receive(connection& client, const char *record)
+{
+    pending_share share;
+    int64_t now = share_now_us();
+    double difficulty;
+    bool known, retargeted;
+
+    share.connection = client.serial;
+    share.id = le32dec(record) | (uint64_t)le32dec(record + 4) << 32;
+    share.worker = le32dec(record + 8);
+    memcpy(share.header, record + 16, NUDD_HEADER_SIZE);
+    received++;
+    {
+        std::lock_guard<std::mutex> guard(workers_lock);
+        std::map<uint32_t, worker_target>::const_iterator worker =
+            workers.find(share.worker);
+        known = worker != workers.end();
+        if (known) {
+            /* Targets are little-endian numbers; the larger is the easier */
+            std::string const& previous = worker->second.previous;
+            bool grace = now < worker->second.previous_until_us &&
+                !nudd_hash_meets_target(previous.data(),
+                    (const unsigned char *)worker->second.target.data());
+            memcpy(share.target, grace ? previous.data() :
+                worker->second.target.data(), NUDD_HASH_SIZE);
+        }
+    }
+
+    if (!known) {
+        unknown_workers++;
+        verdict(share.connection, share.id, share.worker,
+            share_unknown_worker, NULL);
+        return;
+    }
+    if (seen(share.header)) {
+        duplicates++;
+        verdict(share.connection, share.id, share.worker, share_duplicate, NULL);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(workers_lock);
+        retargeted = controller &&
+            controller->record_share(share.worker, now, &difficulty);
+    }
+    if (retargeted)
+        retarget(share.worker, difficulty, now);
+
+    /*
+     * Counted above all the same, so vardiff sees the worker's full rate;
+     * not remembered, so the miner may submit the share again
+     */
+    if (!within_budget(now)) {
+        over_budget++;
+        verdict(share.connection, share.id, share.worker, share_over_budget,
+            NULL);
+        return;
+    }
+
+    remember(share.header);
+    if (pending.empty())
+        pending_since_us = now;
+    pending.push_back(share);
+    if (pending.size() >= max_batch)
+        flush();
+}
+
+void share_server::retarget(uint32_t worker, double difficulty, int64_t now)
+{
+    unsigned char target[NUDD_HASH_SIZE];
+    std::lock_guard<std::mutex> guard(workers_lock);
+    std::map<uint32_t, worker_target>::iterator found = workers.find(worker);
+
+    if (found == workers.end())
+        return;
+    worker_target& entry = found->second;
+
+    /* Back-to-back retargets keep the easiest target still in its grace */
+    if (now >= entry.previous_until_us ||
+        nudd_hash_meets_target(entry.previous.data(),
+            (const unsigned char *)entry.target.data()))
+        entry.previous = entry.target;
+    stratum_target_from_difficulty(difficulty, target);
+    entry.target.assign((const char *)target, NUDD_HASH_SIZE);
+    entry.previous_until_us = now + SHARE_RETARGET_GRACE_US;
+    changed[worker] = difficulty;
+    retargets++;
+}
+
+void share_server::verdict(uint64_t serial, uint64_t id, uint32_t worker,
+    share_status status, const char *hash)
+{
+    unsigned char record[SHARE_VERDICT_SIZE];
+
+    memset(record, 0, sizeof(record));
+    le32enc(record, (uint32_t)id);
+    le32enc(record + 4, (uint32_t)(id >> 32));
+    le32enc(record + 8, worker);
+    record[12] = status;
+    if (hash)
+        memcpy(record + 16, hash, NUDD_HASH_SIZE);
+
+    /* The share's connection may have gone away while it was queued */
+    for (size_t i = 0; i < clients.size(); i++) {
+        if (clients[i].serial == serial) {
+            if (clients[i].fd >= 0)
+                clients[i].output.append((const char *)record, sizeof(record));
+            return;
+        }
+    }
+}
+
+void share_server::flush()
+{
+    size_t count = pending.size();
+    std::string headers(count * NUDD_HEADER_SIZE, '\0');
+    std::string targets(count * NUDD_HASH_SIZE, '\0');
+    std::string hashes(count * NUDD_HASH_SIZE, '\0');
+    std::vector<unsigned char> valid(count);
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&headers[i * NUDD_HEADER_SIZE], pending[i].header, NUDD_HEADER_SIZE);
+        memcpy(&targets[i * NUDD_HASH_SIZE], pending[i].target, NUDD_HASH_SIZE);
+    }
+    nudd_check_targets_batch(headers.data(),
+        (const unsigned char *)targets.data(), count, &valid[0], &hashes[0],
+        hashing_pool());
+    batches++;
+
+    for (size_t i = 0; i < count; i++) {
+        if (valid[i])
+            accepted++;
+        else
+            rejected++;
+        verdict(pending[i].connection, pending[i].id, pending[i].worker,
+            valid[i] ? share_accepted : share_low_difficulty,
+            valid[i] ? &hashes[i * NUDD_HASH_SIZE] : NULL);
+    }
+    pending.clear();
+}
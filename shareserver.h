@@ -0,0 +1,177 @@
+#ifndef SHARESERVER_H
+#define SHARESERVER_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "pow.h"
+#include "vardiff.h"
+
+/*
+ * Pool-side share validation over a Unix stream socket.  Both directions
+ * are fixed-size little-endian records:
+ *
+ *   request  (96 bytes): u64 id, u32 worker, u32 reserved, header[80]
+ *   verdict  (48 bytes): u64 id, u32 worker, u8 status, 3 zero bytes,
+ *                        hash[32] (zero unless the share was accepted)
+ *
+ * Duplicates and unknown workers are answered straight away.  Everything
+ * else is queued and hashed on the shared pool in batches of up to
+ * max_batch shares; a partial batch is flushed once its oldest share has
+ * waited max_wait_us, which bounds verdict latency to roughly max_wait_us
+ * plus one batch of hashing.
+ *
+ * With vardiff enabled, every share that gets as far as the queue is
+ * counted against its worker, accepted or not, since each costs a hash to
+ * validate; a retarget replaces the worker's target at once, keeps
+ * accepting shares at the old target for a short grace period (those
+ * already mined at it), and is queued for the pool to send on as
+ * mining.set_difficulty.
+ *
+ * A vardiff budget is also enforced directly: a token bucket refilled at
+ * budget shares per second, holding at most a second's worth, admits
+ * shares to the queue, and shares arriving with it empty are answered
+ * share_over_budget without being hashed.  Retargeting brings senders
+ * back under the budget, but the bucket bounds validation work while it
+ * catches up, such as when many workers connect at once.
+ */
+#define SHARE_REQUEST_SIZE	96
+#define SHARE_VERDICT_SIZE	48
+
+enum share_status {
+    share_accepted = 0,
+    share_low_difficulty = 1,
+    share_duplicate = 2,
+    share_unknown_worker = 3,
+    share_over_budget = 4
+};
+
+struct share_server_stats {
+    uint64_t received;
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t duplicates;
+    uint64_t unknown_workers;
+    uint64_t batches;
+    uint64_t connections;
+    uint64_t retargets;
+    uint64_t over_budget;
+};
+
+class share_server {
+public:
+    share_server(std::string const& path, size_t max_batch,
+        unsigned int max_wait_us, size_t dedup_window = 1 << 20);
+    ~share_server();
+
+    /* Binds the socket and starts serving; returns false with error() set */
+    bool start();
+    void stop();
+
+    /* Shares from workers without a target are answered share_unknown_worker */
+    void set_worker_target(uint32_t worker, const unsigned char target[NUDD_HASH_SIZE]);
+    void remove_worker(uint32_t worker);
+
+    /* Sets a worker's target from a pool difficulty, handing it to vardiff */
+    void set_worker_difficulty(uint32_t worker, double difficulty);
+
+    /*
+     * Replaces any previous controller, so only while stopped; returns
+     * false with error() set if the server is running
+     */
+    bool enable_vardiff(vardiff_config const& config);
+
+    /* Valid until the next enable_vardiff() */
+    vardiff_controller const *vardiff() const { return controller.get(); }
+
+    /* Moves out the (worker, difficulty) retargets since the last call */
+    void difficulty_changes(std::vector<std::pair<uint32_t, double> >& changes);
+
+    std::string const& error() const { return last_error; }
+    share_server_stats stats() const;
+
+private:
+    struct connection {
+        uint64_t serial;
+        int fd;
+        std::string input;
+        std::string output;
+    };
+
+    struct worker_target {
+        std::string target;
+        std::string previous;
+        int64_t previous_until_us;
+    };
+
+    struct pending_share {
+        uint64_t connection;
+        uint64_t id;
+        uint32_t worker;
+        unsigned char target[NUDD_HASH_SIZE];
+        char header[NUDD_HEADER_SIZE];
+    };
+
+    share_server(share_server const&);
+    share_server& operator=(share_server const&);
+
+    void run();
+    void accept_connections();
+    bool read_connection(connection& client);
+    bool write_connection(connection& client);
+    void receive(connection& client, const char *record);
+    bool seen(const char *header) const;
+    void remember(const char *header);
+    bool within_budget(int64_t now);
+    void retarget(uint32_t worker, double difficulty, int64_t now);
+    void verdict(uint64_t serial, uint64_t id, uint32_t worker,
+        share_status status, const char *hash);
+    void flush();
+
+    std::string path;
+    size_t max_batch;
+    unsigned int max_wait_us;
+    size_t dedup_window;
+
+    int listen_fd;
+    int wake_fds[2];
+    std::thread server;
+    std::atomic<bool> running;
+    std::string last_error;
+
+    /* Also guards every use of controller from the server thread */
+    std::mutex workers_lock;
+    std::map<uint32_t, worker_target> workers;
+    std::unique_ptr<vardiff_controller> controller;
+    std::map<uint32_t, double> changed;
+    double budget;
+
+    /* Owned by the server thread */
+    std::vector<connection> clients;
+    uint64_t next_serial;
+    std::vector<pending_share> pending;
+    int64_t pending_since_us;
+    std::unordered_set<std::string> recent[2];
+    double budget_tokens;
+    int64_t budget_refilled_us;
+
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> duplicates;
+    std::atomic<uint64_t> unknown_workers;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> connections;
+    std::atomic<uint64_t> retargets;
+    std::atomic<uint64_t> over_budget;
+};
+
+#endif
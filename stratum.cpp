@@ -0,0 +1,338 @@
+#include "stratum.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "json.h"
+
+/* Request ids below this are the handshake; submits count up from it */
+#define STRATUM_FIRST_SUBMIT	3
+
+/* A pool sending more than this without a newline is dropped */
+#define STRATUM_MAX_LINE	(256 * 1024)
+
+static bool hex_word(json_value const& value, uint32_t& out)
+{
+    std::string raw;
+
+    if (value.type != json_value::string_value ||
+        !json_unhex(value.string, raw) || raw.size() != 4)
+        return false;
+    out = ((uint32_t)(unsigned char)raw[0] << 24) |
+        ((uint32_t)(unsigned char)raw[1] << 16) |
+        ((uint32_t)(unsigned char)raw[2] << 8) | (unsigned char)raw[3];
+    return true;
+}
+
+bool stratum_extranonce2_size(json_value const& value, unsigned int& size)
+{
+    if (value.type != json_value::number_value ||
+        !(value.number >= 0 && value.number <= 8) ||
+        value.number != floor(value.number))
+        return false;
+    size = (unsigned int)value.number;
+    return true;
+}
+
+void stratum_target_from_difficulty(double difficulty,
+    unsigned char target[NUDD_HASH_SIZE])
+{
+    int exponent, shift, low, i;
+    uint64_t bits;
+
+    memset(target, 0xff, NUDD_HASH_SIZE);
+    if (!(difficulty > 0))
+        return;
+
+    /* 0xffff * 2^208 / difficulty, as bits * 2^shift */
+    bits = (uint64_t)ldexp(frexp(65535.0 / difficulty, &exponent), 53);
+    shift = 208 + exponent - 53;
+    if (shift + 53 > 8 * NUDD_HASH_SIZE)
+        return;
+
+    for (i = 0; i < NUDD_HASH_SIZE; i++) {
+        low = 8 * i - shift;
+        if (low >= 64 || low <= -8)
+            target[i] = 0;
+        else if (low >= 0)
+            target[i] = (bits >> low) & 0xff;
+        else
+            target[i] = (bits << -low) & 0xff;
+    }
+}
+
+stratum_miner::stratum_miner(std::string const& host, int port,
+    std::string const& user, std::string const& password, unsigned int threads)
+    : host(host), port(port), user(user), password(password),
+      scanner(threads), fd(-1), running(false), connected(false),
+      extranonce2_size(4), next_id(STRATUM_FIRST_SUBMIT), accepted(0),
+      rejected(0), jobs(0)
+{
+    stratum_target_from_difficulty(1, target);
+}
+
+stratum_miner::~stratum_miner()
+{
+    stop();
+}
+
+bool stratum_miner::start()
+{
+    struct addrinfo hints, *found, *ai;
+    char service[16];
+    int status;
+
+    if (running)
+        return true;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    status = getaddrinfo(host.c_str(), service, &hints, &found);
+    if (status) {
+        last_error = gai_strerror(status);
+        return false;
+    }
+    for (ai = found; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        last_error = strerror(errno);
+    freeaddrinfo(found);
+    if (fd < 0)
+        return false;
+
+    running = true;
+    connected = true;
+    reader = std::thread(&stratum_miner::read_loop, this);
+    submitter = std::thread(&stratum_miner::submit_loop, this);
+
+    send_line("{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[]}");
+    send_line("{\"id\":2,\"method\":\"mining.authorize\",\"params\":[" +
+        json_quote(user) + "," + json_quote(password) + "]}");
+    return true;
+}
+
+void stratum_miner::stop()
+{
+    if (!running.exchange(false))
+        return;
+    scanner.set_job(std::shared_ptr<scan_job const>());
+    shutdown(fd, SHUT_RDWR);
+    reader.join();
+    submitter.join();
+    close(fd);
+    fd = -1;
+    connected = false;
+}
+
+stratum_stats stratum_miner::stats() const
+{
+    stratum_stats stats;
+
+    stats.hashes = scanner.hashes();
+    stats.shares = scanner.shares();
+    stats.accepted = accepted;
+    stats.rejected = rejected;
+    stats.jobs = jobs;
+    stats.switch_latency_us = scanner.switch_latency_us();
+    stats.connected = connected;
+    return stats;
+}
+
+bool stratum_miner::send_line(std::string const& line)
+{
+    std::string data = line + "\n";
+    std::lock_guard<std::mutex> guard(write_lock);
+    size_t sent = 0;
+
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+void stratum_miner::read_loop()
+{
+    std::string pending;
+    char buffer[4096];
+    bool valid = true;
+
+    while (valid) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        pending.append(buffer, n);
+
+        size_t start = 0, newline;
+        while (valid &&
+            (newline = pending.find('\n', start)) != std::string::npos) {
+            json_value message;
+            if (json_parse(pending.substr(start, newline - start), message))
+                valid = handle(message);
+            start = newline + 1;
+        }
+        pending.erase(0, start);
+        if (pending.size() > STRATUM_MAX_LINE)
+            valid = false;
+    }
+
+    /* A pool breaking the protocol is hung up on */
+    connected = false;
+    if (!valid)
+        shutdown(fd, SHUT_RDWR);
+    scanner.set_job(std::shared_ptr<scan_job const>());
+}
+
+void stratum_miner::submit_loop()
+{
+    scan_share share;
+    char numbers[32];
+
+    while (running) {
+        if (!scanner.next_share(share, 100))
+            continue;
+
+        unsigned char extranonce2[8];
+        unsigned int size = share.extranonce2_size < 8 ? share.extranonce2_size : 8;
+        for (unsigned int i = 0; i < size; i++)
+            extranonce2[i] = (share.extranonce2 >> (8 * (size - 1 - i))) & 0xff;
+        std::string en2 = std::string(2 * (share.extranonce2_size - size), '0') +
+            json_hex(extranonce2, size);
+
+        snprintf(numbers, sizeof(numbers), "\"%08x\",\"%08x\"",
+            share.ntime, share.nonce);
+        char id[24];
+        snprintf(id, sizeof(id), "%llu", (unsigned long long)next_id++);
+        send_line(std::string("{\"id\":") + id +
+            ",\"method\":\"mining.submit\",\"params\":[" + json_quote(user) +
+            "," + json_quote(share.job_id) + ",\"" + en2 + "\"," + numbers + "]}");
+    }
+}
+
+bool stratum_miner::handle(json_value const& message)
+{
+    json_value const* method = message.get("method");
+    json_value const* params = message.get("params");
+    json_value const* id = message.get("id");
+
+    if (method && method->type == json_value::string_value) {
+        if (!params || params->type != json_value::array_value)
+            return true;
+        if (method->string == "mining.notify") {
+            notify(*params);
+        } else if (method->string == "mining.set_difficulty" &&
+            !params->items.empty() &&
+            params->items[0].type == json_value::number_value) {
+            stratum_target_from_difficulty(params->items[0].number, target);
+        }
+        return true;
+    }
+
+    if (!id || id->type != json_value::number_value)
+        return true;
+    json_value const* result = message.get("result");
+
+    if (id->number == 1) {
+        std::string raw;
+        if (result && result->type == json_value::array_value &&
+            result->items.size() >= 3 &&
+            result->items[1].type == json_value::string_value &&
+            result->items[2].type == json_value::number_value &&
+            json_unhex(result->items[1].string, raw)) {
+            /* No share could be built for a size out of range */
+            if (!stratum_extranonce2_size(result->items[2], extranonce2_size))
+                return false;
+            extranonce1 = raw;
+        }
+    } else if (id->number >= STRATUM_FIRST_SUBMIT) {
+        if (result && result->is_true())
+            accepted++;
+        else
+            rejected++;
+    }
+    return true;
+}
+
+void stratum_miner::notify(json_value const& params)
+{
+    std::shared_ptr<scan_job> job(new scan_job());
+
+    if (!stratum_job_from_notify(params, *job))
+        return;
+    job->extranonce1 = extranonce1;
+    job->extranonce2_size = extranonce2_size;
+    memcpy(job->target, target, sizeof(job->target));
+
+    scanner.set_job(job);
+    jobs++;
+}
+
+bool stratum_job_from_notify(json_value const& params, scan_job& job)
+{
+    std::string raw;
+
+    if (params.type != json_value::array_value || params.items.size() < 8)
+        return false;
+    for (size_t i = 0; i < 4; i++)
+        if (params.items[i].type != json_value::string_value)
+            return false;
+    if (params.items[4].type != json_value::array_value)
+        return false;
+
+    job.id = params.items[0].string;
+    if (!json_unhex(params.items[1].string, raw) || raw.size() != 32)
+        return false;
+    memcpy(job.prevhash, raw.data(), 32);
+    if (!json_unhex(params.items[2].string, job.coinb1) ||
+        !json_unhex(params.items[3].string, job.coinb2))
+        return false;
+    job.merkle_branch.clear();
+    for (size_t i = 0; i < params.items[4].items.size(); i++) {
+        json_value const& branch = params.items[4].items[i];
+        if (branch.type != json_value::string_value ||
+            !json_unhex(branch.string, raw) || raw.size() != 32)
+            return false;
+        job.merkle_branch.push_back(raw);
+    }
+    return hex_word(params.items[5], job.version) &&
+        hex_word(params.items[6], job.nbits) &&
+        hex_word(params.items[7], job.ntime);
+}
+
+std::string stratum_notify_params(scan_job const& job, bool clean)
+{
+    char words[48];
+    std::string out = "[" + json_quote(job.id) + ",\"" +
+        json_hex(job.prevhash, 32) + "\",\"" +
+        json_hex(job.coinb1.data(), job.coinb1.size()) + "\",\"" +
+        json_hex(job.coinb2.data(), job.coinb2.size()) + "\",[";
+
+    for (size_t i = 0; i < job.merkle_branch.size(); i++)
+        out += (i ? ",\"" : "\"") + json_hex(job.merkle_branch[i].data(), 32) + "\"";
+    snprintf(words, sizeof(words), "],\"%08x\",\"%08x\",\"%08x\",",
+        job.version, job.nbits, job.ntime);
+    return out + words + (clean ? "true]" : "false]");
+}
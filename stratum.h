@@ -0,0 +1,110 @@
+#ifndef STRATUM_H
+#define STRATUM_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "scanner.h"
+
+struct json_value;
+
+/*
+ * Mining client for a stratum-like pool: line-delimited JSON over TCP.
+ *
+ *   -> mining.subscribe, mining.authorize [user, password]
+ *   <- mining.set_difficulty [difficulty], applied from the next job on
+ *   <- mining.notify [job_id, prevhash, coinb1, coinb2, [branch...],
+ *                     version, nbits, ntime, clean_jobs]
+ *   -> mining.submit [user, job_id, extranonce2, ntime, nonce]
+ *
+ * Byte strings are hex.  version, nbits, ntime and nonce are big-endian hex
+ * numbers as in stratum; prevhash is sent in header byte order, without
+ * stratum's per-word byte swapping.  Difficulty 1 is the 0x1d00ffff target.
+ *
+ * Every mining.notify switches the scanner straight away, from the network
+ * thread, so stale work stops within one Eksblowfish iteration.
+ */
+struct stratum_stats {
+    uint64_t hashes;
+    uint64_t shares;
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t jobs;
+    double switch_latency_us;
+    bool connected;
+};
+
+class stratum_miner {
+public:
+    stratum_miner(std::string const& host, int port, std::string const& user,
+        std::string const& password, unsigned int threads);
+    ~stratum_miner();
+
+    /* Connects and starts mining; returns false with error() set on failure */
+    bool start();
+    void stop();
+
+    std::string const& error() const { return last_error; }
+    stratum_stats stats() const;
+
+private:
+    stratum_miner(stratum_miner const&);
+    stratum_miner& operator=(stratum_miner const&);
+
+    bool send_line(std::string const& line);
+    void read_loop();
+    void submit_loop();
+    /* false if the pool broke the protocol and must be dropped */
+    bool handle(json_value const& message);
+    void notify(json_value const& params);
+
+    std::string host;
+    int port;
+    std::string user;
+    std::string password;
+
+    nonce_scanner scanner;
+    int fd;
+    std::mutex write_lock;
+    std::thread reader;
+    std::thread submitter;
+    std::atomic<bool> running;
+    std::atomic<bool> connected;
+    std::string last_error;
+
+    /* Owned by the reader thread */
+    std::string extranonce1;
+    unsigned int extranonce2_size;
+    unsigned char target[NUDD_HASH_SIZE];
+
+    std::atomic<uint64_t> next_id;
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> jobs;
+};
+
+/*
+ * Reads the job fields of a mining.notify parameter list; extranonce1,
+ * extranonce2_size and target are left for the caller.
+ */
+bool stratum_job_from_notify(json_value const& params, scan_job& job);
+
+/* The inverse, as a JSON array */
+std::string stratum_notify_params(scan_job const& job, bool clean);
+
+/*
+ * Reads an extranonce2 size sent by a pool: a whole number of bytes from 0
+ * to 8, as extranonce2 values are 64 bits.  false for anything else.
+ */
+bool stratum_extranonce2_size(json_value const& value, unsigned int& size);
+
+/* Share target for a pool difficulty, relative to the 0x1d00ffff target */
+void stratum_target_from_difficulty(double difficulty,
+    unsigned char target[NUDD_HASH_SIZE]);
+
+#endif
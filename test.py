@@ -1,15 +1,13 @@
 import nudd_hash
-import weakref
 import binascii
-import StringIO
 import struct
 
 from binascii import unhexlify
 
 def uint256_from_str(s):
-    r = 0L
+    r = 0
     t = struct.unpack("<IIIIIIII", s[:32])
-    for i in xrange(8):
+    for i in range(8):
         r += t[i] << (i * 32)
     return r
 
@@ -18,4 +16,35 @@ testbin = unhexlify(teststart)
 hash_bin = nudd_hash.getPoWHash(testbin)
 hash_int = uint256_from_str(hash_bin)
 print("%s" % hash_int)
+assert hash_int == 38992246059906184083872313216981344710075956403542811129665688535074253728745
 
+
+# checkPoW compares against the header's own compact target (bytes 72-75)
+def compact_target(nbits):
+    return (nbits & 0x007fffff) << (8 * ((nbits >> 24) - 3))
+
+header = testbin[:80]
+easy = header[:72] + struct.pack("<I", 0x2100ffff) + header[76:]
+for h in (header, easy):
+    valid, pow_hash = nudd_hash.checkPoW(h)
+    assert pow_hash == nudd_hash.getPoWHash(h)
+    nbits = struct.unpack("<I", h[72:76])[0]
+    assert valid == (uint256_from_str(pow_hash) <= compact_target(nbits))
+assert nudd_hash.checkPoWBatch([header, easy, easy, header]) == b'\x06'
+
+# Exponents 33 and 34 put the word's low bytes at the top of the target
+# and its zero high bytes past the end, which must not be written
+for nbits in (0x2100ffff, 0x210000ff, 0x220000ff):
+    h = header[:72] + struct.pack("<I", nbits) + header[76:]
+    valid, pow_hash = nudd_hash.checkPoW(h)
+    assert valid == (uint256_from_str(pow_hash) <= compact_target(nbits))
+for nbits in (0x21010000, 0x22000100):
+    h = header[:72] + struct.pack("<I", nbits) + header[76:]
+    assert nudd_hash.checkPoW(h)[0] is False
+    assert nudd_hash.checkPoWBatch([h]) == b'\x00'
+
+# Both halves at once, in one thread or two, give the same hash
+for n in range(4):
+    h = header[:76] + struct.pack("<I", n)
+    assert nudd_hash.getPoWHashLowLatency(h) == nudd_hash.getPoWHash(h)
+    assert nudd_hash.getPoWHashLowLatency(h, threaded=True) == nudd_hash.getPoWHash(h)
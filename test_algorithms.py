@@ -0,0 +1,62 @@
+import hashlib
+import os
+import struct
+import subprocess
+import sys
+
+import nudd_hash
+
+header = bytes(range(76)) + struct.pack("<I", 7)
+algorithms = nudd_hash.powAlgorithms()
+assert set(algorithms) == {"nudd", "scrypt"}, algorithms
+
+assert nudd_hash.powHash("nudd", header) == nudd_hash.getPoWHash(header)
+assert nudd_hash.powHash("scrypt", header) == hashlib.scrypt(
+    header, salt=header, n=1024, r=1, p=1, dklen=32)
+
+for name in algorithms:
+    assert nudd_hash.powSelfTest(name), name
+
+    headers = [header[:76] + struct.pack("<I", n) for n in range(5)]
+    hashes = nudd_hash.powHashBatch(name, headers)
+    assert hashes == [nudd_hash.powHash(name, h) for h in headers]
+    assert nudd_hash.powHashBatch(name, []) == []
+
+    # Anything meets an all-ones target; a nonce's hash is the header's hash
+    found = nudd_hash.powScan(name, header, b"\xff" * 32, 0, 5)
+    assert found == list(enumerate(hashes)), name
+    target = max(hashes[1:4])
+    found = nudd_hash.powScan(name, header, target, 1, 3, background=True)
+    assert found == [(n, hashes[n]) for n in range(1, 4) if hashes[n][::-1] <= target[::-1]]
+    assert nudd_hash.powScan(name, header, bytes(32), 0, 5) == []
+
+for bad in (lambda: nudd_hash.powHash("sha256d", header),
+            lambda: nudd_hash.powHash("nudd", header[:79]),
+            lambda: nudd_hash.powScan("nudd", header, bytes(31), 0, 1),
+            lambda: nudd_hash.powScan("nudd", header, bytes(32), 0xffffffff, 2)):
+    try:
+        bad()
+    except ValueError:
+        pass
+    else:
+        raise AssertionError("accepted bad arguments")
+# With no address space left for scrypt's V, every entry fails rather than
+# returning whatever was in the output buffer.  The pool starts first.
+if sys.platform.startswith("linux"):
+    out = subprocess.check_output([sys.executable, "-c", """
+import resource, nudd_hash
+header = bytes(80)
+nudd_hash.powHashBatch("nudd", [header] * 4)
+size = [int(l.split()[1]) for l in open("/proc/self/status") if l.startswith("VmSize:")]
+resource.setrlimit(resource.RLIMIT_AS, (size[0] * 1024 + 65536, resource.RLIM_INFINITY))
+for call in (lambda: nudd_hash.powHash("scrypt", header),
+             lambda: nudd_hash.powHashBatch("scrypt", [header]),
+             lambda: nudd_hash.powScan("scrypt", header, b"\\xff" * 32, 0, 2)):
+    try:
+        call()
+    except MemoryError:
+        print("failed")
+print(nudd_hash.powSelfTest("scrypt"))
+"""], env=dict(os.environ, PYTHONPATH=os.path.dirname(os.path.abspath(nudd_hash.__file__))))
+    assert out.decode().split() == ["failed"] * 3 + ["False"], out
+print("algorithms ok")
@@ -0,0 +1,39 @@
+import asyncio
+import struct
+
+import nudd_hash
+
+from binascii import unhexlify
+
+testbin = unhexlify('700000009da3e71afe06285056f917d22343faaf58655cfa75beb268452c082c00000000f54b50a00de0f7769b7a2c5b4b2203269f50a1a5c62d301b10ff5dc5a5e51d57006dd852060e631cd00b85d6')
+
+async def main():
+    headers = [testbin[:76] + struct.pack("<I", n) for n in range(16)]
+    results = await asyncio.gather(*[nudd_hash.getPoWHashAsync(h) for h in headers])
+    assert results == [nudd_hash.getPoWHash(h) for h in headers]
+
+    cancelled = nudd_hash.getPoWHashAsync(testbin)
+    cancelled.cancel()
+    assert await nudd_hash.getPoWHashAsync(testbin) == nudd_hash.getPoWHash(testbin)
+    print("async ok")
+
+asyncio.run(main())
+# a second loop gets its own completion channel
+asyncio.run(main())
+
+# Futures still queued when their loop closes are released once the next
+# loop prunes its channel, and its reader is removed
+import gc
+import weakref
+
+loop = asyncio.new_event_loop()
+
+async def submit():
+    return [weakref.ref(nudd_hash.getPoWHashAsync(testbin[:76] + struct.pack("<I", n), background=True))
+            for n in range(8)]
+
+refs = loop.run_until_complete(submit())
+loop.close()
+asyncio.run(main())
+gc.collect()
+assert all(r() is None for r in refs)
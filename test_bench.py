@@ -0,0 +1,22 @@
+import nudd_hash
+
+COUNTERS = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"}
+
+for kernel in ("nudd", "nudd_interleaved", "bcrypt", "scrypt"):
+    report = nudd_hash.benchmark(kernel, 2)
+    assert report["kernel"] == kernel and report["hashes"] == 2 and report["seconds"] > 0
+    # Either some counters came back, or the reason they did not
+    assert set(report) & COUNTERS or report["counter_error"], report
+    assert set(report) - {"kernel", "hashes", "seconds", "counter_error"} <= COUNTERS
+
+report = nudd_hash.benchmark("scrypt", 3, counters=False, n=64, tmto=4, interleave=2)
+assert report["hashes"] == 6 and not set(report) & (COUNTERS | {"counter_error"})
+
+for kernel, options in (("sha256d", {}), ("scrypt", {"n": 1000}), ("scrypt", {"interleave": 0})):
+    try:
+        nudd_hash.benchmark(kernel, 1, **options)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError((kernel, options))
+print("bench ok")
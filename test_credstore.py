@@ -0,0 +1,62 @@
+import os
+import shutil
+import tempfile
+
+import nudd_hash
+
+directory = tempfile.mkdtemp()
+try:
+    path = os.path.join(directory, "credentials")
+    store = nudd_hash.CredentialStore(path, writable=True)
+    assert store.capacity() == 0 and store.get(0) is None and store.verify(0, "x") is None
+
+    hashes = {}
+    for user, (password, setting) in enumerate([
+            ("U*U", "$2a$05$CCCCCCCCCCCCCCCCCCCCC."),
+            ("", "$2y$04$abcdefghijklmnopqrstuu"),
+            ("\xff\xa3345", "$2x$04$abcdefghijklmnopqrstuu"),
+            ("password", "$2a$04$0123456789abcdefghijkl")]):
+        hashes[user * 1000] = (password, nudd_hash.bcryptHash(password, setting))
+    for user, (password, hashed) in hashes.items():
+        store.put(user, hashed)
+    assert store.capacity() > max(hashes)
+    store.sync()
+
+    # Records are 41 bytes after a 64-byte header
+    assert os.path.getsize(path) == 64 + 41 * store.capacity()
+
+    reader = nudd_hash.CredentialStore(path)
+    for user, (password, hashed) in hashes.items():
+        assert reader.get(user) == hashed
+        assert reader.verify(user, password) is True
+        assert reader.verify(user, password + "x") is False
+        assert nudd_hash.bcryptHash(password, reader.get(user)) == hashed
+    assert reader.get(1) is None and reader.verify(1, "") is None
+    assert reader.get(10 ** 12) is None
+    try:
+        reader.put(1, hashes[0][1])
+    except OSError:
+        pass
+    else:
+        raise AssertionError("read-only store accepted a put")
+
+    store.remove(0)
+    assert reader.get(0) is None and reader.verify(0, "U*U") is None
+    try:
+        store.put(1, "$2b$05$" + "." * 53)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError("put accepted an invalid hash")
+
+    with open(os.path.join(directory, "other"), "wb") as f:
+        f.write(b"\0" * 128)
+    try:
+        nudd_hash.CredentialStore(os.path.join(directory, "other"))
+    except OSError:
+        pass
+    else:
+        raise AssertionError("opened a file without the header")
+finally:
+    shutil.rmtree(directory)
+print("credential store ok")
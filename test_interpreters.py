@@ -0,0 +1,53 @@
+import os
+import sys
+import threading
+
+import nudd_hash
+
+headers = [bytes([n]) * 80 for n in range(8)]
+expected = [nudd_hash.getPoWHash(h) for h in headers]
+
+# Plain threads hashing and checking at once
+errors = []
+
+
+def work():
+    try:
+        for _ in range(4):
+            assert [nudd_hash.getPoWHash(h) for h in headers] == expected
+            nudd_hash.checkPoWBatch(headers)
+    except Exception as e:
+        errors.append(e)
+
+
+threads = [threading.Thread(target=work) for _ in range(4)]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+assert not errors, errors
+
+# A batch works from a snapshot, so mutating the list afterwards is harmless
+batch = list(headers)
+bitmap = nudd_hash.checkPoWBatch(batch)
+batch.clear()
+assert len(bitmap) == 1
+
+# Each isolated interpreter, with its own GIL, gets its own module state.
+# 3.12's _xxsubinterpreters also works, but its asyncio aborts at exit there.
+interpreters = None
+if sys.version_info >= (3, 13):
+    import _interpreters as interpreters
+if interpreters:
+    for _ in range(2):
+        interp = interpreters.create()
+        interpreters.run_string(interp, "\n".join([
+            "import sys",
+            "sys.path.insert(0, %r)" % os.path.dirname(os.path.abspath(__file__)),
+            "import asyncio, nudd_hash",
+            "async def once():",
+            "    return await nudd_hash.getPoWHashAsync(bytes(80))",
+            "assert asyncio.run(once()) == nudd_hash.getPoWHash(bytes(80))",
+        ]))
+        interpreters.destroy(interp)
+print("interpreters ok")
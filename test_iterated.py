@@ -0,0 +1,16 @@
+import nudd_hash
+
+data = bytes(bytearray(i * 7 & 0xff for i in range(72 * 80 + 5)))
+
+# Around every block boundary of the first two rounds, and past the point
+# where the second round needs more than one block itself
+for size in (0, 1, 22, 23, 71, 72, 73, 143, 144, 145, 72 * 4, 72 * 4 + 1,
+             72 * 72 // 23, 72 * 72 // 23 + 1, len(data)):
+    serial = nudd_hash.bcryptIterated(data[:size])
+    assert len(serial) == 23
+    assert nudd_hash.bcryptIterated(data[:size], parallel=True) == serial, size
+
+# bcryptIterated is one half of the proof of work hash
+header = data[:80]
+assert nudd_hash.getPoWHash(header)[:23] == nudd_hash.bcryptIterated(header[:60])
+print("iterated ok")
@@ -0,0 +1,92 @@
+import json
+import os
+import signal
+import socket
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "tools"))
+
+import nudd_hash
+from lease_demo import check_shares, spawn_worker, start_job
+
+difficulty = 2.0 ** -28
+address = os.path.join(tempfile.mkdtemp(), "lease.sock")
+coordinator = nudd_hash.LeaseCoordinator(address, lease_size=256, timeout_ms=600)
+coordinator.start()
+job = start_job(coordinator, difficulty)
+
+workers = [spawn_worker(address, "w%d" % i) for i in range(2)]
+time.sleep(3)
+stats = coordinator.stats()
+assert stats["workers"] == 2 and stats["leases"] >= 2 and stats["hashrate"] > 0
+
+# A worker that stops reporting loses its lease to the queue
+workers[0].send_signal(signal.SIGSTOP)
+time.sleep(1.5)
+stats = coordinator.stats()
+for worker in workers:
+    worker.kill()
+    worker.wait()
+
+shares = coordinator.shares()
+print(stats, "%d shares" % len(shares))
+assert stats["workers"] == 1 and stats["released"] >= 1
+assert shares and check_shares(job, shares, difficulty) == len(shares)
+
+
+def read_until_closed(sock, seconds):
+    """Everything sock receives, and whether the peer closed within seconds."""
+    sock.settimeout(0.1)
+    data, deadline = b"", time.time() + seconds
+    while time.time() < deadline:
+        try:
+            more = sock.recv(65536)
+        except socket.timeout:
+            continue
+        except ConnectionResetError:
+            return data, True
+        if not more:
+            return data, True
+        data += more
+    return data, False
+
+
+# The coordinator drops a worker that never ends its line, well before it
+# would time out as silent
+raw = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+raw.connect(address)
+raw.settimeout(5)
+job_line = raw.recv(65536).split(b"\n")[0]
+raw.sendall(b"x" * (300 * 1024))
+assert read_until_closed(raw, 0.3)[1]
+raw.close()
+coordinator.stop()
+
+# A worker refuses jobs whose extranonce2 size it cannot fill, and drops a
+# coordinator that never ends its line
+fake = os.path.join(tempfile.mkdtemp(), "fake.sock")
+listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+listener.bind(fake)
+listener.listen(1)
+for size, requests in ((4, True), (9, False), (-1, False), (2.5, False), (1e300, False)):
+    job = json.loads(job_line)
+    job["extranonce2_size"] = size
+    worker = nudd_hash.LeaseWorker(fake, 1, "bad")
+    worker.start()
+    peer, _ = listener.accept()
+    peer.sendall(json.dumps(job).encode() + b"\n")
+    sent, _ = read_until_closed(peer, 1.0)
+    assert (b"lease.request" in sent) == requests, size
+    worker.stop()
+    peer.close()
+worker = nudd_hash.LeaseWorker(fake, 1, "bad")
+worker.start()
+peer, _ = listener.accept()
+peer.sendall(b"x" * (300 * 1024))
+assert read_until_closed(peer, 5)[1] and not worker.stats()["connected"]
+worker.stop()
+peer.close()
+listener.close()
+print("lease ok")
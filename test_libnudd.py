@@ -0,0 +1,86 @@
+import ctypes
+import os
+import struct
+import subprocess
+import sys
+
+import nudd_hash
+
+here = os.path.dirname(os.path.abspath(__file__))
+subprocess.check_call(["make", "-s", "-C", here, "libnudd.so"])
+lib = ctypes.CDLL(os.path.join(here, "libnudd.so"))
+
+
+class Share(ctypes.Structure):
+    _fields_ = [("nonce", ctypes.c_uint32), ("hash", ctypes.c_ubyte * 32)]
+
+
+lib.nudd_algorithm_at.restype = ctypes.c_void_p
+lib.nudd_algorithm_find.restype = ctypes.c_void_p
+lib.nudd_algorithm_name.restype = ctypes.c_char_p
+lib.nudd_algorithm_name.argtypes = [ctypes.c_void_p]
+for name in ("nudd_algorithm_self_test", "nudd_pow_hash", "nudd_pow_hash_batch",
+             "nudd_pow_scan", "nudd_pow_check_batch"):
+    getattr(lib, name).argtypes = None
+assert lib.nudd_api_version() == 1
+
+header = bytes(range(72)) + struct.pack("<I", 0x2100ffff) + struct.pack("<I", 5)
+names = [lib.nudd_algorithm_name(lib.nudd_algorithm_at(i)).decode()
+         for i in range(lib.nudd_algorithm_count())]
+assert sorted(names) == sorted(nudd_hash.powAlgorithms())
+assert not lib.nudd_algorithm_find(b"sha256d")
+for name in names:
+    algorithm = ctypes.c_void_p(lib.nudd_algorithm_find(name.encode()))
+    assert lib.nudd_algorithm_self_test(algorithm) == 1
+
+    hash = ctypes.create_string_buffer(32)
+    assert lib.nudd_pow_hash(algorithm, header, hash) == 0
+    assert hash.raw == nudd_hash.powHash(name, header)
+
+    headers = [header[:76] + struct.pack("<I", n) for n in range(4)]
+    hashes = ctypes.create_string_buffer(32 * 4)
+    assert lib.nudd_pow_hash_batch(algorithm, b"".join(headers), ctypes.c_size_t(4), hashes) == 0
+    assert hashes.raw == b"".join(nudd_hash.powHashBatch(name, headers))
+
+    # Only capacity shares are written, but all are counted
+    shares = (Share * 2)()
+    found = ctypes.c_size_t()
+    assert lib.nudd_pow_scan(algorithm, header, b"\xff" * 32, ctypes.c_uint32(0),
+                             ctypes.c_uint32(4), shares, ctypes.c_size_t(2),
+                             ctypes.byref(found)) == 0
+    assert found.value == 4
+    assert [(s.nonce, bytes(s.hash)) for s in shares] == \
+        nudd_hash.powScan(name, header, b"\xff" * 32, 0, 2)
+    assert lib.nudd_pow_scan(algorithm, header, bytes(32), ctypes.c_uint32(0xffffffff),
+                             ctypes.c_uint32(2), shares, ctypes.c_size_t(2), None) == -1
+
+    # The all-ones nBits of the second header can never be met
+    headers[1] = header[:72] + b"\xff" * 4 + header[76:]
+    valid = ctypes.create_string_buffer(4)
+    assert lib.nudd_pow_check_batch(algorithm, b"".join(headers), ctypes.c_size_t(4),
+                                    valid, None) == 0
+    assert valid.raw == b"\x01\x00\x01\x01", (name, valid.raw)
+assert lib.nudd_pow_hash(None, header, ctypes.create_string_buffer(32)) == -1
+
+# Without address space for scrypt's V the entries fail instead of
+# returning stale output; the pool is started before the limit
+if sys.platform.startswith("linux"):
+    out = subprocess.check_output([sys.executable, "-c", """
+import ctypes, resource, sys
+lib = ctypes.CDLL(sys.argv[1])
+lib.nudd_algorithm_find.restype = ctypes.c_void_p
+nudd = ctypes.c_void_p(lib.nudd_algorithm_find(b"nudd"))
+scrypt = ctypes.c_void_p(lib.nudd_algorithm_find(b"scrypt"))
+header, hashes = bytes(80), ctypes.create_string_buffer(32 * 4)
+lib.nudd_pow_hash_batch(nudd, header * 4, ctypes.c_size_t(4), hashes)
+size = [int(l.split()[1]) for l in open("/proc/self/status") if l.startswith("VmSize:")]
+resource.setrlimit(resource.RLIMIT_AS, (size[0] * 1024 + 65536, resource.RLIM_INFINITY))
+print(lib.nudd_pow_hash(scrypt, header, hashes),
+      lib.nudd_pow_hash_batch(scrypt, header, ctypes.c_size_t(1), hashes),
+      lib.nudd_pow_scan(scrypt, header, b"\\xff" * 32, ctypes.c_uint32(0),
+                        ctypes.c_uint32(2), None, ctypes.c_size_t(0), None),
+      lib.nudd_pow_check_batch(scrypt, header, ctypes.c_size_t(1), hashes, None),
+      lib.nudd_algorithm_self_test(scrypt))
+""", os.path.join(here, "libnudd.so")])
+    assert out.split() == [b"-1"] * 4 + [b"0"], out
+print("libnudd ok")
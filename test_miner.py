@@ -0,0 +1,72 @@
+import asyncio
+import os
+import socket
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "tools"))
+
+import nudd_hash
+from pool_standin import StandinPool
+
+# A share roughly every sixteen hashes, and a new job every half second
+pool = StandinPool(difficulty=2.0 ** -28, interval=0.5)
+loop = asyncio.new_event_loop()
+server = loop.run_until_complete(pool.serve())
+port = server.sockets[0].getsockname()[1]
+threading.Thread(target=loop.run_forever, daemon=True).start()
+
+# More threads than cores would measure the scheduler's timeslice instead
+threads = min(2, os.cpu_count() or 1)
+miner = nudd_hash.Miner("127.0.0.1", port, "tester", threads=threads)
+miner.start()
+time.sleep(3)
+stats = miner.stats()
+miner.stop()
+print(stats, "accepted %d stale %d invalid %d" % (pool.accepted, pool.stale, pool.invalid))
+
+assert stats["jobs"] >= 4
+assert stats["accepted"] > 0 and pool.accepted >= stats["accepted"]
+assert pool.invalid == 0
+assert pool.stale <= stats["jobs"]
+# Typically a few hundred microseconds, one Eksblowfish iteration; the
+# bound leaves room for timeslices on a loaded or shared host
+assert stats["switch_latency_us"] < 50000
+
+
+def hung_up_on(data):
+    """Whether a miner drops a pool that opens by sending data."""
+    listener = socket.socket()
+    listener.bind(("127.0.0.1", 0))
+    listener.listen(1)
+    bad = nudd_hash.Miner("127.0.0.1", listener.getsockname()[1], "tester", threads=1)
+    bad.start()
+    client, _ = listener.accept()
+    client.sendall(data)
+    client.settimeout(2)
+    try:
+        while client.recv(4096):
+            pass
+        dropped = True
+    except (socket.timeout, ConnectionResetError):
+        dropped = False
+    connected = bad.stats()["connected"]
+    bad.stop()
+    client.close()
+    listener.close()
+    return dropped and not connected
+
+
+# extranonce2 sizes a 64-bit extranonce2 cannot fill, and endless lines
+for size in ("9", "-1", "2.5", "1e300"):
+    assert hung_up_on(b'{"id":1,"error":null,"result":[[],"00",%s]}\n' % size.encode()), size
+assert hung_up_on(b"x" * (300 * 1024))
+assert not hung_up_on(b'{"id":1,"error":null,"result":[[],"00",8]}\n' + b"x" * 1024)
+
+try:
+    nudd_hash.Miner("127.0.0.1", 1, "tester").start()
+    assert False, "connecting to a closed port should fail"
+except OSError:
+    pass
+print("miner ok")
@@ -0,0 +1,54 @@
+import asyncio
+import struct
+import threading
+import time
+
+import nudd_hash
+
+# A real compact target, so every header is actually hashed
+base = bytes(range(72)) + struct.pack("<I", 0x1d00ffff)
+headers = [base + struct.pack("<I", n) for n in range(300)]
+expected = nudd_hash.checkPoWBatch(headers[:8], background=False)
+assert nudd_hash.checkPoWBatch(headers[:8]) == expected
+
+# Half a core for bulk work, backing off when verifies queue past 2 ms
+nudd_hash.configurePool(cpu_budget=0.5, latency_target_us=2000)
+bulk = threading.Thread(target=nudd_hash.checkPoWBatch, args=(headers,))
+bulk.start()
+time.sleep(0.2)
+
+
+async def verifies():
+    worst = 0
+    for header in headers[:20]:
+        started = time.monotonic()
+        assert await nudd_hash.getPoWHashAsync(header) == nudd_hash.getPoWHash(header)
+        worst = max(worst, time.monotonic() - started)
+    return worst
+
+worst = asyncio.run(verifies())
+stats = nudd_hash.poolStats()
+bulk.join()
+print(stats, "worst verify %.1f ms" % (worst * 1000))
+assert stats["foreground_done"] >= 20 and stats["background_done"] > 0
+# A foreground verify waits for at most the background header in flight
+assert stats["foreground_wait_p99_us"] < 50000
+
+nudd_hash.configurePool()
+assert nudd_hash.poolStats()["background_limit"] >= 1
+
+
+# A background batch keeps to the budget, including the share the calling
+# thread runs itself
+def cpu_ratio(count):
+    wall, cpu = time.monotonic(), time.process_time()
+    nudd_hash.checkPoWBatch(headers[:count], background=True)
+    return (time.process_time() - cpu) / (time.monotonic() - wall)
+
+unbudgeted = cpu_ratio(60)
+nudd_hash.configurePool(cpu_budget=0.25)
+budgeted = cpu_ratio(60)
+nudd_hash.configurePool()
+print("cpu/wall %.2f unbudgeted, %.2f at a 0.25 core budget" % (unbudgeted, budgeted))
+assert budgeted < 0.35 and budgeted < unbudgeted / 2
+print("pool ok")
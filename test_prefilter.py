@@ -0,0 +1,61 @@
+import struct
+
+import nudd_hash
+
+
+def header(version=2, prev=b"\x11" * 32, time=1000, nbits=0x2100ffff, nonce=0):
+    return (struct.pack("<I", version) + prev + b"\x22" * 32 +
+            struct.pack("<III", time, nbits, nonce))
+
+
+known = [b"\x11" * 32, b"\x33" * 32]
+flt = nudd_hash.HeaderFilter(versions=(2, 4), max_nbits=0x2100ffff,
+                             time_window=(900, 1100), prev_hashes=known)
+headers = [
+    header(),                              # plausible
+    header(version=1),                     # version
+    header(version=5, time=0),             # version, before time is looked at
+    header(nbits=0x2200ffff),              # easier than the limit
+    header(nbits=0x2180ffff),              # negative target
+    header(time=1101),                     # time
+    header(prev=b"\x44" * 32),             # unknown parent
+    header(prev=b"\x33" * 32, nonce=1),    # plausible
+]
+bitmap = flt.check_pow_batch(headers)
+unfiltered = nudd_hash.checkPoWBatch(headers)
+for i, h in enumerate(headers):
+    expected = i in (0, 7) and bool(unfiltered[0] >> i & 1)
+    assert bool(bitmap[0] >> i & 1) == expected, i
+assert flt.stats() == {"version": 2, "nbits": 2, "time": 1, "prev_hash": 1, "admitted": 2}
+
+# The window and the known parents can move between batches
+flt.set_time_window(1100, 1200)
+flt.add_prev_hash(b"\x44" * 32)
+flt.check_pow_batch([headers[0], headers[5], header(prev=b"\x44" * 32, time=1150)])
+assert flt.stats()["time"] == 2 and flt.stats()["admitted"] == 4
+flt.clear_prev_hashes()
+assert flt.check_pow_batch([headers[5]]) == b"\x00"
+assert flt.stats()["prev_hash"] == 2
+
+# Checks run in keyword order: the first failing one takes the count
+by_time = nudd_hash.HeaderFilter(time_window=(0, 10), versions=(9, 9))
+by_version = nudd_hash.HeaderFilter(versions=(9, 9), time_window=(0, 10))
+by_time.check_pow_batch([header()])
+by_version.check_pow_batch([header()])
+assert by_time.stats()["time"] == 1 and by_time.stats()["version"] == 0
+assert by_version.stats()["version"] == 1 and by_version.stats()["time"] == 0
+
+# No checks: the same as checkPoWBatch
+assert nudd_hash.HeaderFilter().check_pow_batch(headers) == unfiltered
+
+for bad in (lambda: nudd_hash.HeaderFilter((1, 2)),
+            lambda: nudd_hash.HeaderFilter(version=(1, 2)),
+            lambda: nudd_hash.HeaderFilter(prev_hashes=[b"short"]),
+            lambda: flt.add_prev_hash(b"short")):
+    try:
+        bad()
+    except (TypeError, ValueError):
+        pass
+    else:
+        raise AssertionError("accepted bad arguments")
+print("prefilter ok")
@@ -0,0 +1,63 @@
+import random
+
+import nudd_hash
+
+ALPHABET = "./ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+
+
+def encode(data):
+    """BF_encode(): six bits at a time, most significant first, no padding."""
+    bits = "".join("{:08b}".format(b) for b in data)
+    bits += "0" * (-len(bits) % 6)
+    return "".join(ALPHABET[int(bits[i:i + 6], 2)] for i in range(0, len(bits), 6))
+
+
+rng = random.Random(7)
+stored = []
+for i in range(200):
+    salt = bytes(rng.getrandbits(8) for _ in range(16))
+    digest = bytes(rng.getrandbits(8) for _ in range(23))
+    subtype = "axy"[i % 3]
+    cost = 4 + i % 28
+    text = "$2%s$%02d$%s%s" % (subtype, cost, encode(salt), encode(digest))
+    assert nudd_hash.formatBcrypt(subtype, cost, salt, digest) == text
+    stored.append((text, (subtype, cost, salt, digest)))
+assert nudd_hash.parseBcrypt([text for text, _ in stored]) == [parsed for _, parsed in stored]
+
+# Real hashes round-trip, and the salt's ignored low bits are dropped as BF_crypt() does
+for password in ("", "U*U", "password"):
+    salt = "".join(rng.choice(ALPHABET) for _ in range(22))
+    hashed = nudd_hash.bcryptHash(password, "$2a$04$" + salt)
+    (parsed,) = nudd_hash.parseBcrypt([hashed])
+    assert nudd_hash.formatBcrypt(*parsed) == hashed
+    assert nudd_hash.bcryptHash(password, hashed) == hashed
+(parsed,) = nudd_hash.parseBcrypt(["$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW"])
+assert nudd_hash.formatBcrypt(*parsed) == "$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW"
+(parsed,) = nudd_hash.parseBcrypt(["$2a$05$CCCCCCCCCCCCCCCCCCCCC/E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW"])
+assert nudd_hash.formatBcrypt(*parsed) == "$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW"
+
+good = stored[0][0]
+bad = [
+    good[:-1],                           # short
+    good + ".",                          # long
+    "$2b$" + good[4:],                   # subtype BF_crypt() does not know
+    "$2a$03$" + good[7:],                # cost too low
+    "$2a$32$" + good[7:],                # cost too high
+    "$2a$0x$" + good[7:],
+    "$2a$05" + "!" + good[7:],
+    good[:20] + "*" + good[21:],         # salt outside the alphabet
+    good[:50] + "\u00e9" + good[51:],     # hash outside the alphabet
+    b"not a hash",
+    None,
+]
+assert nudd_hash.parseBcrypt(bad) == [None] * len(bad)
+assert nudd_hash.parseBcrypt([good.encode()]) == [stored[0][1]]
+subtype, cost, salt, digest = stored[0][1]
+for args in (("b", cost, salt, digest), ("a", 3, salt, digest), ("a", cost, salt[:15], digest)):
+    try:
+        nudd_hash.formatBcrypt(*args)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError(args)
+print("radix64 ok")
@@ -0,0 +1,39 @@
+import asyncio
+import os
+import random
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "tools"))
+
+import nudd_hash
+from replay import HEADER_NBITS, Histogram, generate_trace, random_header, replay
+
+# crypt_blowfish's own test vector
+stored = "$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW"
+assert nudd_hash.bcryptHash("U*U", stored) == stored
+assert nudd_hash.bcryptHash("U*V", stored) != stored
+
+histogram = Histogram()
+for us in range(1, 10001):
+    histogram.record(us / 1e6)
+for fraction in (0.5, 0.99, 0.999):
+    exact = fraction * 10000
+    assert abs(histogram.percentile(fraction) - exact) <= exact / 64 + 1
+
+# Generated headers carry a valid target, so checks really hash them
+header = random_header(random.Random(1))
+assert len(header) == 80 and struct.unpack("<I", header[72:76])[0] == HEADER_NBITS
+assert nudd_hash.checkPoWBatch([header]) in (b"\x00", b"\x01")
+valid, pow_hash = nudd_hash.checkPoW(header)
+assert pow_hash == nudd_hash.getPoWHash(header)
+
+mix = {"hash": 4, "check": 2, "batch": 1, "bcrypt": 1}
+trace = generate_trace(80, rate=400, mix=mix, cost=4, batch=4)
+assert trace == generate_trace(80, rate=400, mix=mix, cost=4, batch=4)
+histograms, elapsed, failed = asyncio.run(replay(trace, concurrency=4, speed=2))
+print("%.2fs" % elapsed, histograms["all"].summary())
+assert failed == 0 and histograms["all"].total == len(trace)
+assert sum(histograms[op].total for op in mix) == len(trace)
+assert histograms["all"].percentile(0.5) <= histograms["all"].percentile(0.99)
+print("replay ok")
@@ -0,0 +1,38 @@
+import os
+import select
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "tools"))
+
+import nudd_hash
+from lease_demo import EXTRANONCE1, check_shares
+from pool_standin import Job
+
+# Every hash is a share, and the queue is far too small to hold them
+difficulty = 2.0 ** -40
+scanner = nudd_hash.Scanner(threads=2, capacity=8)
+job = Job(1, 4)
+scanner.set_job(str(job.id), job.prevhash, job.coinb1, job.coinb2, job.branch,
+                job.version, job.nbits, job.ntime, EXTRANONCE1,
+                job.extranonce2_size, difficulty)
+
+time.sleep(1)
+before = scanner.stats()
+time.sleep(1)
+stats = scanner.stats()
+print(stats)
+# A full queue drops shares rather than holding up the hashing threads
+assert stats["dropped"] > 0 and stats["hashes"] > before["hashes"]
+
+shares = list(scanner)
+assert 0 < len(shares) <= 8
+assert check_shares(job, [("",) + share for share in shares], difficulty) == len(shares)
+
+# Once iteration ran dry, the descriptor signals the next share
+readable, _, _ = select.select([scanner], [], [], 2)
+assert readable and next(scanner)
+
+scanner.clear()
+scanner.wait(0.1)
+print("scanner ok")
@@ -0,0 +1,71 @@
+import hashlib
+
+import nudd_hash
+
+# RFC 7914 section 12, plus shapes that exercise odd r and several lanes
+cases = [
+    (b"", b"", 16, 1, 1, 64),
+    (b"password", b"NaCl", 1024, 8, 16, 64),
+    (b"pleaseletmein", b"SodiumChloride", 16384, 8, 1, 64),
+    (b"x" * 100, b"salt", 256, 3, 5, 33),
+    (b"key", b"s" * 80, 2, 1, 2, 200),
+]
+for password, salt, n, r, p, dklen in cases:
+    expected = hashlib.scrypt(password, salt=salt, n=n, r=r, p=p, dklen=dklen,
+                              maxmem=1 << 30)
+    assert nudd_hash.scrypt(password, salt, n, r, p, dklen) == expected, (n, r, p)
+assert nudd_hash.scrypt(b"password", b"NaCl", 1024, 8, 16) == hashlib.scrypt(
+    b"password", salt=b"NaCl", n=1024, r=8, p=16)
+
+# Storing part of V and stepping lanes together give the same result
+for password, salt, n, r, p, dklen in cases:
+    expected = nudd_hash.scrypt(password, salt, n, r, p, dklen)
+    for tmto, interleave in ((2, 1), (3, 4), (16, 8), (64, 16), (5, 3)):
+        assert nudd_hash.scrypt(password, salt, n, r, p, dklen, tmto=min(tmto, n),
+                                interleave=interleave) == expected, (n, tmto, interleave)
+        assert nudd_hash.scrypt(password, salt, n, r, p, dklen, tmto=min(tmto, n),
+                                interleave=interleave, parallel=False) == expected
+
+for n, r, p in ((0, 1, 1), (1000, 1, 1), (1 << 16, 1, 1), (16, 0, 1), (16, 1, 0),
+                (16, 1 << 15, 1 << 15)):
+    try:
+        nudd_hash.scrypt(b"", b"", n, r, p)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError((n, r, p))
+for tmto, interleave in ((0, 1), (32, 1), (1, 0), (1, 17)):
+    try:
+        nudd_hash.scrypt(b"", b"", 16, 1, 1, tmto=tmto, interleave=interleave)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError((tmto, interleave))
+# A batch of different inputs, each scrypt(x, x, n, r, 1), stepped together
+headers = [bytes([i]) * 80 for i in range(13)]
+for n, r, dklen in ((1024, 1, 32), (16, 2, 64), (2, 3, 7)):
+    expected = [nudd_hash.scrypt(h, h, n, r, 1, dklen) for h in headers]
+    for tmto, interleave in ((1, 1), (2, 1), (3, 4), (16, 8), (1, 16), (5, 3)):
+        for parallel in (True, False):
+            assert nudd_hash.scryptBatch(headers, n, r, dklen, tmto=min(tmto, n),
+                                         interleave=interleave,
+                                         parallel=parallel) == expected, \
+                (n, r, tmto, interleave)
+assert nudd_hash.scryptBatch(headers[:1])[0] == hashlib.scrypt(
+    headers[0], salt=headers[0], n=1024, r=1, p=1, dklen=32)
+assert nudd_hash.scryptBatch([]) == []
+for bad in ([b"a", b"bc"], [b"a", "b"], None):
+    try:
+        nudd_hash.scryptBatch(bad)
+    except (ValueError, TypeError):
+        pass
+    else:
+        raise AssertionError(bad)
+for n, tmto, interleave in ((1000, 1, 1), (16, 32, 1), (16, 1, 17)):
+    try:
+        nudd_hash.scryptBatch(headers, n, tmto=tmto, interleave=interleave)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError((n, tmto, interleave))
+print("scrypt ok")
@@ -0,0 +1,39 @@
+import os
+import socket
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "tools"))
+
+import nudd_hash
+from share_load import pack_share, read_verdicts
+
+path = os.path.join(tempfile.mkdtemp(), "shares.sock")
+server = nudd_hash.ShareServer(path, max_batch=4, max_wait_ms=1.0)
+server.set_worker_difficulty(1, 2.0 ** -40)   # accepts everything
+server.set_worker_difficulty(2, 2.0 ** 40)    # accepts nothing
+server.start()
+
+headers = [os.urandom(80) for _ in range(3)]
+shares = [(1, headers[0]), (1, headers[1]), (1, headers[0]), (2, headers[2]), (9, headers[2])]
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+sock.connect(path)
+sock.sendall(b"".join(pack_share(100 + i, w, h) for i, (w, h) in enumerate(shares)))
+
+verdicts, buffered = [], b""
+while len(verdicts) < len(shares):
+    more, buffered = read_verdicts(sock, buffered)
+    verdicts += more
+sock.close()
+
+verdicts = dict((v[0], v) for v in verdicts)
+assert [verdicts[100 + i][2] for i in range(len(shares))] == [0, 0, 2, 1, 3]
+assert verdicts[100][3] == nudd_hash.getPoWHash(headers[0])
+assert verdicts[103][3] == b"\0" * 32
+
+stats = server.stats()
+server.stop()
+assert not os.path.exists(path)
+assert stats["received"] == 5 and stats["accepted"] == 2 and stats["rejected"] == 1
+assert stats["duplicates"] == 1 and stats["unknown_workers"] == 1
+print("share server ok")
@@ -0,0 +1,44 @@
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+# The profile goes to a scratch file rather than this host's real one
+path = os.path.join(tempfile.mkdtemp(), "nudd_hash", "host.json")
+os.environ["NUDD_HASH_PROFILE"] = path
+
+import nudd_hash
+
+assert nudd_hash.hostProfile()["hashrate"] == 0
+best = nudd_hash.tune(seconds=1.0)
+print(best)
+assert best["threads"] >= 1 and best["hashrate"] > 0 and best["lanes"] in (1, 2)
+with open(path) as f:
+    saved = json.load(f)
+    assert saved["engine"] == best["engine"] and saved["lanes"] == best["lanes"]
+
+# A fresh process picks the profile up, and either engine hashes the same
+header = bytes(range(80))
+expected = nudd_hash.getPoWHash(header)
+for engine in ("specialized", "generic"):
+    with open(path, "w") as f:
+        json.dump(dict(best, engine=engine), f)
+    out = subprocess.check_output([sys.executable, "-c",
+        "import nudd_hash, binascii; print(nudd_hash.hostProfile()['engine']);"
+        "print(binascii.hexlify(nudd_hash.getPoWHash(bytes(range(80)))).decode())"],
+        env=dict(os.environ, PYTHONPATH=os.path.dirname(os.path.abspath(nudd_hash.__file__))))
+    loaded, hashed = out.decode().split()
+    assert loaded == engine and hashed == expected.hex()
+
+# The lane count picks the registry's nudd kernel, which hashes the same
+for lanes, kernel in ((1, "serial"), (2, "interleaved")):
+    with open(path, "w") as f:
+        json.dump(dict(best, lanes=lanes), f)
+    out = subprocess.check_output([sys.executable, "-c",
+        "import nudd_hash, binascii; print(nudd_hash.powAlgorithms()['nudd']);"
+        "print(binascii.hexlify(nudd_hash.powHash('nudd', bytes(range(80)))).decode())"],
+        env=dict(os.environ, PYTHONPATH=os.path.dirname(os.path.abspath(nudd_hash.__file__))))
+    chosen, hashed = out.decode().split()
+    assert chosen == kernel and hashed == expected.hex()
+print("tune ok")
@@ -0,0 +1,105 @@
+import os
+import socket
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "tools"))
+
+import nudd_hash
+from share_load import pack_share, read_verdicts
+
+path = os.path.join(tempfile.mkdtemp(), "shares.sock")
+server = nudd_hash.ShareServer(path, max_batch=8, max_wait_ms=1.0)
+try:
+    server.enable_vardiff(shares_per_minute=0)
+    raise AssertionError("zero share rate accepted")
+except ValueError:
+    pass
+server.enable_vardiff(shares_per_minute=6, min_difficulty=2.0 ** -40,
+                      retarget_seconds=30)
+server.set_worker_difficulty(1, 2.0 ** -40)
+server.set_worker_difficulty(2, 2.0 ** -60)   # clamped to min_difficulty
+assert server.worker_difficulty(2) == 2.0 ** -40
+assert server.worker_difficulty(9) is None
+assert abs(server.stats()["target_share_rate"] - 0.1) < 1e-9
+server.start()
+try:
+    server.enable_vardiff(shares_per_minute=60)
+    raise AssertionError("vardiff replaced while running")
+except RuntimeError:
+    pass
+
+# Forty shares at once from worker 1 is far over 6 a minute: it is
+# retargeted without waiting out the window, and its in-flight shares
+# are still taken at the old difficulty
+count = 40
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+sock.connect(path)
+sock.sendall(b"".join(pack_share(i, 1, os.urandom(80)) for i in range(count)))
+verdicts, buffered = [], b""
+while len(verdicts) < count:
+    more, buffered = read_verdicts(sock, buffered)
+    verdicts += more
+sock.close()
+assert all(v[2] == 0 for v in verdicts)
+
+changes = server.difficulty_changes()
+assert [w for w, _ in changes] == [1]
+assert changes[0][1] > 2.0 ** -40 and changes[0][1] == server.worker_difficulty(1)
+assert server.worker_difficulty(2) == 2.0 ** -40
+assert server.difficulty_changes() == []
+stats = server.stats()
+assert stats["retargets"] >= 1 and stats["expected_share_rate"] > 0
+
+server.remove_worker(1)
+assert server.worker_difficulty(1) is None
+server.stop()
+server.enable_vardiff(shares_per_minute=60)
+assert server.worker_difficulty(2) is None
+
+# A budget of 2 shares a second is split over every known worker, those
+# given fixed difficulties before vardiff was enabled too
+path = os.path.join(tempfile.mkdtemp(), "budget.sock")
+budgeted = nudd_hash.ShareServer(path, max_batch=8, max_wait_ms=1.0)
+for worker in range(41, 81):
+    budgeted.set_worker_difficulty(worker, 2.0 ** -40)
+budgeted.enable_vardiff(shares_per_minute=6, budget=2)
+assert budgeted.worker_difficulty(41) is None
+assert abs(budgeted.stats()["target_share_rate"] - 2.0 / 40) < 1e-9
+for worker in range(1, 41):
+    budgeted.set_worker_difficulty(worker, 1.0)
+assert abs(budgeted.stats()["target_share_rate"] - 2.0 / 80) < 1e-9
+
+# and bounds hashing outright: of a burst of 40 only about a second's worth
+# is validated, the rest answered over budget
+budgeted.start()
+sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+sock.connect(path)
+headers = [os.urandom(80) for i in range(count)]
+sock.sendall(b"".join(pack_share(i, 41, headers[i]) for i in range(count)))
+verdicts, buffered = [], b""
+while len(verdicts) < count:
+    more, buffered = read_verdicts(sock, buffered)
+    verdicts += more
+statuses = [v[2] for v in verdicts]
+assert set(statuses) <= {0, 4} and 2 <= statuses.count(0) <= 3, statuses
+stats = budgeted.stats()
+assert stats["over_budget"] == statuses.count(4) and stats["accepted"] == statuses.count(0)
+
+# A share turned away over budget is validated when resubmitted, not
+# taken for a duplicate, once the bucket has a token again
+refused = [v[0] for v in verdicts if v[2] == 4][0]
+time.sleep(0.6)
+sock.sendall(pack_share(count, 41, headers[refused]))
+verdicts = []
+while not verdicts:
+    verdicts, buffered = read_verdicts(sock, buffered)
+sock.close()
+assert verdicts[0][:3] == (count, 41, 0), verdicts
+assert budgeted.stats()["duplicates"] == 0
+for worker in range(41, 81):
+    budgeted.remove_worker(worker)
+assert abs(budgeted.stats()["target_share_rate"] - 2.0 / 40) < 1e-9
+budgeted.stop()
+print("vardiff ok")
@@ -0,0 +1,343 @@
+#include "threadpool.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "tune.h"
+
+/* Foreground waits kept for the latency percentiles */
+#define POOL_WAIT_SAMPLES	1024
+
+/* Quiet spell, in latency targets, before the background limit grows again */
+#define POOL_RECOVERY		20
+
+/* Set while a worker runs a background task, which already holds a slot */
+static thread_local bool pool_in_background = false;
+
+thread_pool::thread_pool(unsigned int threads, std::vector<int> const& cpus)
+    : stopping(false), background_running(0), duty_cycle(1),
+      latency_target(0), foreground_done(0), background_done(0), waits_next(0)
+{
+    if (!threads)
+        threads = cpus.empty() ? std::thread::hardware_concurrency() :
+            (unsigned int)cpus.size();
+    if (!threads)
+        threads = 1;
+    background_cap = background_limit = threads;
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&thread_pool::run, this));
+        nudd_pin_thread(workers.back(), cpus, i);
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+void thread_pool::submit(std::function<void()> task, pool_priority priority)
+{
+    queued_task queued;
+
+    queued.run = std::move(task);
+    queued.queued = clock::now();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (priority == pool_foreground)
+            foreground.push_back(std::move(queued));
+        else
+            background.push_back(std::move(queued));
+    }
+    ready.notify_one();
+}
+
+void thread_pool::set_cpu_budget(double cpu_budget)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        unsigned int cores = (unsigned int)ceil(cpu_budget);
+
+        if (cpu_budget <= 0 || cores >= workers.size()) {
+            background_cap = (unsigned int)workers.size();
+            duty_cycle = cpu_budget <= 0 ? 1 : std::min(1.0, cpu_budget / background_cap);
+        } else {
+            background_cap = cores;
+            duty_cycle = cpu_budget / cores;
+        }
+        background_limit = background_cap;
+        last_change = clock::now();
+    }
+    ready.notify_all();
+    slot_free.notify_all();
+}
+
+void thread_pool::set_latency_target(std::chrono::microseconds target)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        latency_target = target;
+        background_limit = background_cap;
+        last_change = clock::now();
+    }
+    ready.notify_all();
+    slot_free.notify_all();
+}
+
+void thread_pool::foreground_waited(clock::time_point now, clock::duration wait)
+{
+    uint32_t us = (uint32_t)std::min<long long>(UINT32_MAX,
+        std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+
+    if (waits_us.size() < POOL_WAIT_SAMPLES)
+        waits_us.push_back(us);
+    else
+        waits_us[waits_next++ % POOL_WAIT_SAMPLES] = us;
+
+    /* Multiplicative decrease, at most once per target interval */
+    if (latency_target.count() && wait > latency_target &&
+        now - last_change >= latency_target) {
+        background_limit = std::max(1u, background_limit / 2);
+        last_change = now;
+    }
+}
+
+void thread_pool::background_finished(clock::time_point now)
+{
+    background_done++;
+    if (background_limit < background_cap &&
+        now - last_change >= std::max<clock::duration>(
+            POOL_RECOVERY * latency_target, std::chrono::milliseconds(50))) {
+        background_limit++;
+        last_change = now;
+        ready.notify_one();
+        slot_free.notify_all();
+    }
+}
+
+/* A background slot was given back; lock held */
+void thread_pool::background_released()
+{
+    background_running--;
+    slot_free.notify_all();
+}
+
+thread_pool_stats thread_pool::stats()
+{
+    thread_pool_stats stats;
+    std::vector<uint32_t> waits;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stats.foreground_queued = foreground.size();
+        stats.background_queued = background.size();
+        stats.background_running = background_running;
+        stats.background_limit = background_limit;
+        stats.foreground_done = foreground_done;
+        stats.background_done = background_done;
+        waits = waits_us;
+    }
+    stats.foreground_wait_p50_us = stats.foreground_wait_p99_us = 0;
+    if (!waits.empty()) {
+        std::sort(waits.begin(), waits.end());
+        stats.foreground_wait_p50_us = waits[(waits.size() - 1) / 2];
+        stats.foreground_wait_p99_us = waits[(waits.size() - 1) * 99 / 100];
+    }
+    return stats;
+}
+
+namespace {
+
+struct parallel_range {
+    std::function<void(size_t)> const* body;
+    size_t count;
+    std::atomic<size_t> next;
+    size_t finished;
+    std::mutex lock;
+    std::condition_variable done;
+
+    /* Runs indices until none are left; helpers that start late do nothing */
+    void drain()
+    {
+        size_t ran = 0;
+        for (size_t i; (i = next++) < count; ran++)
+            (*body)(i);
+        finish(ran);
+    }
+
+    /* Runs a single index; false once none are left */
+    bool step()
+    {
+        size_t i = next++;
+
+        if (i >= count)
+            return false;
+        (*body)(i);
+        finish(1);
+        return true;
+    }
+
+    void finish(size_t ran)
+    {
+        if (!ran)
+            return;
+        std::lock_guard<std::mutex> guard(lock);
+        finished += ran;
+        if (finished == count)
+            done.notify_all();
+    }
+};
+
+/* A background helper goes back in the queue after every index */
+void parallel_step(thread_pool *pool, std::shared_ptr<parallel_range> range)
+{
+    if (range->step())
+        pool->submit([pool, range]() { parallel_step(pool, range); },
+            pool_background);
+}
+
+}
+
+void thread_pool::parallel_for(size_t count,
+    std::function<void(size_t)> const& body, pool_priority priority)
+{
+    if (!count)
+        return;
+
+    std::shared_ptr<parallel_range> range(new parallel_range());
+    range->body = &body;
+    range->count = count;
+    range->next = 0;
+    range->finished = 0;
+
+    size_t helpers = count - 1 < workers.size() ? count - 1 : workers.size();
+    for (size_t i = 0; i < helpers; i++) {
+        if (priority == pool_foreground)
+            submit([range]() { range->drain(); });
+        else
+            submit([this, range]() { parallel_step(this, range); },
+                pool_background);
+    }
+
+    if (priority == pool_foreground || pool_in_background)
+        range->drain();
+    else
+        run_background_steps([range]() { return range->step(); });
+    std::unique_lock<std::mutex> guard(range->lock);
+    while (range->finished < count)
+        range->done.wait(guard);
+}
+
+/*
+ * The calling thread's share of a background parallel_for.  It waits for a
+ * slot like a worker taking a background task, and after each index keeps
+ * the slot idle for the same duty-cycle pause, so bulk work stays within
+ * the CPU budget whichever thread runs it.
+ */
+void thread_pool::run_background_steps(std::function<bool()> const& step)
+{
+    for (;;) {
+        double duty;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (background_running >= background_limit)
+                slot_free.wait(guard);
+            background_running++;
+            duty = duty_cycle;
+        }
+
+        clock::time_point started = clock::now();
+        bool ran = step();
+        clock::time_point now = clock::now();
+
+        if (ran && duty < 1)
+            std::this_thread::sleep_for((now - started) * (1 / duty - 1));
+        std::lock_guard<std::mutex> guard(lock);
+        if (ran)
+            background_finished(now);
+        background_released();
+        if (!ran)
+            return;
+    }
+}
+
+void thread_pool::run()
+{
+    /* After a background task the worker keeps its slot until idle_until */
+    bool holding = false;
+    clock::time_point idle_until;
+
+    for (;;) {
+        queued_task task;
+        bool is_background = false;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                clock::time_point now = clock::now();
+                if (holding && now >= idle_until) {
+                    holding = false;
+                    background_released();
+                }
+                if (!foreground.empty()) {
+                    task = std::move(foreground.front());
+                    foreground.pop_front();
+                    foreground_waited(now, now - task.queued);
+                    break;
+                }
+                if (!holding && !background.empty() &&
+                    background_running < background_limit) {
+                    task = std::move(background.front());
+                    background.pop_front();
+                    background_running++;
+                    is_background = true;
+                    break;
+                }
+                if (stopping && background.empty()) {
+                    if (holding)
+                        background_released();
+                    return;
+                }
+                if (holding)
+                    ready.wait_until(guard, idle_until);
+                else
+                    ready.wait(guard);
+            }
+        }
+
+        clock::time_point started = clock::now();
+        pool_in_background = is_background;
+        task.run();
+        pool_in_background = false;
+        clock::time_point now = clock::now();
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (!is_background) {
+            foreground_done++;
+            continue;
+        }
+        background_finished(now);
+        if (duty_cycle < 1) {
+            holding = true;
+            idle_until = now + std::chrono::duration_cast<clock::duration>(
+                (now - started) * (1 / duty_cycle - 1));
+        } else {
+            background_released();
+        }
+    }
+}
+
+thread_pool& hashing_pool()
+{
+    /* Deliberately leaked: joining the workers from a static destructor
+     * would make interpreter exit wait for in-flight hashes */
+    static thread_pool* pool = new thread_pool(nudd_host_profile().threads,
+        nudd_host_profile().smt ? std::vector<int>() : nudd_cpu_list(false));
+    return *pool;
+}
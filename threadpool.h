@@ -0,0 +1,134 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Foreground tasks are interactive verifies someone is waiting on; they
+ * always run before any queued background (bulk) task.
+ */
+enum pool_priority {
+    pool_foreground,
+    pool_background
+};
+
+struct thread_pool_stats {
+    size_t foreground_queued;
+    size_t background_queued;
+    unsigned int background_running;
+    unsigned int background_limit;
+    uint64_t foreground_done;
+    uint64_t background_done;
+
+    /* Queueing delay of recent foreground tasks */
+    double foreground_wait_p50_us;
+    double foreground_wait_p99_us;
+};
+
+/*
+ * Fixed-size pool of native hashing threads.  Tasks run without the Python
+ * GIL, so they must not touch Python objects; results are handed back to
+ * the interpreter by whoever submitted the task.
+ *
+ * Background work is governed so the pool can share a host with latency
+ * sensitive services: at most background_limit workers run it at a time,
+ * each idling after a task long enough to keep to the CPU budget's duty
+ * cycle, and the limit is halved whenever a foreground task waited longer
+ * than the latency target, then raised one worker at a time once
+ * foreground waits stay short.  Foreground work is never throttled.
+ */
+class thread_pool {
+public:
+    /*
+     * threads == 0 means one thread per hardware thread, or per CPU in
+     * cpus if given; worker i is then pinned to cpus[i % cpus.size()]
+     */
+    explicit thread_pool(unsigned int threads = 0,
+        std::vector<int> const& cpus = std::vector<int>());
+    ~thread_pool();
+
+    void submit(std::function<void()> task,
+        pool_priority priority = pool_foreground);
+
+    /*
+     * Calls body(0) .. body(count - 1) across the pool and returns once all
+     * of them have finished.  The calling thread takes part, so this is
+     * safe to use from inside a pool task.  In the background, workers
+     * requeue after every index so foreground tasks can cut in, and the
+     * calling thread claims a background slot and keeps the duty cycle
+     * for each index it runs, just as a worker would; inside a background
+     * task it already holds one.
+     */
+    void parallel_for(size_t count, std::function<void(size_t)> const& body,
+        pool_priority priority = pool_foreground);
+
+    /*
+     * Caps background work at cpu_budget cores; a fractional budget is met
+     * with a duty cycle.  0 lifts the cap.
+     */
+    void set_cpu_budget(double cpu_budget);
+
+    /* Foreground queueing delay that makes background work back off; 0 never does */
+    void set_latency_target(std::chrono::microseconds target);
+
+    thread_pool_stats stats();
+
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    struct queued_task {
+        std::function<void()> run;
+        clock::time_point queued;
+    };
+
+    thread_pool(thread_pool const&);
+    thread_pool& operator=(thread_pool const&);
+
+    void run();
+
+    /* Calls step() under a background slot until it returns false */
+    void run_background_steps(std::function<bool()> const& step);
+
+    /* Controller updates; lock held */
+    void foreground_waited(clock::time_point now, clock::duration wait);
+    void background_finished(clock::time_point now);
+    void background_released();
+
+    std::vector<std::thread> workers;
+    std::deque<queued_task> foreground;
+    std::deque<queued_task> background;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable slot_free;
+    bool stopping;
+
+    unsigned int background_cap;
+    unsigned int background_limit;
+    unsigned int background_running;
+    double duty_cycle;
+    clock::duration latency_target;
+    clock::time_point last_change;
+
+    uint64_t foreground_done;
+    uint64_t background_done;
+    std::vector<uint32_t> waits_us;
+    size_t waits_next;
+};
+
+/*
+ * Process-wide pool shared by the asynchronous and batched entry points,
+ * sized and placed by the host profile
+ */
+extern thread_pool& hashing_pool();
+
+#endif
@@ -0,0 +1,48 @@
+"""Scaling of the parallel iterated bcrypt reduction with core count.
+
+Hashes payloads of a growing number of 72-byte blocks with
+bcryptIterated(), serially and with each round's blocks spread over the
+native thread pool, and prints both rates and the speedup. The pool has
+one thread per core (or what the host profile chose), so the speedup on
+large payloads should approach that thread count.
+
+    PYTHONPATH=. python3 tools/iterated_bench.py --blocks 8 64 512
+"""
+
+import argparse
+import os
+import time
+
+import nudd_hash
+
+
+def rate(data, parallel, seconds):
+    done = 0
+    started = time.perf_counter()
+    while True:
+        nudd_hash.bcryptIterated(data, parallel=parallel)
+        done += 1
+        elapsed = time.perf_counter() - started
+        if elapsed >= seconds:
+            return done * len(data) / elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--blocks", type=int, nargs="+", default=[8, 64, 512])
+    parser.add_argument("--seconds", type=float, default=1.0)
+    args = parser.parse_args()
+
+    threads = nudd_hash.hostProfile()["threads"] or os.cpu_count()
+    print("pool threads %d" % threads)
+    print("%8s %14s %14s %8s" % ("blocks", "serial KiB/s", "parallel KiB/s", "speedup"))
+    for blocks in args.blocks:
+        data = os.urandom(72 * blocks)
+        serial = rate(data, False, args.seconds)
+        parallel = rate(data, True, args.seconds)
+        print("%8d %14.1f %14.1f %7.2fx" % (blocks, serial / 1024,
+              parallel / 1024, parallel / serial))
+
+
+if __name__ == "__main__":
+    main()
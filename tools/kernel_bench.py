@@ -0,0 +1,59 @@
+"""Per-kernel throughput with hardware counters, where the host exposes them.
+
+Runs each hashing kernel on one thread through nudd_hash.benchmark() and
+prints hashes per second next to IPC and cycles, L1D, last-level cache,
+branch and dTLB misses per hash. Counters the kernel or container will
+not give are shown as "-", with the reason printed once.
+
+    PYTHONPATH=. python3 tools/kernel_bench.py --count 200 --tmto 1 4 --interleave 1 4
+"""
+
+import argparse
+
+import nudd_hash
+
+COLUMNS = ("cycles", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses")
+
+
+def per_hash(report, counter):
+    if counter not in report:
+        return "-"
+    return "%.1f" % (report[counter] / float(report["hashes"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--count", type=int, default=100)
+    parser.add_argument("--n", type=int, default=1024)
+    parser.add_argument("--r", type=int, default=1)
+    parser.add_argument("--tmto", type=int, nargs="+", default=[1, 4, 16])
+    parser.add_argument("--interleave", type=int, nargs="+", default=[1, 4])
+    parser.add_argument("--no-counters", dest="counters", action="store_false")
+    args = parser.parse_args()
+
+    runs = [("nudd", {}), ("nudd_interleaved", {}), ("bcrypt", {})]
+    for tmto in args.tmto:
+        for interleave in args.interleave:
+            runs.append(("scrypt", dict(n=args.n, r=args.r, tmto=tmto, interleave=interleave)))
+
+    print("%-26s %12s %6s" % ("kernel", "hashes/s", "IPC") +
+          "".join(" %13s" % column for column in COLUMNS))
+    errors = set()
+    for kernel, options in runs:
+        report = nudd_hash.benchmark(kernel, args.count, args.counters, **options)
+        if "counter_error" in report:
+            errors.add(report["counter_error"])
+        label = kernel
+        if options:
+            label += " tmto=%d x%d" % (options["tmto"], options["interleave"])
+        ipc = "-"
+        if "cycles" in report and "instructions" in report and report["cycles"]:
+            ipc = "%.2f" % (report["instructions"] / float(report["cycles"]))
+        print("%-26s %12.1f %6s" % (label, report["hashes"] / report["seconds"], ipc) +
+              "".join(" %13s" % per_hash(report, column) for column in COLUMNS))
+    for error in sorted(errors):
+        print("counters unavailable: %s" % error)
+
+
+if __name__ == "__main__":
+    main()
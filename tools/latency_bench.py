@@ -0,0 +1,50 @@
+"""Single-header nudd_hash latency: serial halves against both at once.
+
+Hashes --count distinct headers one at a time through each path and prints
+the median and 99th percentile latency, with the speedup over getPoWHash.
+
+    PYTHONPATH=. python3 tools/latency_bench.py --count 500
+"""
+
+import argparse
+import struct
+import time
+
+import nudd_hash
+from share_load import percentile
+
+PATHS = (
+    ("serial", nudd_hash.getPoWHash),
+    ("interleaved", nudd_hash.getPoWHashLowLatency),
+    ("threaded", lambda header: nudd_hash.getPoWHashLowLatency(header, threaded=True)),
+)
+
+
+def measure(hash_header, headers):
+    samples = []
+    for header in headers:
+        started = time.perf_counter()
+        hash_header(header)
+        samples.append(time.perf_counter() - started)
+    return samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--count", type=int, default=500)
+    args = parser.parse_args()
+
+    headers = [bytes(range(76)) + struct.pack("<I", n) for n in range(args.count)]
+    for _, hash_header in PATHS:
+        assert hash_header(headers[0]) == nudd_hash.getPoWHash(headers[0])
+    serial = None
+    for name, hash_header in PATHS:
+        samples = measure(hash_header, headers)
+        p50 = percentile(samples, 0.5)
+        serial = serial or p50
+        print("%-12s p50 %8.1f us  p99 %8.1f us  %.2fx" % (
+            name, p50 * 1e6, percentile(samples, 0.99) * 1e6, serial / p50))
+
+
+if __name__ == "__main__":
+    main()
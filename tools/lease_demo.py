@@ -0,0 +1,104 @@
+"""Runs a LeaseCoordinator with 1..N local worker processes.
+
+For every worker count it reports the aggregate hashrate the coordinator
+sees, so scaling can be checked on one box, and verifies every share the
+workers reported against nudd_hash.getPoWHash.
+
+    PYTHONPATH=. python3 tools/lease_demo.py --workers 4 --seconds 5
+    PYTHONPATH=. python3 tools/lease_demo.py --worker ADDRESS   # one worker
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+import nudd_hash
+from pool_standin import Job, target_from_difficulty
+
+EXTRANONCE1 = b"\x00\x00\x00\x2a"
+
+
+def start_job(coordinator, difficulty, job_id=1):
+    job = Job(job_id, 4)
+    coordinator.set_job(str(job.id), job.prevhash, job.coinb1, job.coinb2,
+                        job.branch, job.version, job.nbits, job.ntime,
+                        EXTRANONCE1, job.extranonce2_size, difficulty)
+    return job
+
+
+def check_shares(job, shares, difficulty):
+    """Returns how many of the reported shares are correct."""
+    good = 0
+    for worker, job_id, extranonce2, ntime, nonce, pow_hash in shares:
+        header = job.header(EXTRANONCE1, extranonce2.to_bytes(4, "big"), ntime, nonce)
+        if (job_id == str(job.id) and pow_hash == nudd_hash.getPoWHash(header) and
+                int.from_bytes(pow_hash, "little") <= target_from_difficulty(difficulty)):
+            good += 1
+    return good
+
+
+def spawn_worker(address, name, threads=1):
+    here = os.path.dirname(os.path.abspath(__file__))
+    env = dict(os.environ)
+    env["PYTHONPATH"] = os.pathsep.join([os.path.dirname(here), env.get("PYTHONPATH", "")])
+    return subprocess.Popen([sys.executable, os.path.join(here, "lease_demo.py"),
+                             "--worker", address, "--name", name,
+                             "--threads", str(threads)], env=env)
+
+
+def run_worker(address, name, threads):
+    worker = nudd_hash.LeaseWorker(address, threads, name)
+    worker.start()
+    try:
+        while worker.stats()["connected"]:
+            time.sleep(0.2)
+    except KeyboardInterrupt:
+        pass
+    worker.stop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--workers", type=int, default=4)
+    parser.add_argument("--seconds", type=float, default=5.0)
+    parser.add_argument("--lease-size", type=int, default=4096)
+    parser.add_argument("--difficulty", type=float, default=2.0 ** -28)
+    parser.add_argument("--address", help="host:port or socket path to listen on")
+    parser.add_argument("--worker", metavar="ADDRESS", help="run a single worker instead")
+    parser.add_argument("--name", default="")
+    parser.add_argument("--threads", type=int, default=1)
+    args = parser.parse_args()
+
+    if args.worker:
+        run_worker(args.worker, args.name, args.threads)
+        return
+
+    address = args.address or os.path.join(tempfile.mkdtemp(), "lease.sock")
+    coordinator = nudd_hash.LeaseCoordinator(address, args.lease_size)
+    coordinator.start()
+    job = start_job(coordinator, args.difficulty)
+
+    baseline = None
+    for count in range(1, args.workers + 1):
+        workers = [spawn_worker(address, "w%d" % i) for i in range(count)]
+        time.sleep(1.0)
+        before = coordinator.stats()["hashes"]
+        time.sleep(args.seconds)
+        rate = (coordinator.stats()["hashes"] - before) / args.seconds
+        for worker in workers:
+            worker.terminate()
+            worker.wait()
+        baseline = baseline or rate
+        print("%d workers: %8.1f H/s  (%.2fx)" % (count, rate, rate / baseline))
+
+    shares = coordinator.shares()
+    print("%d shares, %d valid; %s" % (len(shares), check_shares(job, shares, args.difficulty),
+                                       coordinator.stats()))
+    coordinator.stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,29 @@
+/*
+ * Lists the algorithms libnudd provides and runs their self-tests; exits
+ * non-zero if any fails.  Built and run by "make check" against the
+ * shared library, as an embedding program would use it.
+ */
+#include <stdio.h>
+
+#include "nudd.h"
+
+int main(void)
+{
+    int failed = 0;
+    size_t i;
+
+    if (nudd_api_version() != NUDD_API_VERSION) {
+        fprintf(stderr, "libnudd API %d, built against %d\n",
+            nudd_api_version(), NUDD_API_VERSION);
+        return 1;
+    }
+    for (i = 0; i < nudd_algorithm_count(); i++) {
+        const nudd_algorithm *algorithm = nudd_algorithm_at(i);
+        int passed = nudd_algorithm_self_test(algorithm);
+
+        printf("%-8s %-12s %s\n", nudd_algorithm_name(algorithm),
+            nudd_algorithm_kernel(algorithm), passed ? "ok" : "FAILED");
+        failed |= !passed;
+    }
+    return failed;
+}
@@ -0,0 +1,168 @@
+"""Stand-in stratum pool for exercising nudd_hash.Miner locally.
+
+Speaks the line-delimited JSON dialect documented in stratum.h, hands out a
+fresh job every --interval seconds and checks every submitted share by
+rebuilding the header and hashing it with nudd_hash.getPoWHash.
+
+    PYTHONPATH=. python3 tools/pool_standin.py --port 3333 --difficulty 1e-9
+"""
+
+import argparse
+import asyncio
+import hashlib
+import json
+import os
+import struct
+
+import nudd_hash
+
+
+def sha256d(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+def target_from_difficulty(difficulty):
+    return int(0xffff * 2 ** 208 / difficulty)
+
+
+class Job(object):
+    def __init__(self, job_id, extranonce2_size):
+        self.id = job_id
+        self.prevhash = os.urandom(32)
+        self.coinb1 = os.urandom(42)
+        self.coinb2 = os.urandom(30)
+        self.branch = [os.urandom(32) for _ in range(2)]
+        self.version = 0x70
+        self.nbits = 0x1c0fffff
+        self.ntime = 0x52d86d00 + job_id
+        self.extranonce2_size = extranonce2_size
+
+    def notify(self, clean):
+        return [str(self.id), self.prevhash.hex(), self.coinb1.hex(),
+                self.coinb2.hex(), [b.hex() for b in self.branch],
+                "%08x" % self.version, "%08x" % self.nbits,
+                "%08x" % self.ntime, clean]
+
+    def header(self, extranonce1, extranonce2, ntime, nonce):
+        node = sha256d(self.coinb1 + extranonce1 + extranonce2 + self.coinb2)
+        for branch in self.branch:
+            node = sha256d(node + branch)
+        return (struct.pack("<I", self.version) + self.prevhash + node +
+                struct.pack("<III", ntime, self.nbits, nonce))
+
+
+class StandinPool(object):
+    def __init__(self, difficulty=1e-9, interval=0.5, extranonce2_size=4):
+        self.difficulty = difficulty
+        self.interval = interval
+        self.extranonce2_size = extranonce2_size
+        self.jobs = {}
+        self.current = None
+        self.clients = set()
+        self.seen = set()
+        self.accepted = 0
+        self.stale = 0
+        self.invalid = 0
+        self.next_extranonce1 = 1
+        self.next_job = 1
+
+    def new_job(self):
+        job = Job(self.next_job, self.extranonce2_size)
+        self.next_job += 1
+        self.jobs[job.id] = job
+        self.current = job
+        return job
+
+    def broadcast(self, message):
+        line = (json.dumps(message) + "\n").encode()
+        for writer in list(self.clients):
+            writer.write(line)
+
+    async def rotate(self):
+        while True:
+            await asyncio.sleep(self.interval)
+            job = self.new_job()
+            self.broadcast({"id": None, "method": "mining.notify",
+                            "params": job.notify(True)})
+
+    def submit(self, extranonce1, params):
+        user, job_id, extranonce2, ntime, nonce = params[:5]
+        job = self.jobs.get(int(job_id))
+        extranonce2 = bytes.fromhex(extranonce2)
+        key = (job_id, extranonce1, extranonce2, ntime, nonce)
+        if job is None or len(extranonce2) != job.extranonce2_size or key in self.seen:
+            self.invalid += 1
+            return False
+        self.seen.add(key)
+        if job is not self.current:
+            self.stale += 1
+            return False
+        header = job.header(extranonce1, extranonce2, int(ntime, 16), int(nonce, 16))
+        value = int.from_bytes(nudd_hash.getPoWHash(header), "little")
+        if value > target_from_difficulty(self.difficulty):
+            self.invalid += 1
+            return False
+        self.accepted += 1
+        return True
+
+    async def client(self, reader, writer):
+        extranonce1 = struct.pack(">I", self.next_extranonce1)
+        self.next_extranonce1 += 1
+
+        def send(message):
+            writer.write((json.dumps(message) + "\n").encode())
+
+        try:
+            while True:
+                line = await reader.readline()
+                if not line:
+                    break
+                message = json.loads(line)
+                method = message.get("method")
+                if method == "mining.subscribe":
+                    send({"id": message["id"], "error": None,
+                          "result": [[], extranonce1.hex(), self.extranonce2_size]})
+                elif method == "mining.authorize":
+                    send({"id": message["id"], "error": None, "result": True})
+                    send({"id": None, "method": "mining.set_difficulty",
+                          "params": [self.difficulty]})
+                    send({"id": None, "method": "mining.notify",
+                          "params": self.current.notify(True)})
+                    self.clients.add(writer)
+                elif method == "mining.submit":
+                    ok = self.submit(extranonce1, message["params"])
+                    send({"id": message["id"], "result": ok,
+                          "error": None if ok else [23, "rejected", None]})
+                await writer.drain()
+        except ConnectionError:
+            pass
+        finally:
+            self.clients.discard(writer)
+            writer.close()
+
+    async def serve(self, host="127.0.0.1", port=0):
+        self.new_job()
+        server = await asyncio.start_server(self.client, host, port)
+        asyncio.ensure_future(self.rotate())
+        return server
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=3333)
+    parser.add_argument("--difficulty", type=float, default=1e-9)
+    parser.add_argument("--interval", type=float, default=5.0)
+    args = parser.parse_args()
+
+    async def run():
+        pool = StandinPool(args.difficulty, args.interval)
+        server = await pool.serve(args.host, args.port)
+        async with server:
+            await server.serve_forever()
+
+    asyncio.run(run())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,214 @@
+"""Replays a trace of hashing operations at a set concurrency and speed.
+
+A trace is JSON lines, one operation each, t being its arrival time in
+seconds from the start:
+
+    {"t": 0.012, "op": "hash", "header": "<80 bytes hex>"}
+    {"t": 0.013, "op": "check", "header": "<80 bytes hex>"}
+    {"t": 0.020, "op": "batch", "headers": ["<80 bytes hex>", ...]}
+    {"t": 0.031, "op": "bcrypt", "password": "...", "hash": "$2a$05$..."}
+
+Operations are issued open-loop at their arrival times, divided by --speed,
+with at most --concurrency in flight.  Latency counts from the arrival
+time, so waiting behind a burst shows up the way it would in production.
+hash goes through getPoWHashAsync, check and batch through checkPoW and
+checkPoWBatch, bcrypt through bcryptHash; the last three run on a thread
+per in-flight operation.
+
+    PYTHONPATH=. python3 tools/replay.py --generate trace.jsonl --ops 2000 --rate 300
+    PYTHONPATH=. python3 tools/replay.py trace.jsonl --concurrency 16 --speed 2
+"""
+
+import argparse
+import asyncio
+import binascii
+import json
+import os
+import random
+import struct
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import nudd_hash
+
+OPS = ("hash", "check", "batch", "bcrypt")
+BCRYPT_ALPHABET = "./ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+
+
+class Histogram(object):
+    """Log-linear latency buckets in the manner of HdrHistogram.
+
+    Microsecond values below SUB_BUCKETS are kept exactly; above that every
+    power of two is split into SUB_BUCKETS / 2 linear steps, so any recorded
+    value is off by less than 1.6% whatever its magnitude.
+    """
+
+    SUB_BUCKETS = 128
+
+    def __init__(self):
+        self.counts = {}
+        self.total = 0
+        self.maximum = 0
+
+    def record(self, seconds):
+        us = max(0, int(seconds * 1e6))
+        shift = max(0, us.bit_length() - self.SUB_BUCKETS.bit_length() + 1)
+        key = (shift, us >> shift)
+        self.counts[key] = self.counts.get(key, 0) + 1
+        self.total += 1
+        self.maximum = max(self.maximum, us)
+
+    def percentile(self, fraction):
+        """Highest microsecond value equivalent to the given percentile's bucket."""
+        if not self.total:
+            return 0
+        rank = max(1, int(round(fraction * self.total)))
+        seen = 0
+        for shift, step in sorted(self.counts, key=lambda k: k[1] << k[0]):
+            seen += self.counts[(shift, step)]
+            if seen >= rank:
+                return min(self.maximum, ((step + 1) << shift) - 1)
+        return self.maximum
+
+    def summary(self):
+        return "n %6d  p50 %8d  p99 %8d  p999 %8d  max %8d us" % (
+            self.total, self.percentile(0.5), self.percentile(0.99),
+            self.percentile(0.999), self.maximum)
+
+
+# Fixed version and a difficulty-1 compact target, as tools/pool_standin.py
+# hands out: a random nBits is almost never valid, and checkPoW rejects
+# those without hashing anything
+HEADER_VERSION = 0x70
+HEADER_NBITS = 0x1d00ffff
+
+
+def random_header(rng):
+    """Random previous hash, merkle root, time and nonce in a well-formed header."""
+    body = bytes(rng.getrandbits(8) for _ in range(68))
+    return (struct.pack("<I", HEADER_VERSION) + body +
+            struct.pack("<II", HEADER_NBITS, rng.getrandbits(32)))
+
+
+def generate_trace(ops, rate, mix, cost=5, batch=16, seed=1):
+    """Bursty arrivals: the rate alternates between 4x and 1/4 of rate."""
+    rng = random.Random(seed)
+    names, weights = zip(*sorted(mix.items()))
+    passwords = ["password%d" % i for i in range(8)]
+    hashes = {}
+    trace = []
+    t = 0.0
+    burst = False
+    for _ in range(ops):
+        if rng.random() < 0.02:
+            burst = not burst
+        t += rng.expovariate(rate * (4 if burst else 0.25))
+        op = rng.choices(names, weights)[0]
+        entry = {"t": round(t, 6), "op": op}
+        if op in ("hash", "check"):
+            entry["header"] = binascii.hexlify(random_header(rng)).decode()
+        elif op == "batch":
+            entry["headers"] = [binascii.hexlify(random_header(rng)).decode()
+                                for _ in range(batch)]
+        else:
+            password = rng.choice(passwords)
+            if password not in hashes:
+                salt = "".join(rng.choice(BCRYPT_ALPHABET) for _ in range(22))
+                hashes[password] = nudd_hash.bcryptHash(password, "$2a$%02d$%s" % (cost, salt))
+            entry["password"] = password
+            entry["hash"] = hashes[password]
+        trace.append(entry)
+    return trace
+
+
+async def replay(trace, concurrency, speed=1.0):
+    """Returns ({op: Histogram}, elapsed seconds, failed operations)."""
+    loop = asyncio.get_running_loop()
+    executor = ThreadPoolExecutor(concurrency)
+    slots = asyncio.Semaphore(concurrency)
+    histograms = dict((op, Histogram()) for op in OPS + ("all",))
+    failed = [0]
+
+    async def run(entry, arrival):
+        try:
+            op = entry["op"]
+            if op == "hash":
+                await nudd_hash.getPoWHashAsync(binascii.unhexlify(entry["header"]))
+            elif op == "check":
+                await loop.run_in_executor(executor, nudd_hash.checkPoW,
+                                           binascii.unhexlify(entry["header"]))
+            elif op == "batch":
+                await loop.run_in_executor(executor, nudd_hash.checkPoWBatch,
+                                           [binascii.unhexlify(h) for h in entry["headers"]])
+            else:
+                hashed = await loop.run_in_executor(executor, nudd_hash.bcryptHash,
+                                                    entry["password"], entry["hash"])
+                if hashed != entry["hash"]:
+                    failed[0] += 1
+            elapsed = time.perf_counter() - arrival
+            histograms[op].record(elapsed)
+            histograms["all"].record(elapsed)
+        finally:
+            slots.release()
+
+    started = time.perf_counter()
+    tasks = []
+    for entry in trace:
+        arrival = started + entry["t"] / speed
+        delay = arrival - time.perf_counter()
+        if delay > 0:
+            await asyncio.sleep(delay)
+        await slots.acquire()
+        tasks.append(asyncio.ensure_future(run(entry, arrival)))
+    await asyncio.gather(*tasks)
+    elapsed = time.perf_counter() - started
+    executor.shutdown()
+    return histograms, elapsed, failed[0]
+
+
+def parse_mix(text):
+    mix = {}
+    for part in text.split(","):
+        name, weight = part.split("=")
+        if name not in OPS:
+            raise argparse.ArgumentTypeError("unknown operation %r" % name)
+        mix[name] = float(weight)
+    return mix
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", nargs="?", help="trace to replay")
+    parser.add_argument("--generate", metavar="PATH", help="write a synthetic trace and exit")
+    parser.add_argument("--ops", type=int, default=1000)
+    parser.add_argument("--rate", type=float, default=200.0, help="operations per second; bursts run at 4x it, lulls at 1/4")
+    parser.add_argument("--mix", type=parse_mix, default="hash=6,check=2,batch=1,bcrypt=1")
+    parser.add_argument("--cost", type=int, default=5, help="bcrypt cost of generated hashes")
+    parser.add_argument("--concurrency", type=int, default=16)
+    parser.add_argument("--speed", type=float, default=1.0, help="arrival time divisor")
+    args = parser.parse_args()
+
+    if args.generate:
+        trace = generate_trace(args.ops, args.rate, args.mix, args.cost)
+        with open(args.generate, "w") as f:
+            for entry in trace:
+                f.write(json.dumps(entry) + "\n")
+        print("%d operations over %.1fs written to %s" %
+              (len(trace), trace[-1]["t"] if trace else 0, args.generate))
+        return
+    if not args.trace or not os.path.exists(args.trace):
+        parser.error("a trace to replay is required")
+
+    with open(args.trace) as f:
+        trace = [json.loads(line) for line in f if line.strip()]
+    histograms, elapsed, failed = asyncio.run(replay(trace, args.concurrency, args.speed))
+    print("%d operations in %.2fs: %.0f ops/s, %d failed" %
+          (len(trace), elapsed, len(trace) / elapsed, failed))
+    for op in OPS + ("all",):
+        if histograms[op].total:
+            print("%-7s %s" % (op, histograms[op].summary()))
+    print(nudd_hash.poolStats())
+
+
+if __name__ == "__main__":
+    main()
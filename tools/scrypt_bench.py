@@ -0,0 +1,78 @@
+"""scrypt throughput per core against the TMTO factor and interleave width.
+
+Runs one hashing thread per core, each hashing batches of distinct 80-byte
+headers with scryptBatch at --n, r=1 and p=1, the proof-of-work shape, so
+every call steps interleave different headers through ROMix together on its
+own thread. For each tmto factor it prints the scratch memory a core touches
+and hashes per second per core, relative to storing the whole of V with one
+header at a time.
+
+    PYTHONPATH=. python3 tools/scrypt_bench.py --n 1024 --seconds 2
+"""
+
+import argparse
+import os
+import struct
+import threading
+import time
+
+import nudd_hash
+
+
+def headers_prefix(index):
+    return struct.pack("<I", index) + bytes(72)
+
+
+def throughput(threads, seconds, n, tmto, interleave):
+    counts = [0] * threads
+    deadline = time.perf_counter() + seconds
+
+    def work(index):
+        nonce = 0
+        done = 0
+        while time.perf_counter() < deadline:
+            headers = [headers_prefix(index) + struct.pack("<I", nonce + i)
+                       for i in range(interleave)]
+            nudd_hash.scryptBatch(headers, n, 1, 32, tmto=tmto,
+                                  interleave=interleave, parallel=False)
+            nonce += interleave
+            done += interleave
+        counts[index] = done
+
+    workers = [threading.Thread(target=work, args=(i,)) for i in range(threads)]
+    started = time.perf_counter()
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    return sum(counts) / (time.perf_counter() - started) / threads
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--n", type=int, default=1024)
+    parser.add_argument("--seconds", type=float, default=2.0)
+    parser.add_argument("--threads", type=int, default=os.cpu_count() or 1)
+    parser.add_argument("--tmto", type=int, nargs="+", default=[1, 2, 4, 8, 16, 32])
+    parser.add_argument("--interleave", type=int, nargs="+", default=[1, 4, 8])
+    args = parser.parse_args()
+
+    for tmto in args.tmto:
+        for interleave in args.interleave:
+            headers = [headers_prefix(i) + bytes(4) for i in range(interleave)]
+            assert nudd_hash.scryptBatch(headers, 64, tmto=min(tmto, 64),
+                                         interleave=interleave) == \
+                [nudd_hash.scrypt(h, h, 64, 1, 1, 32) for h in headers]
+    baseline = None
+    print("%5s %10s %12s %14s %8s" % ("tmto", "interleave", "scratch KB", "hashes/s/core", "vs k=1"))
+    for interleave in args.interleave:
+        for tmto in args.tmto:
+            rate = throughput(args.threads, args.seconds, args.n, tmto, interleave)
+            baseline = baseline or rate
+            scratch = interleave * 128 * ((args.n + tmto - 1) // tmto + 5)
+            print("%5d %10d %12.1f %14.1f %7.2fx" % (
+                tmto, interleave, scratch / 1024.0, rate, rate / baseline))
+
+
+if __name__ == "__main__":
+    main()
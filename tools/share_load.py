@@ -0,0 +1,121 @@
+"""Load generator for nudd_hash.ShareServer.
+
+Opens --connections Unix socket connections, keeps up to --window shares in
+flight on each and reports shares/second and verdict latency percentiles.
+Without --path it starts a ShareServer in-process with the given batching
+settings; every worker gets --difficulty.
+
+    PYTHONPATH=. python3 tools/share_load.py --shares 2000 --max-batch 32 --max-wait-ms 1
+"""
+
+import argparse
+import os
+import socket
+import struct
+import tempfile
+import threading
+import time
+
+REQUEST = struct.Struct("<QII80s")
+VERDICT = struct.Struct("<QIB3x32s")
+STATUS = ("accepted", "low difficulty", "duplicate", "unknown worker", "over budget")
+
+
+def pack_share(share_id, worker, header):
+    return REQUEST.pack(share_id, worker, 0, header)
+
+
+def read_verdicts(sock, buffered):
+    """Returns (verdicts, leftover bytes) after one recv, or None on EOF."""
+    data = sock.recv(65536)
+    if not data:
+        return None
+    buffered += data
+    whole = len(buffered) - len(buffered) % VERDICT.size
+    verdicts = [VERDICT.unpack_from(buffered, i) for i in range(0, whole, VERDICT.size)]
+    return verdicts, buffered[whole:]
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def run_connection(path, worker, count, window, duplicate_rate, latencies, statuses):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(path)
+    sent_at = {}
+    previous = None
+    buffered = b""
+    sent = done = 0
+
+    while done < count:
+        while sent < count and sent - done < window:
+            if previous is not None and os.urandom(1)[0] < 256 * duplicate_rate:
+                header = previous
+            else:
+                header = previous = os.urandom(80)
+            sent_at[sent] = time.perf_counter()
+            sock.sendall(pack_share(sent, worker, header))
+            sent += 1
+        result = read_verdicts(sock, buffered)
+        if result is None:
+            break
+        verdicts, buffered = result
+        now = time.perf_counter()
+        for share_id, _, status, _ in verdicts:
+            latencies.append(now - sent_at.pop(share_id))
+            statuses[status] += 1
+            done += 1
+    sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--path", help="connect to a running server instead of starting one")
+    parser.add_argument("--connections", type=int, default=4)
+    parser.add_argument("--shares", type=int, default=1000, help="shares per connection")
+    parser.add_argument("--window", type=int, default=16)
+    parser.add_argument("--duplicate-rate", type=float, default=0.05)
+    parser.add_argument("--difficulty", type=float, default=2.0 ** -28)
+    parser.add_argument("--max-batch", type=int, default=64)
+    parser.add_argument("--max-wait-ms", type=float, default=2.0)
+    args = parser.parse_args()
+
+    server = None
+    path = args.path
+    if path is None:
+        import nudd_hash
+        path = os.path.join(tempfile.mkdtemp(), "shares.sock")
+        server = nudd_hash.ShareServer(path, args.max_batch, args.max_wait_ms)
+        for worker in range(args.connections):
+            server.set_worker_difficulty(worker, args.difficulty)
+        server.start()
+
+    latencies = []
+    statuses = [0] * len(STATUS)
+    threads = [threading.Thread(target=run_connection,
+                                args=(path, worker, args.shares, args.window,
+                                      args.duplicate_rate, latencies, statuses))
+               for worker in range(args.connections)]
+    started = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - started
+
+    print("%d verdicts in %.2fs: %.0f shares/s" %
+          (len(latencies), elapsed, len(latencies) / elapsed))
+    print("latency ms: p50 %.2f  p99 %.2f  max %.2f" %
+          tuple(1e3 * percentile(latencies, f) for f in (0.5, 0.99, 1.0)))
+    print(", ".join("%s %d" % pair for pair in zip(STATUS, statuses)))
+    if server is not None:
+        print(server.stats())
+        server.stop()
+
+
+if __name__ == "__main__":
+    main()
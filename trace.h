@@ -0,0 +1,115 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Static tracepoints under the "nudd_hash" provider.  With <sys/sdt.h>
+ * (systemtap-sdt-dev) at build time each probe is a single nop plus an ELF
+ * note, free until a tracer attaches; without it they compile to nothing.
+ * Every probe has an SDT semaphore, which tracers raise while attached, so
+ * the clock behind a duration argument is only read when someone is
+ * listening.
+ *
+ *     bpftrace -l 'usdt:./nudd_hash*.so:nudd_hash:*'
+ *     bpftrace -e 'usdt:./nudd_hash*.so:nudd_hash:batch__done
+ *         { @us = hist(arg1 / 1000); }'
+ *
+ * Probe names pair up as name__entry / name__return where a duration is
+ * interesting; arguments are integers or pointers, never anything that
+ * costs more than a register move to produce.
+ *
+ *   hash__entry(header, mode)          hash__return(header, mode)
+ *       mode 0: serial, 1: interleaved, 2: threaded
+ *   iterated__entry(length)            iterated__return(length)
+ *   bf__entry(cost, key_length)        bf__return(cost, failed)
+ *   batch__submit(count, priority)     batch__done(count, ns)
+ *   scan__job(epoch, begin, end)       scan__switch(ns)
+ *   scan__claim(position, chunk)       scan__share(nonce, dropped)
+ *   scrypt__entry(N, r, p)             scrypt__return(N, failed)
+ *   scrypt__lane(lane, ns)
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES	1
+#include <sys/sdt.h>
+#define NUDD_TRACE	1
+#endif
+#endif
+
+#ifdef NUDD_TRACE
+/*
+ * The probe notes point at these.  Weak, so every object that includes
+ * this header shares one per probe per library; hidden, so the library's
+ * probes never share them with another's.
+ */
+#define NUDD_SEMAPHORE(name) \
+	__extension__ unsigned short nudd_hash_##name##_semaphore \
+	__attribute__((weak, unused, section(".probes"), visibility("hidden")))
+
+NUDD_SEMAPHORE(hash__entry);
+NUDD_SEMAPHORE(hash__return);
+NUDD_SEMAPHORE(iterated__entry);
+NUDD_SEMAPHORE(iterated__return);
+NUDD_SEMAPHORE(bf__entry);
+NUDD_SEMAPHORE(bf__return);
+NUDD_SEMAPHORE(batch__submit);
+NUDD_SEMAPHORE(batch__done);
+NUDD_SEMAPHORE(scan__job);
+NUDD_SEMAPHORE(scan__switch);
+NUDD_SEMAPHORE(scan__claim);
+NUDD_SEMAPHORE(scan__share);
+NUDD_SEMAPHORE(scrypt__entry);
+NUDD_SEMAPHORE(scrypt__return);
+NUDD_SEMAPHORE(scrypt__lane);
+
+#define NUDD_PROBE_ENABLED(name) \
+	__builtin_expect(nudd_hash_##name##_semaphore != 0, 0)
+#else
+#define NUDD_PROBE_ENABLED(name)	0
+#endif
+
+#ifdef NUDD_TRACE
+#define NUDD_PROBE(name)		DTRACE_PROBE(nudd_hash, name)
+#define NUDD_PROBE1(name, a)		DTRACE_PROBE1(nudd_hash, name, a)
+#define NUDD_PROBE2(name, a, b)		DTRACE_PROBE2(nudd_hash, name, a, b)
+#define NUDD_PROBE3(name, a, b, c)	DTRACE_PROBE3(nudd_hash, name, a, b, c)
+#else
+/* sizeof keeps the arguments "used" without evaluating them */
+#define NUDD_PROBE(name)		do { } while (0)
+#define NUDD_PROBE1(name, a)		do { (void)sizeof(a); } while (0)
+#define NUDD_PROBE2(name, a, b)		do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define NUDD_PROBE3(name, a, b, c) \
+	do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
+
+/* Monotonic nanoseconds for duration arguments; 0 when probes are compiled out */
+#ifdef NUDD_TRACE
+#include <time.h>
+static inline unsigned long long nudd_trace_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+#else
+static inline unsigned long long nudd_trace_ns(void)
+{
+    return 0;
+}
+#endif
+
+/*
+ * A duration probe: NUDD_TRACE_START(name) reads the clock only if name is
+ * enabled, and NUDD_PROBE_ELAPSED fires it with the time since then, so an
+ * idle probe costs a load and a branch at each end.
+ */
+#define NUDD_TRACE_START(name) \
+	(NUDD_PROBE_ENABLED(name) ? nudd_trace_ns() : 0ull)
+#define NUDD_PROBE_ELAPSED(name, a, started) \
+	do { \
+		if (started) \
+			NUDD_PROBE2(name, a, nudd_trace_ns() - (started)); \
+	} while (0)
+
+#endif
@@ -0,0 +1,267 @@
+#include "tune.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "bcrypt.h"
+#include "json.h"
+#include "pow.h"
+
+static const char *engine_names[] = { "specialized", "generic" };
+
+std::string nudd_profile_path()
+{
+    const char *path = getenv("NUDD_HASH_PROFILE");
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char host[256];
+    std::string dir;
+
+    if (path && *path)
+        return path;
+    if (cache && *cache)
+        dir = cache;
+    else if (home && *home)
+        dir = std::string(home) + "/.cache";
+    else
+        dir = "/tmp";
+    if (gethostname(host, sizeof(host)))
+        strcpy(host, "localhost");
+    host[sizeof(host) - 1] = 0;
+    return dir + "/nudd_hash/" + host + ".json";
+}
+
+bool nudd_profile_load(std::string const& path, nudd_profile& profile)
+{
+    std::ifstream in(path.c_str());
+    std::stringstream text;
+    json_value root;
+    json_value const *field;
+    nudd_profile loaded;
+
+    if (!in)
+        return false;
+    text << in.rdbuf();
+    if (!json_parse(text.str(), root) || root.type != json_value::object_value)
+        return false;
+
+    if ((field = root.get("threads")) && field->type == json_value::number_value &&
+        field->number >= 0 && field->number <= 4096)
+        loaded.threads = (unsigned int)field->number;
+    if ((field = root.get("smt")) && field->type == json_value::bool_value)
+        loaded.smt = field->boolean;
+    if ((field = root.get("engine")) && field->type == json_value::string_value) {
+        if (field->string == engine_names[BCRYPT_ENGINE_GENERIC])
+            loaded.engine = BCRYPT_ENGINE_GENERIC;
+        else if (field->string != engine_names[BCRYPT_ENGINE_SPECIALIZED])
+            return false;
+    }
+    if ((field = root.get("lanes")) && field->type == json_value::number_value) {
+        if (field->number != 1 && field->number != 2)
+            return false;
+        loaded.lanes = (unsigned int)field->number;
+    }
+    if ((field = root.get("hashrate")) && field->type == json_value::number_value)
+        loaded.hashrate = field->number;
+    profile = loaded;
+    return true;
+}
+
+/* mkdir -p for the directories leading up to path */
+static void make_parents(std::string const& path)
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos;
+         slash = path.find('/', slash + 1))
+        mkdir(path.substr(0, slash).c_str(), 0755);
+}
+
+bool nudd_profile_save(std::string const& path, nudd_profile const& profile)
+{
+    std::string temporary = path + ".tmp";
+    char host[256];
+    FILE *out;
+
+    if (gethostname(host, sizeof(host)))
+        strcpy(host, "localhost");
+    host[sizeof(host) - 1] = 0;
+
+    make_parents(path);
+    out = fopen(temporary.c_str(), "w");
+    if (!out)
+        return false;
+    fprintf(out, "{\"host\": %s, \"threads\": %u, \"smt\": %s, "
+        "\"engine\": \"%s\", \"lanes\": %u, \"hashrate\": %.1f}\n",
+        json_quote(host).c_str(), profile.threads,
+        profile.smt ? "true" : "false", engine_names[profile.engine],
+        profile.lanes, profile.hashrate);
+    if (fclose(out) || rename(temporary.c_str(), path.c_str())) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+static nudd_profile load_host_profile()
+{
+    nudd_profile profile;
+
+    nudd_profile_load(nudd_profile_path(), profile);
+    bcrypt_set_engine(profile.engine);
+    return profile;
+}
+
+nudd_profile const& nudd_host_profile()
+{
+    static nudd_profile const profile = load_host_profile();
+    return profile;
+}
+
+std::vector<int> nudd_cpu_list(bool smt)
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    std::set<std::string> cores;
+    cpu_set_t allowed;
+
+    if (!sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            if (!smt) {
+                char name[96];
+                std::string siblings;
+                snprintf(name, sizeof(name),
+                    "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+                std::ifstream in(name);
+                if (in && std::getline(in, siblings) && !cores.insert(siblings).second)
+                    continue;
+            }
+            cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        unsigned int count = std::thread::hardware_concurrency();
+        for (unsigned int cpu = 0; cpu < (count ? count : 1); cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+void nudd_pin_thread(std::thread& thread, std::vector<int> const& cpus, size_t i)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (cpus.empty())
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[i % cpus.size()], &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)cpus;
+    (void)i;
+#endif
+}
+
+/*
+ * Hashes per second with threads pinned to cpus (unpinned if empty),
+ * hashing each header's halves one after the other or interleaved
+ */
+static double measure(unsigned int threads, std::vector<int> const& cpus,
+    unsigned int lanes, double seconds)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = start +
+        std::chrono::microseconds((long long)(seconds * 1e6));
+    std::atomic<unsigned long long> hashes(0);
+    std::vector<std::thread> workers;
+
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([t, lanes, deadline, &hashes]() {
+            char header[NUDD_HEADER_SIZE], hash[NUDD_HASH_SIZE];
+            unsigned long long done = 0;
+
+            memset(header, 0x5a, sizeof(header));
+            le32enc(header + 64, t);
+            do {
+                le32enc(header + 76, (uint32_t)done++);
+                if (lanes == 2)
+                    nudd_hash_interleaved(header, hash);
+                else
+                    nudd_hash(header, hash);
+            } while (std::chrono::steady_clock::now() < deadline);
+            hashes += done;
+        }));
+        nudd_pin_thread(workers.back(), cpus, t);
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return hashes / elapsed.count();
+}
+
+nudd_profile nudd_tune(double seconds)
+{
+    std::vector<int> all = nudd_cpu_list(true);
+    std::vector<int> cores = nudd_cpu_list(false);
+    int previous = bcrypt_engine();
+    struct trial {
+        unsigned int threads;
+        bool smt;
+    };
+    std::vector<trial> trials;
+    nudd_profile best;
+
+    /* Powers of two up to each limit, and the limit itself */
+    for (int smt = 0; smt < 2; smt++) {
+        unsigned int limit = (unsigned int)(smt ? all.size() : cores.size());
+        /* Without SMT siblings both passes would be the same, unpinned */
+        if (smt && all.size() == cores.size())
+            break;
+        for (unsigned int threads = 1; ; threads *= 2) {
+            trial t = { threads < limit ? threads : limit,
+                smt || all.size() == cores.size() };
+            trials.push_back(t);
+            if (threads >= limit)
+                break;
+        }
+    }
+
+    double each = seconds / (4 * trials.size());
+    for (int engine = 0; engine < 2; engine++) {
+        bcrypt_set_engine(engine);
+        for (unsigned int lanes = 1; lanes <= 2; lanes++) {
+            for (size_t i = 0; i < trials.size(); i++) {
+                std::vector<int> pinned;
+                if (!trials[i].smt)
+                    pinned = cores;
+                double rate = measure(trials[i].threads, pinned, lanes, each);
+                if (rate > best.hashrate) {
+                    best.threads = trials[i].threads;
+                    best.smt = trials[i].smt;
+                    best.engine = engine;
+                    best.lanes = lanes;
+                    best.hashrate = rate;
+                }
+            }
+        }
+    }
+    bcrypt_set_engine(previous);
+    return best;
+}
@@ -0,0 +1,66 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Per-host hashing configuration.  Eksblowfish keeps about 4 KB of S-boxes
+ * per hash in flight, so SMT siblings sharing a core's L1 can lose more
+ * than they gain, and which BF_crypt engine wins depends on the CPU, as
+ * does whether stepping a header's two halves together beats hashing them
+ * one after the other.
+ * nudd_tune() measures the combinations on this machine; the result is
+ * stored in a small JSON file that the scanner and hashing pool read the
+ * first time they start.
+ */
+struct nudd_profile {
+    /* Hashing threads; 0 means one per hardware thread */
+    unsigned int threads;
+
+    /* false pins threads to one hardware thread per physical core */
+    bool smt;
+
+    /* BCRYPT_ENGINE_SPECIALIZED or BCRYPT_ENGINE_GENERIC */
+    int engine;
+
+    /* Halves of a header hashed at once: 1 serial, 2 interleaved */
+    unsigned int lanes;
+
+    /* Hashes per second measured for this configuration, 0 if untuned */
+    double hashrate;
+
+    nudd_profile() : threads(0), smt(true), engine(0), lanes(2), hashrate(0) {}
+};
+
+/*
+ * $NUDD_HASH_PROFILE if set, else nudd_hash/<hostname>.json under
+ * $XDG_CACHE_HOME or ~/.cache.  The hostname keeps machines that share a
+ * home directory apart.
+ */
+std::string nudd_profile_path();
+
+bool nudd_profile_load(std::string const& path, nudd_profile& profile);
+bool nudd_profile_save(std::string const& path, nudd_profile const& profile);
+
+/*
+ * The profile loaded from nudd_profile_path() on first use, or the
+ * defaults if there is none.  Loading it also selects its bcrypt engine.
+ */
+nudd_profile const& nudd_host_profile();
+
+/*
+ * Tries every thread count, SMT setting, engine and lane count worth
+ * trying, for about seconds in total, and returns the fastest.  The engine
+ * in use is left as it was.
+ */
+nudd_profile nudd_tune(double seconds);
+
+/* CPUs to place threads on: all of them, or the first sibling of each core */
+std::vector<int> nudd_cpu_list(bool smt);
+
+/* Pins thread i of a group to cpus[i % cpus.size()]; a no-op off Linux */
+void nudd_pin_thread(std::thread& thread, std::vector<int> const& cpus, size_t i);
+
+#endif
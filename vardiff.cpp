@@ -0,0 +1,128 @@
+#include "vardiff.h"
+
+#include <algorithm>
+
+/* A window this far ahead of its target rate is cut short */
+#define VARDIFF_FLOOD_FACTOR	4
+#define VARDIFF_FLOOD_MINIMUM	8
+
+/* Changes smaller than this are not worth a mining.set_difficulty */
+#define VARDIFF_HYSTERESIS	1.25
+
+vardiff_controller::vardiff_controller(vardiff_config const& config)
+    : config(config), known(0)
+{
+}
+
+double vardiff_controller::clamp(double difficulty) const
+{
+    return std::min(std::max(difficulty, config.min_difficulty),
+        config.max_difficulty);
+}
+
+double vardiff_controller::rate_locked() const
+{
+    double rate = config.shares_per_minute / 60;
+
+    size_t sharing = std::max(known, tracked.size());
+
+    if (config.budget > 0 && sharing)
+        rate = std::min(rate, config.budget / sharing);
+    return rate;
+}
+
+double vardiff_controller::add_worker(uint32_t worker, double difficulty,
+    int64_t now_us)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    worker_state& state = tracked[worker];
+
+    state.difficulty = clamp(difficulty);
+    state.hashrate = -1;
+    state.window_start_us = now_us;
+    state.shares = 0;
+    return state.difficulty;
+}
+
+void vardiff_controller::remove_worker(uint32_t worker)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    tracked.erase(worker);
+}
+
+void vardiff_controller::set_workers(size_t count)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    known = count;
+}
+
+bool vardiff_controller::record_share(uint32_t worker, int64_t now_us,
+    double *difficulty)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<uint32_t, worker_state>::iterator found = tracked.find(worker);
+    double rate = rate_locked(), elapsed, measured, next;
+    bool flood;
+
+    if (found == tracked.end())
+        return false;
+    worker_state& state = found->second;
+    state.shares++;
+
+    elapsed = std::max(now_us - state.window_start_us, (int64_t)1) / 1e6;
+    flood = state.shares >= VARDIFF_FLOOD_MINIMUM &&
+        state.shares > VARDIFF_FLOOD_FACTOR * std::max(rate * elapsed, 1.0);
+    if (elapsed < config.retarget_seconds && !flood)
+        return false;
+
+    measured = state.shares / elapsed * state.difficulty;
+    if (state.hashrate < 0 || flood)
+        state.hashrate = measured;
+    else
+        state.hashrate = (state.hashrate + measured) / 2;
+    state.window_start_us = now_us;
+    state.shares = 0;
+
+    next = clamp(std::max(state.hashrate / rate,
+        state.difficulty / config.max_step));
+    if (next < state.difficulty * VARDIFF_HYSTERESIS &&
+        next > state.difficulty / VARDIFF_HYSTERESIS)
+        return false;
+    state.difficulty = next;
+    *difficulty = next;
+    return true;
+}
+
+double vardiff_controller::difficulty(uint32_t worker) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<uint32_t, worker_state>::const_iterator found = tracked.find(worker);
+
+    return found == tracked.end() ? 0 : found->second.difficulty;
+}
+
+double vardiff_controller::target_rate() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return rate_locked();
+}
+
+double vardiff_controller::expected_rate() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    double total = 0;
+
+    for (std::map<uint32_t, worker_state>::const_iterator i = tracked.begin();
+            i != tracked.end(); ++i)
+        if (i->second.hashrate >= 0)
+            total += i->second.hashrate / i->second.difficulty;
+    return total;
+}
+
+size_t vardiff_controller::workers() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return tracked.size();
+}
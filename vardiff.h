@@ -0,0 +1,91 @@
+#ifndef VARDIFF_H
+#define VARDIFF_H
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+
+/*
+ * Variable share difficulty.  Validating a share costs one hash whatever
+ * its difficulty, so the pool's CPU follows the share rate; this keeps
+ * every worker near shares_per_minute, and when budget (shares per second
+ * across all workers) is set, lowers that rate for everyone as workers
+ * join so the total stays within it.  The split counts every worker the
+ * caller reports through set_workers(), fixed-target ones included, as
+ * well as those tracked here.
+ *
+ * Each worker's shares are counted over a window.  Once retarget_seconds
+ * have passed, at its next share, the window's rate times the difficulty
+ * gives the worker's hashrate (in difficulty-1 shares per second, smoothed
+ * across windows), and the new difficulty is that over the target rate.
+ * A worker sending shares four times faster than its target is retargeted
+ * straight away, on its own measurement alone, and nothing limits how far
+ * its difficulty rises; falls are limited to max_step per window so one
+ * unlucky window does not flood the pool.
+ *
+ * Times are caller-supplied microseconds from any monotonic clock.
+ */
+struct vardiff_config {
+    double shares_per_minute;
+    double budget;
+    double min_difficulty;
+    double max_difficulty;
+    double retarget_seconds;
+    double max_step;
+
+    vardiff_config()
+        : shares_per_minute(20), budget(0), min_difficulty(1.0 / 65536),
+          max_difficulty(4294967296.0), retarget_seconds(30), max_step(4) {}
+};
+
+class vardiff_controller {
+public:
+    explicit vardiff_controller(vardiff_config const& config = vardiff_config());
+
+    /* Starts tracking worker at difficulty (clamped to the configured range) */
+    double add_worker(uint32_t worker, double difficulty, int64_t now_us);
+    void remove_worker(uint32_t worker);
+
+    /* Workers sharing the budget, whether or not they are tracked */
+    void set_workers(size_t count);
+
+    /*
+     * Counts a share from worker.  Returns true with *difficulty set when
+     * it retargeted the worker to a new difficulty; false for unknown
+     * workers and when the difficulty stays.
+     */
+    bool record_share(uint32_t worker, int64_t now_us, double *difficulty);
+
+    /* Current difficulty of worker, or 0 if it is not tracked */
+    double difficulty(uint32_t worker) const;
+
+    /* Shares per second each worker is being steered to */
+    double target_rate() const;
+
+    /* Expected shares per second across all workers at their hashrates */
+    double expected_rate() const;
+
+    size_t workers() const;
+
+private:
+    struct worker_state {
+        double difficulty;
+        double hashrate;
+        int64_t window_start_us;
+        uint64_t shares;
+    };
+
+    vardiff_controller(vardiff_controller const&);
+    vardiff_controller& operator=(vardiff_controller const&);
+
+    double clamp(double difficulty) const;
+    double rate_locked() const;
+
+    vardiff_config config;
+    mutable std::mutex lock;
+    std::map<uint32_t, worker_state> tracked;
+    size_t known;
+};
+
+#endif